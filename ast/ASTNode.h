@@ -5,15 +5,29 @@
 #include <cassert>
 #include <vector>
 #include <string>
-#include <tuple>
+#include "Bytecode.h"
+#include "BytecodeEmitter.h"
+#include "SlotResolver.h"
 
 
 class ASTNode {
  public:
   virtual ~ASTNode() = default;
 
-  virtual std::vector<std::tuple<std::string, std::vector<int64_t>>> generateBytecode(size_t currentOffset) const {
-    return std::vector<std::tuple<std::string, std::vector<int64_t>>>();
+  // Appends the node's stack bytecode to the program being emitted.
+  virtual void generateBytecode(BytecodeEmitter& /*emitter*/, const SlotResolver& /*slots*/) const {}
+
+  // Whether that bytecode leaves a value on the operand stack, as the
+  // bytecode of an expression does.
+  [[nodiscard]] virtual bool leavesValue() const { return false; }
+
+  // Emits the node as a statement, dropping the value of an expression such
+  // as a call whose result is unused.
+  void generateStatement(BytecodeEmitter& emitter, const SlotResolver& slots) const {
+    generateBytecode(emitter, slots);
+    if (leavesValue()) {
+      emitter.emit(OpCode::POP);
+    }
   }
 };
 
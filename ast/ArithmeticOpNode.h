@@ -2,7 +2,10 @@
 #define ARITHMETIC_OP_NODE_H
 
 #include <cassert>
+#include <limits>
 #include "ASTNode.h"
+#include "NumberAST.h"
+#include "VariableAST.h"
 
 class ArithmeticOpNode : public ASTNode {
  public:
@@ -26,34 +29,68 @@ class ArithmeticOpNode : public ASTNode {
   [[nodiscard]] ASTNode* getRight() const { return right_; }
   [[nodiscard]] Operator getOperator() const { return op_; }
 
-  std::vector<std::tuple<std::string, std::vector<int64_t>>> generateBytecode(size_t currentOffset) const override {
-    std::vector<std::tuple<std::string, std::vector<int64_t>>> bytecode;
+  // Replace an operand, freeing the old one.
+  void setLeft(ASTNode* left) {
+    delete left_;
+    left_ = left;
+  }
+  void setRight(ASTNode* right) {
+    delete right_;
+    right_ = right;
+  }
 
-    auto leftBytecode = left_->generateBytecode(currentOffset);
-    currentOffset += leftBytecode.size();
-    auto rightBytecode = right_->generateBytecode(currentOffset);
-    currentOffset += rightBytecode.size();
+  [[nodiscard]] bool leavesValue() const override { return true; }
 
-    bytecode.insert(bytecode.end(), leftBytecode.begin(), leftBytecode.end());
-    bytecode.insert(bytecode.end(), rightBytecode.begin(), rightBytecode.end());
+  void generateBytecode(BytecodeEmitter& emitter, const SlotResolver& slots) const override {
+    if (generateAddSlotConst(emitter, slots)) {
+      return;
+    }
+
+    left_->generateBytecode(emitter, slots);
+    right_->generateBytecode(emitter, slots);
 
     switch (op_) {
-      case Operator::ADD: bytecode.emplace_back("ADD", std::vector<int64_t>());
+      case Operator::ADD: emitter.emit(OpCode::ADD);
         break;
-      case Operator::SUBTRACT: bytecode.emplace_back("SUBTRACT", std::vector<int64_t>());
+      case Operator::SUBTRACT: emitter.emit(OpCode::SUBTRACT);
         break;
-      case Operator::MULTIPLY: bytecode.emplace_back("MULTIPLY", std::vector<int64_t>());
+      case Operator::MULTIPLY: emitter.emit(OpCode::MULTIPLY);
         break;
-      case Operator::DIVIDE: bytecode.emplace_back("DIVIDE", std::vector<int64_t>());
+      case Operator::DIVIDE: emitter.emit(OpCode::DIVIDE);
         break;
-      case Operator::MODULO: bytecode.emplace_back("MODULO", std::vector<int64_t>());
+      case Operator::MODULO: emitter.emit(OpCode::MODULO);
         break;
     }
-
-    return bytecode;
   }
 
  private:
+  // `x + c`, `c + x` and `x - c` on a frame-local variable become a single
+  // ADD_SLOT_CONST (subtraction adds the negated constant).
+  bool generateAddSlotConst(BytecodeEmitter& emitter, const SlotResolver& slots) const {
+    const VariableRefAST* variable = nullptr;
+    const NumberAST* number = nullptr;
+    if (op_ == Operator::ADD || op_ == Operator::SUBTRACT) {
+      variable = dynamic_cast<const VariableRefAST*>(left_);
+      number = dynamic_cast<const NumberAST*>(right_);
+    }
+    if (op_ == Operator::ADD && !variable) {
+      variable = dynamic_cast<const VariableRefAST*>(right_);
+      number = dynamic_cast<const NumberAST*>(left_);
+    }
+    if (!variable || !number) {
+      return false;
+    }
+
+    auto slot = slots.slotOf(variable->getName());
+    int64_t value = number->getValue();
+    if (slot.global || (op_ == Operator::SUBTRACT && value == std::numeric_limits<int64_t>::min())) {
+      return false;
+    }
+
+    emitter.emit(OpCode::ADD_SLOT_CONST, {slot.index, op_ == Operator::SUBTRACT ? -value : value});
+    return true;
+  }
+
   ASTNode* left_;
   Operator op_;
   ASTNode* right_;
@@ -10,32 +10,44 @@ class ArrayAccessAST : public ASTNode {
   ArrayAccessAST(std::string arrayName, ASTNode* index)
       : arrayName(std::move(arrayName)), index(index) {}
 
+  ~ArrayAccessAST() override {
+    delete index;
+  }
+
   [[nodiscard]] const std::string& getArrayName() const { return arrayName; }
   [[nodiscard]] ASTNode* getIndex() const { return index; }
 
+  // Replaces the index, freeing the old one.
+  void setIndex(ASTNode* newIndex) {
+    delete index;
+    index = newIndex;
+  }
 
-  [[nodiscard]] std::vector<std::tuple<std::string, std::vector<int64_t>>> generateBytecode(size_t currentOffset) const override {
-    std::vector<std::tuple<std::string, std::vector<int64_t>>> bytecode;
+  // Set by the optimizer once the index is proven to lie inside the array,
+  // which then is read and written without a bounds check.
+  [[nodiscard]] bool isInBounds() const { return inBounds; }
+  void markInBounds() { inBounds = true; }
 
-    auto indexBytecode = index->generateBytecode(currentOffset);
-    currentOffset += indexBytecode.size();
-    bytecode.insert(bytecode.end(), indexBytecode.begin(), indexBytecode.end());
 
-    std::vector<int64_t> operands;
-    operands.push_back(arrayName.size());
-    for (char c : arrayName) {
-      operands.push_back(static_cast<int64_t>(c));
-    }
+  [[nodiscard]] bool leavesValue() const override { return true; }
 
-    bytecode.emplace_back("LOAD_ARRAY_ELEMENT", operands);
+  void generateBytecode(BytecodeEmitter& emitter, const SlotResolver& slots) const override {
+    index->generateBytecode(emitter, slots);
 
-    return bytecode;
+    auto slot = slots.slotOf(arrayName);
+    if (inBounds) {
+      emitter.emit(slot.global ? OpCode::LOAD_GLOBAL_ELEMENT_UNCHECKED : OpCode::LOAD_ARRAY_ELEMENT_UNCHECKED,
+                   {slot.index});
+    } else {
+      emitter.emit(slot.global ? OpCode::LOAD_GLOBAL_ELEMENT : OpCode::LOAD_ARRAY_ELEMENT, {slot.index});
+    }
   }
 
 
  private:
   std::string arrayName;
   ASTNode* index;
+  bool inBounds = false;
 };
 
 class ArrayDeclAST : public ASTNode {
@@ -48,28 +60,16 @@ class ArrayDeclAST : public ASTNode {
   [[nodiscard]] int64_t getSize() const { return size; }
   [[nodiscard]] const std::vector<int64_t>& getElements() const { return elements; }
 
-  [[nodiscard]] std::vector<std::tuple<std::string, std::vector<int64_t>>> generateBytecode(size_t currentOffset) const override {
-    std::vector<std::tuple<std::string, std::vector<int64_t>>> bytecode;
-
-
-    std::vector<int64_t> operands;
-    operands.push_back(size);
-    operands.push_back(name.size());
-    for (char c : name) {
-      operands.push_back(static_cast<int64_t>(c));
-    }
+  void generateBytecode(BytecodeEmitter& emitter, const SlotResolver& slots) const override {
+    emitter.emit(OpCode::DECLARE_ARRAY, {slots.slotOf(name).index, size});
 
     for (int64_t i = 0; i < size && i < static_cast<int64_t>(elements.size()); ++i) {
-      operands.push_back(elements[i]);
+      emitter.emitWord(elements[i]);
     }
 
     for (int64_t i = elements.size(); i < size; ++i) {
-      operands.push_back(0);
+      emitter.emitWord(0);
     }
-
-    bytecode.emplace_back("DECLARE_ARRAY", operands);
-
-    return bytecode;
   }
 
 
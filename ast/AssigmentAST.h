@@ -12,43 +12,28 @@ class AssignmentAST : public ASTNode {
 
   [[nodiscard]] ASTNode* getLHS() const { return lhs.get(); }
   [[nodiscard]] ASTNode* getRHS() const { return rhs.get(); }
+  void setRHS(std::unique_ptr<ASTNode> value) { rhs = std::move(value); }
 
-  std::vector<std::tuple<std::string, std::vector<int64_t>>> generateBytecode(size_t currentOffset) const override {
-    std::vector<std::tuple<std::string, std::vector<int64_t>>> bytecode;
-
+  void generateBytecode(BytecodeEmitter& emitter, const SlotResolver& slots) const override {
     if (auto* arrayAccess = dynamic_cast<ArrayAccessAST*>(lhs.get())) {
-
-      auto indexBytecode = arrayAccess->getIndex()->generateBytecode(currentOffset);
-      currentOffset += indexBytecode.size();
-      bytecode.insert(bytecode.end(), indexBytecode.begin(), indexBytecode.end());
-
-      auto rhsBytecode = rhs->generateBytecode(currentOffset);
-      currentOffset += rhsBytecode.size();
-      bytecode.insert(bytecode.end(), rhsBytecode.begin(), rhsBytecode.end());
-
-      std::vector<int64_t> operands;
-      operands.push_back(arrayAccess->getArrayName().size());
-      for (char c : arrayAccess->getArrayName()) {
-        operands.push_back(static_cast<int64_t>(c));
+      arrayAccess->getIndex()->generateBytecode(emitter, slots);
+      rhs->generateBytecode(emitter, slots);
+
+      auto slot = slots.slotOf(arrayAccess->getArrayName());
+      if (arrayAccess->isInBounds()) {
+        emitter.emit(slot.global ? OpCode::ASSIGN_GLOBAL_ELEMENT_UNCHECKED : OpCode::ASSIGN_ARRAY_ELEMENT_UNCHECKED,
+                     {slot.index});
+      } else {
+        emitter.emit(slot.global ? OpCode::ASSIGN_GLOBAL_ELEMENT : OpCode::ASSIGN_ARRAY_ELEMENT, {slot.index});
       }
-      bytecode.emplace_back("ASSIGN_ARRAY_ELEMENT", operands);
     } else if (auto* variable = dynamic_cast<VariableRefAST*>(lhs.get())) {
+      rhs->generateBytecode(emitter, slots);
 
-      auto rhsBytecode = rhs->generateBytecode(currentOffset);
-      currentOffset += rhsBytecode.size();
-      bytecode.insert(bytecode.end(), rhsBytecode.begin(), rhsBytecode.end());
-
-      std::vector<int64_t> operands;
-      operands.push_back(variable->getName().size());
-      for (char c : variable->getName()) {
-        operands.push_back(static_cast<int64_t>(c));
-      }
-      bytecode.emplace_back("ASSIGN_VAR", operands);
+      auto slot = slots.slotOf(variable->getName());
+      emitter.emit(slot.global ? OpCode::STORE_GLOBAL : OpCode::STORE_SLOT, {slot.index});
     } else {
       std::cerr << "Unsupported LHS type in AssignmentAST\n";
     }
-
-    return bytecode;
   }
 
  private:
@@ -0,0 +1,190 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <cstdint>
+#include <initializer_list>
+#include <span>
+#include <string>
+#include <vector>
+
+// Instruction stream is a flat vector of 64-bit words: every instruction is
+// its opcode followed by its operands inline. Jump targets and function
+// entries are word offsets into the same vector.
+//
+// Slots are relative to the current frame; top-level code runs in the
+// bottom frame, whose slots are the globals. Functions reach globals through
+// the *_GLOBAL instructions.
+enum class OpCode : int64_t {
+  LOAD_CONST,            // value
+  RESERVE_SLOTS,         // slot count, emitted once at the start of the program
+  STORE_SLOT,            // slot
+  LOAD_SLOT,             // slot
+  DECLARE_ARRAY,         // slot, size, size * element
+  ASSIGN_ARRAY_ELEMENT,  // slot
+  LOAD_ARRAY_ELEMENT,    // slot
+  STORE_GLOBAL,          // global slot
+  LOAD_GLOBAL,           // global slot
+  ASSIGN_GLOBAL_ELEMENT, // global slot
+  LOAD_GLOBAL_ELEMENT,   // global slot
+  ADD,
+  SUBTRACT,
+  MULTIPLY,
+  DIVIDE,
+  MODULO,
+  EQUALS,
+  LESS_THAN,
+  GREATER_THAN,
+  LESS_THAN_OR_EQUAL,
+  GREATER_THAN_OR_EQUAL,
+  JUMP,                  // target
+  JUMP_IF_FALSE,         // target
+  // Superinstructions: each one does the work of the sequence in its comment.
+  ADD_SLOT_CONST,        // slot, value: LOAD_SLOT, LOAD_CONST, ADD
+  JUMP_IF_NOT_EQUALS,    // target: EQUALS, JUMP_IF_FALSE
+  JUMP_IF_NOT_LESS_THAN, // target: LESS_THAN, JUMP_IF_FALSE
+  JUMP_IF_NOT_GREATER_THAN,           // target: GREATER_THAN, JUMP_IF_FALSE
+  JUMP_IF_NOT_LESS_THAN_OR_EQUAL,     // target: LESS_THAN_OR_EQUAL, JUMP_IF_FALSE
+  JUMP_IF_NOT_GREATER_THAN_OR_EQUAL,  // target: GREATER_THAN_OR_EQUAL, JUMP_IF_FALSE
+  FOR_LOOP,              // slot, step, limit, target: add step to slot, jump to target while slot < limit
+  STORE_SLOT_KEEP,       // slot: STORE_SLOT, LOAD_SLOT of the same slot
+  DIVIDE_POW2,           // shift: LOAD_CONST 2^shift, DIVIDE
+  MODULO_POW2,           // shift: LOAD_CONST 2^shift, MODULO
+  // Element accesses whose index the compiler proved to be inside the array.
+  // The verified interpreter does not check their bounds again.
+  ASSIGN_ARRAY_ELEMENT_UNCHECKED,   // slot
+  LOAD_ARRAY_ELEMENT_UNCHECKED,     // slot
+  ASSIGN_GLOBAL_ELEMENT_UNCHECKED,  // global slot
+  LOAD_GLOBAL_ELEMENT_UNCHECKED,    // global slot
+  FUNC_DEF,              // function id, arity, frame size, body length
+  CALL_FUNC,             // function id, argument count, 0; rewritten to CALL by the linker
+  CALL,                  // entry, frame size, argument count
+  // Calls of a memoized function: the result is looked up in the function's
+  // memo table by the arguments, and the call only runs on a miss.
+  CALL_FUNC_MEMO,        // function id, argument count, 0, 0; rewritten to CALL_MEMO by the linker
+  CALL_MEMO,             // entry, frame size, argument count, function id
+  RETURN,
+  PRINT,
+  POP,                   // drops the value of an expression statement, e.g. an unused call result
+  HALT,                  // end of program, emitted once after the top level
+  COUNT
+};
+
+using Bytecode = std::vector<int64_t>;
+// Read-only view of a finished program, owned by a Bytecode or mapped from
+// a cache file.
+using BytecodeView = std::span<const int64_t>;
+
+inline const char* opcodeName(OpCode op) {
+  switch (op) {
+    case OpCode::LOAD_CONST: return "LOAD_CONST";
+    case OpCode::RESERVE_SLOTS: return "RESERVE_SLOTS";
+    case OpCode::STORE_SLOT: return "STORE_SLOT";
+    case OpCode::LOAD_SLOT: return "LOAD_SLOT";
+    case OpCode::DECLARE_ARRAY: return "DECLARE_ARRAY";
+    case OpCode::ASSIGN_ARRAY_ELEMENT: return "ASSIGN_ARRAY_ELEMENT";
+    case OpCode::LOAD_ARRAY_ELEMENT: return "LOAD_ARRAY_ELEMENT";
+    case OpCode::STORE_GLOBAL: return "STORE_GLOBAL";
+    case OpCode::LOAD_GLOBAL: return "LOAD_GLOBAL";
+    case OpCode::ASSIGN_GLOBAL_ELEMENT: return "ASSIGN_GLOBAL_ELEMENT";
+    case OpCode::LOAD_GLOBAL_ELEMENT: return "LOAD_GLOBAL_ELEMENT";
+    case OpCode::ADD: return "ADD";
+    case OpCode::SUBTRACT: return "SUBTRACT";
+    case OpCode::MULTIPLY: return "MULTIPLY";
+    case OpCode::DIVIDE: return "DIVIDE";
+    case OpCode::MODULO: return "MODULO";
+    case OpCode::EQUALS: return "EQUALS";
+    case OpCode::LESS_THAN: return "LESS_THAN";
+    case OpCode::GREATER_THAN: return "GREATER_THAN";
+    case OpCode::LESS_THAN_OR_EQUAL: return "LESS_THAN_OR_EQUAL";
+    case OpCode::GREATER_THAN_OR_EQUAL: return "GREATER_THAN_OR_EQUAL";
+    case OpCode::JUMP: return "JUMP";
+    case OpCode::JUMP_IF_FALSE: return "JUMP_IF_FALSE";
+    case OpCode::ADD_SLOT_CONST: return "ADD_SLOT_CONST";
+    case OpCode::JUMP_IF_NOT_EQUALS: return "JUMP_IF_NOT_EQUALS";
+    case OpCode::JUMP_IF_NOT_LESS_THAN: return "JUMP_IF_NOT_LESS_THAN";
+    case OpCode::JUMP_IF_NOT_GREATER_THAN: return "JUMP_IF_NOT_GREATER_THAN";
+    case OpCode::JUMP_IF_NOT_LESS_THAN_OR_EQUAL: return "JUMP_IF_NOT_LESS_THAN_OR_EQUAL";
+    case OpCode::JUMP_IF_NOT_GREATER_THAN_OR_EQUAL: return "JUMP_IF_NOT_GREATER_THAN_OR_EQUAL";
+    case OpCode::FOR_LOOP: return "FOR_LOOP";
+    case OpCode::STORE_SLOT_KEEP: return "STORE_SLOT_KEEP";
+    case OpCode::DIVIDE_POW2: return "DIVIDE_POW2";
+    case OpCode::MODULO_POW2: return "MODULO_POW2";
+    case OpCode::ASSIGN_ARRAY_ELEMENT_UNCHECKED: return "ASSIGN_ARRAY_ELEMENT_UNCHECKED";
+    case OpCode::LOAD_ARRAY_ELEMENT_UNCHECKED: return "LOAD_ARRAY_ELEMENT_UNCHECKED";
+    case OpCode::ASSIGN_GLOBAL_ELEMENT_UNCHECKED: return "ASSIGN_GLOBAL_ELEMENT_UNCHECKED";
+    case OpCode::LOAD_GLOBAL_ELEMENT_UNCHECKED: return "LOAD_GLOBAL_ELEMENT_UNCHECKED";
+    case OpCode::FUNC_DEF: return "FUNC_DEF";
+    case OpCode::CALL_FUNC: return "CALL_FUNC";
+    case OpCode::CALL: return "CALL";
+    case OpCode::CALL_FUNC_MEMO: return "CALL_FUNC_MEMO";
+    case OpCode::CALL_MEMO: return "CALL_MEMO";
+    case OpCode::RETURN: return "RETURN";
+    case OpCode::PRINT: return "PRINT";
+    case OpCode::POP: return "POP";
+    case OpCode::HALT: return "HALT";
+    case OpCode::COUNT: break;
+  }
+  return "UNKNOWN";
+}
+
+// Number of words (opcode included) taken by the instruction starting at ip.
+inline size_t instructionLength(const int64_t* ip) {
+  switch (static_cast<OpCode>(ip[0])) {
+    case OpCode::LOAD_CONST:
+    case OpCode::RESERVE_SLOTS:
+    case OpCode::STORE_SLOT:
+    case OpCode::LOAD_SLOT:
+    case OpCode::ASSIGN_ARRAY_ELEMENT:
+    case OpCode::LOAD_ARRAY_ELEMENT:
+    case OpCode::STORE_GLOBAL:
+    case OpCode::LOAD_GLOBAL:
+    case OpCode::ASSIGN_GLOBAL_ELEMENT:
+    case OpCode::LOAD_GLOBAL_ELEMENT:
+    case OpCode::JUMP:
+    case OpCode::JUMP_IF_FALSE:
+    case OpCode::JUMP_IF_NOT_EQUALS:
+    case OpCode::JUMP_IF_NOT_LESS_THAN:
+    case OpCode::JUMP_IF_NOT_GREATER_THAN:
+    case OpCode::JUMP_IF_NOT_LESS_THAN_OR_EQUAL:
+    case OpCode::JUMP_IF_NOT_GREATER_THAN_OR_EQUAL:
+    case OpCode::STORE_SLOT_KEEP:
+    case OpCode::DIVIDE_POW2:
+    case OpCode::MODULO_POW2:
+    case OpCode::ASSIGN_ARRAY_ELEMENT_UNCHECKED:
+    case OpCode::LOAD_ARRAY_ELEMENT_UNCHECKED:
+    case OpCode::ASSIGN_GLOBAL_ELEMENT_UNCHECKED:
+    case OpCode::LOAD_GLOBAL_ELEMENT_UNCHECKED:
+      return 2;
+    case OpCode::ADD_SLOT_CONST:
+      return 3;
+    case OpCode::DECLARE_ARRAY:
+      return 3 + ip[2];
+    case OpCode::CALL_FUNC:
+    case OpCode::CALL:
+      return 4;
+    case OpCode::FUNC_DEF:
+    case OpCode::FOR_LOOP:
+    case OpCode::CALL_FUNC_MEMO:
+    case OpCode::CALL_MEMO:
+      return 5;
+    default:
+      return 1;
+  }
+}
+
+// The shift that divides by `divisor` in DIVIDE_POW2 and MODULO_POW2 (and
+// their register machine forms), or 0 unless it is a power of two from 2 to
+// 2^62.
+inline int64_t powerOfTwoShift(int64_t divisor) {
+  if (divisor < 2 || (divisor & (divisor - 1)) != 0) {
+    return 0;
+  }
+  return __builtin_ctzll(static_cast<uint64_t>(divisor));
+}
+
+inline void emit(Bytecode& bytecode, OpCode op, std::initializer_list<int64_t> operands = {}) {
+  bytecode.push_back(static_cast<int64_t>(op));
+  bytecode.insert(bytecode.end(), operands.begin(), operands.end());
+}
+
+#endif // BYTECODE_H
@@ -0,0 +1,99 @@
+#ifndef BYTECODE_EMITTER_H
+#define BYTECODE_EMITTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <optional>
+#include <utility>
+#include <vector>
+#include "Bytecode.h"
+
+// Appends the instructions of a whole program to a single buffer, so nodes
+// emit in place and no child's code is ever copied into its parent.
+//
+// Jumps name a Label instead of an offset. A jump to a label that is not
+// bound yet records where its target goes, and bind() patches every such
+// word once the label's offset is known.
+class BytecodeEmitter {
+ public:
+  struct Label {
+    size_t id;
+  };
+
+  // Offset of the next word to be emitted.
+  [[nodiscard]] size_t offset() const { return code_.size(); }
+
+  void emit(OpCode op, std::initializer_list<int64_t> operands = {}) {
+    ::emit(code_, op, operands);
+  }
+
+  // Appends a bare operand word, such as an element of an array literal.
+  void emitWord(int64_t word) {
+    code_.push_back(word);
+  }
+
+  // Emits a jump whose target, the label, is its last operand.
+  void emitJump(OpCode op, Label target, std::initializer_list<int64_t> operands = {}) {
+    emit(op, operands);
+    code_.push_back(0);
+    LabelState& label = labels_[target.id];
+    if (label.offset >= 0) {
+      code_.back() = label.offset;
+    } else {
+      label.uses.push_back(code_.size() - 1);
+    }
+  }
+
+  Label newLabel() {
+    labels_.emplace_back();
+    return {labels_.size() - 1};
+  }
+
+  // Binds the label to the next word to be emitted.
+  void bind(Label target) {
+    LabelState& label = labels_[target.id];
+    label.offset = static_cast<int64_t>(offset());
+    for (size_t use : label.uses) {
+      code_[use] = label.offset;
+    }
+    label.uses.clear();
+  }
+
+  // While the body of an inlined call is emitted, a `return` jumps to the
+  // end of the call instead of leaving the frame.
+  void pushReturnTarget(Label target) {
+    returnTargets_.push_back(target);
+  }
+
+  void popReturnTarget() {
+    returnTargets_.pop_back();
+  }
+
+  [[nodiscard]] std::optional<Label> returnTarget() const {
+    return returnTargets_.empty() ? std::nullopt : std::optional<Label>(returnTargets_.back());
+  }
+
+  // Overwrites an operand emitted earlier, such as a length only known once
+  // the code it measures is emitted.
+  void patch(size_t index, int64_t word) {
+    code_[index] = word;
+  }
+
+  Bytecode take() {
+    labels_.clear();
+    return std::move(code_);
+  }
+
+ private:
+  struct LabelState {
+    int64_t offset = -1;
+    std::vector<size_t> uses;
+  };
+
+  Bytecode code_;
+  std::vector<LabelState> labels_;
+  std::vector<Label> returnTargets_;
+};
+
+#endif // BYTECODE_EMITTER_H
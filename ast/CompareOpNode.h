@@ -26,31 +26,55 @@ class CompareOpNode : public ASTNode {
   [[nodiscard]] ASTNode* getRight() const { return right_; }
   [[nodiscard]] Operator getOperator() const { return op_; }
 
-  std::vector<std::tuple<std::string, std::vector<int64_t>>> generateBytecode(size_t currentOffset) const override {
-    std::vector<std::tuple<std::string, std::vector<int64_t>>> bytecode;
+  // Replace an operand, freeing the old one.
+  void setLeft(ASTNode* left) {
+    delete left_;
+    left_ = left;
+  }
+  void setRight(ASTNode* right) {
+    delete right_;
+    right_ = right;
+  }
 
-    auto leftBytecode = left_->generateBytecode(currentOffset);
-    currentOffset += leftBytecode.size();
-    auto rightBytecode = right_->generateBytecode(currentOffset);
-    currentOffset += rightBytecode.size();
+  [[nodiscard]] bool leavesValue() const override { return true; }
 
-    bytecode.insert(bytecode.end(), leftBytecode.begin(), leftBytecode.end());
-    bytecode.insert(bytecode.end(), rightBytecode.begin(), rightBytecode.end());
+  void generateBytecode(BytecodeEmitter& emitter, const SlotResolver& slots) const override {
+    left_->generateBytecode(emitter, slots);
+    right_->generateBytecode(emitter, slots);
 
     switch (op_) {
-      case Operator::LESS_THAN: bytecode.emplace_back("LESS_THAN", std::vector<int64_t>());
+      case Operator::LESS_THAN: emitter.emit(OpCode::LESS_THAN);
         break;
-      case Operator::GREATER_THAN: bytecode.emplace_back("GREATER_THAN", std::vector<int64_t>());
+      case Operator::GREATER_THAN: emitter.emit(OpCode::GREATER_THAN);
         break;
-      case Operator::LESS_THAN_OR_EQUAL: bytecode.emplace_back("LESS_THAN_OR_EQUAL", std::vector<int64_t>());
+      case Operator::LESS_THAN_OR_EQUAL: emitter.emit(OpCode::LESS_THAN_OR_EQUAL);
         break;
-      case Operator::GREATER_THAN_OR_EQUAL: bytecode.emplace_back("GREATER_THAN_OR_EQUAL", std::vector<int64_t>());
+      case Operator::GREATER_THAN_OR_EQUAL: emitter.emit(OpCode::GREATER_THAN_OR_EQUAL);
         break;
-      case Operator::EQUALS: bytecode.emplace_back("EQUALS", std::vector<int64_t>());
+      case Operator::EQUALS: emitter.emit(OpCode::EQUALS);
         break;
     }
+  }
+
+  // Emits the operands followed by one fused compare-and-branch instruction
+  // that jumps to `target` when the comparison is false.
+  void generateBranchIfFalse(BytecodeEmitter& emitter, const SlotResolver& slots,
+                             BytecodeEmitter::Label target) const {
+    left_->generateBytecode(emitter, slots);
+    right_->generateBytecode(emitter, slots);
 
-    return bytecode;
+    switch (op_) {
+      case Operator::LESS_THAN: emitter.emitJump(OpCode::JUMP_IF_NOT_LESS_THAN, target);
+        break;
+      case Operator::GREATER_THAN: emitter.emitJump(OpCode::JUMP_IF_NOT_GREATER_THAN, target);
+        break;
+      case Operator::LESS_THAN_OR_EQUAL: emitter.emitJump(OpCode::JUMP_IF_NOT_LESS_THAN_OR_EQUAL, target);
+        break;
+      case Operator::GREATER_THAN_OR_EQUAL: emitter.emitJump(OpCode::JUMP_IF_NOT_GREATER_THAN_OR_EQUAL, target);
+        break;
+      case Operator::EQUALS: emitter.emitJump(OpCode::JUMP_IF_NOT_EQUALS, target);
+        break;
+    }
   }
 
  private:
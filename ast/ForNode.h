@@ -7,6 +7,7 @@
 #include <memory>
 #include <cassert>
 #include "ASTNode.h"
+#include "NumberAST.h"
 
 class ForNode : public ASTNode {
  public:
@@ -28,54 +29,66 @@ class ForNode : public ASTNode {
   [[nodiscard]] ASTNode* getFinish() const { return finish_; }
   [[nodiscard]] ASTNode* getStep() const { return step_; }
   [[nodiscard]] const std::vector<std::unique_ptr<ASTNode>>& getBody() const { return body_; }
+  std::vector<std::unique_ptr<ASTNode>>& getBody() { return body_; }
 
-  [[nodiscard]] std::vector<std::tuple<std::string, std::vector<int64_t>>> generateBytecode(size_t currentOffset) const override {
-    std::vector<std::tuple<std::string, std::vector<int64_t>>> bytecode;
-
-    auto startBytecode = getStart()->generateBytecode(currentOffset);
-    bytecode.insert(bytecode.end(), startBytecode.begin(), startBytecode.end());
-
-    std::vector<int64_t> operands;
-    operands.push_back(static_cast<int64_t>(getIteratorName().size()));
-    for (char c : getIteratorName()) {
-      operands.push_back(static_cast<int64_t>(c));
-    }
+  // Replace a bound of the range, freeing the old one.
+  void setStart(ASTNode* start) {
+    delete start_;
+    start_ = start;
+  }
+  void setFinish(ASTNode* finish) {
+    delete finish_;
+    finish_ = finish;
+  }
+  void setStep(ASTNode* step) {
+    delete step_;
+    step_ = step;
+  }
 
-    bytecode.emplace_back("DECLARE_VAR", operands);
+  // The header checks the iterator once on entry with a fused
+  // compare-and-branch. When the step and the limit are constants the back
+  // edge is a single FOR_LOOP that increments, compares and jumps to the body;
+  // otherwise it increments and jumps back to the header, which re-evaluates
+  // the limit.
+  void generateBytecode(BytecodeEmitter& emitter, const SlotResolver& slots) const override {
+    getStart()->generateBytecode(emitter, slots);
 
-    size_t loopStartOffset = currentOffset + bytecode.size();
+    int64_t iteratorSlot = slots.slotOf(getIteratorName()).index;
+    emitter.emit(OpCode::STORE_SLOT, {iteratorSlot});
 
-    bytecode.emplace_back("LOAD_VAR", operands);
-    auto finishBytecode = getFinish()->generateBytecode(currentOffset + bytecode.size());
-    bytecode.insert(bytecode.end(), finishBytecode.begin(), finishBytecode.end());
-    bytecode.emplace_back("LESS_THAN", std::vector<int64_t>{});
+    BytecodeEmitter::Label header = emitter.newLabel();
+    BytecodeEmitter::Label body = emitter.newLabel();
+    BytecodeEmitter::Label end = emitter.newLabel();
 
-    size_t jumpToEndIndex = bytecode.size();
-    bytecode.emplace_back("JUMP_IF_FALSE", std::vector<int64_t>{0});
+    emitter.bind(header);
+    emitter.emit(OpCode::LOAD_SLOT, {iteratorSlot});
+    getFinish()->generateBytecode(emitter, slots);
+    emitter.emitJump(OpCode::JUMP_IF_NOT_LESS_THAN, end);
 
-    size_t bodyOffset = currentOffset + bytecode.size();
+    emitter.bind(body);
     for (const auto& stmt : getBody()) {
-      auto bodyBytecode = stmt->generateBytecode(bodyOffset);
-      bodyOffset += bodyBytecode.size();
-      bytecode.insert(bytecode.end(), bodyBytecode.begin(), bodyBytecode.end());
+      stmt->generateStatement(emitter, slots);
     }
 
-    bytecode.emplace_back("LOAD_VAR", operands);
-    if (getStep()) {
-      auto stepBytecode = getStep()->generateBytecode(currentOffset + bytecode.size());
-      bytecode.insert(bytecode.end(), stepBytecode.begin(), stepBytecode.end());
+    auto* constStep = getStep() ? dynamic_cast<const NumberAST*>(getStep()) : nullptr;
+    auto* constFinish = dynamic_cast<const NumberAST*>(getFinish());
+    int64_t stepValue = constStep ? constStep->getValue() : 1;
+
+    if ((constStep || !getStep()) && constFinish) {
+      emitter.emitJump(OpCode::FOR_LOOP, body, {iteratorSlot, stepValue, constFinish->getValue()});
     } else {
-      bytecode.emplace_back("LOAD_CONST", std::vector<int64_t>{1});
+      if (constStep || !getStep()) {
+        emitter.emit(OpCode::ADD_SLOT_CONST, {iteratorSlot, stepValue});
+      } else {
+        emitter.emit(OpCode::LOAD_SLOT, {iteratorSlot});
+        getStep()->generateBytecode(emitter, slots);
+        emitter.emit(OpCode::ADD);
+      }
+      emitter.emit(OpCode::STORE_SLOT, {iteratorSlot});
+      emitter.emitJump(OpCode::JUMP, header);
     }
-    bytecode.emplace_back("ADD", std::vector<int64_t>{});
-    bytecode.emplace_back("ASSIGN_VAR", operands);
-
-    bytecode.emplace_back("JUMP", std::vector<int64_t>{static_cast<int64_t>(loopStartOffset)});
-
-    size_t loopEndOffset = currentOffset + bytecode.size();
-    std::get<1>(bytecode[jumpToEndIndex])[0] = static_cast<int64_t>(loopEndOffset);
 
-    return bytecode;
+    emitter.bind(end);
   }
  private:
   std::string iteratorName_;
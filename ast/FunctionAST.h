@@ -1,6 +1,7 @@
 #ifndef MATUR_PL_AST_FUNCTIONAST_H_
 #define MATUR_PL_AST_FUNCTIONAST_H_
 
+#include <stdexcept>
 #include <string>
 #include <vector>
 #include <memory>
@@ -17,46 +18,31 @@ class FunctionDeclNode : public ASTNode {
 
   [[nodiscard]] const std::string& getFunctionName() const { return function_name_; }
   [[nodiscard]] const std::vector<std::unique_ptr<ASTNode>>& getBody() const { return body_; }
+  std::vector<std::unique_ptr<ASTNode>>& getBody() { return body_; }
   [[nodiscard]] const std::vector<std::string>& getParameters() const { return parameters_; }
 
-  std::vector<std::tuple<std::string, std::vector<int64_t>>> generateBytecode(size_t offset) const override {
-    std::vector<std::tuple<std::string, std::vector<int64_t>>> bytecode;
-    std::vector<std::tuple<std::string, std::vector<int64_t>>> finish_bytecode;
+  void generateBytecode(BytecodeEmitter& emitter, const SlotResolver& slots) const override {
+    // Parameters are the first slots of the frame; CALL moves the arguments
+    // into them, so the body starts right after the header.
+    const SlotResolver::Function& function = slots.function(function_name_);
+    const SlotResolver& frame = *function.frame;
 
-    std::vector<int64_t> operands;
+    // The body length is patched into the header once the body is emitted.
+    emitter.emit(OpCode::FUNC_DEF, {function.id, function.arity, static_cast<int64_t>(frame.slotCount()), 0});
+    size_t lengthIndex = emitter.offset() - 1;
 
-
-
-    for (const auto & parameter : parameters_) {
-      operands.clear();
-      operands.push_back(static_cast<int64_t>(parameter.size()));
-      for (char c : parameter) {
-        operands.push_back(static_cast<int64_t>(c));
-      }
-      bytecode.emplace_back("DECLARE_VAR",  operands);
-    }
-
-
-    size_t body_offset = offset + bytecode.size() + 1;
     for (const auto& stmt : body_) {
-      auto stmtBytecode = stmt->generateBytecode(body_offset);
-      body_offset += stmtBytecode.size();
-      bytecode.insert(bytecode.end(), stmtBytecode.begin(), stmtBytecode.end());
+      stmt->generateStatement(emitter, frame);
     }
 
-    if (!bytecode.empty() && std::get<0>(bytecode.back()) != "RETURN") {
-      bytecode.emplace_back("RETURN", std::vector<int64_t>{});
-    }
-    operands.clear();
-    operands.push_back(static_cast<int64_t>(function_name_.size()));
-    for (char c : function_name_) {
-      operands.push_back(static_cast<int64_t>(c));
-    }
-    operands.push_back(static_cast<int64_t>(bytecode.size()));
-    finish_bytecode.emplace_back("FUNC_DEF", operands);
-    finish_bytecode.insert(finish_bytecode.end(), bytecode.begin(), bytecode.end());
-    return finish_bytecode;
+    // A trailing RETURN is always emitted: the last word of the body may be an
+    // operand that happens to equal the RETURN opcode, so it cannot be checked.
+    // A body that ends without `return` returns 0, like RETURN_VOID in the
+    // register VM, so every call leaves exactly one value.
+    emitter.emit(OpCode::LOAD_CONST, {0});
+    emitter.emit(OpCode::RETURN);
 
+    emitter.patch(lengthIndex, static_cast<int64_t>(emitter.offset() - lengthIndex - 1));
   }
 
  private:
@@ -70,12 +56,28 @@ class ReturnNode : public ASTNode {
   explicit ReturnNode(ASTNode* expression)
       : expression_(expression) {}
 
+  ~ReturnNode() override {
+    delete expression_;
+  }
+
   [[nodiscard]] const ASTNode* getExpression() const { return expression_; }
+  [[nodiscard]] ASTNode* getExpression() { return expression_; }
+
+  // Replaces the returned expression, freeing the old one.
+  void setExpression(ASTNode* expression) {
+    delete expression_;
+    expression_ = expression;
+  }
 
-  std::vector<std::tuple<std::string, std::vector<int64_t>>> generateBytecode(size_t offset) const override {
-    auto bytecode = expression_->generateBytecode(offset);
-    bytecode.emplace_back("RETURN", std::vector<int64_t>{});
-    return bytecode;
+  // Inside an inlined call the result stays on the operand stack and the
+  // return jumps past the inlined body.
+  void generateBytecode(BytecodeEmitter& emitter, const SlotResolver& slots) const override {
+    expression_->generateBytecode(emitter, slots);
+    if (auto target = emitter.returnTarget()) {
+      emitter.emitJump(OpCode::JUMP, *target);
+    } else {
+      emitter.emit(OpCode::RETURN);
+    }
   }
 
  private:
@@ -91,26 +93,81 @@ class FunctionCallNode : public ASTNode {
 
   [[nodiscard]] const std::string& getFunctionName() const { return function_name_; }
   [[nodiscard]] const std::vector<std::unique_ptr<ASTNode>>& getArguments() const { return arguments_; }
+  std::vector<std::unique_ptr<ASTNode>>& getArguments() { return arguments_; }
+
+  [[nodiscard]] bool leavesValue() const override { return true; }
+
+  void generateBytecode(BytecodeEmitter& emitter, const SlotResolver& slots) const override {
+    const SlotResolver::Function& function = slots.function(function_name_);
+    auto argumentCount = static_cast<int64_t>(arguments_.size());
+    if (argumentCount != function.arity) {
+      throw std::runtime_error("Function " + function_name_ + " expects " + std::to_string(function.arity) +
+          " arguments, got " + std::to_string(argumentCount));
+    }
 
-  std::vector<std::tuple<std::string, std::vector<int64_t>>> generateBytecode(size_t offset) const override {
-    std::vector<std::tuple<std::string, std::vector<int64_t>>> bytecode;
-    std::vector<int64_t> operands;
     for (auto it = arguments_.rbegin(); it != arguments_.rend(); ++it) {
-      auto argBytecode = it->get()->generateBytecode(offset + bytecode.size());
-      bytecode.insert(bytecode.end(), argBytecode.begin(), argBytecode.end());
+      it->get()->generateBytecode(emitter, slots);
     }
-    operands.push_back(static_cast<int64_t>(function_name_.size()));
-    for (char c : function_name_) {
-      operands.push_back(static_cast<int64_t>(c));
+    if (function.memoized) {
+      emitter.emit(OpCode::CALL_FUNC_MEMO, {function.id, argumentCount, 0, 0});
+    } else {
+      emitter.emit(OpCode::CALL_FUNC, {function.id, argumentCount, 0});
     }
-    bytecode.emplace_back("CALL_FUNC", operands);
+  }
 
-    return bytecode;
+ private:
+  std::string function_name_;
+  std::vector<std::unique_ptr<ASTNode>> arguments_;
+};
+
+// A call whose function body the optimizer copied into the caller. The
+// copy's parameters and locals are renamed to variables of the caller's
+// frame, so the call needs no frame of its own: the arguments are evaluated
+// as for CALL and stored into the parameters, and the body's last statement
+// is a `return`.
+class InlinedCallNode : public ASTNode {
+ public:
+  InlinedCallNode(std::string function_name,
+                  std::vector<std::string> parameters,
+                  std::vector<std::unique_ptr<ASTNode>> arguments,
+                  std::vector<std::unique_ptr<ASTNode>> body)
+      : function_name_(std::move(function_name)),
+        parameters_(std::move(parameters)),
+        arguments_(std::move(arguments)),
+        body_(std::move(body)) {}
+
+  [[nodiscard]] const std::string& getFunctionName() const { return function_name_; }
+  [[nodiscard]] const std::vector<std::string>& getParameters() const { return parameters_; }
+  [[nodiscard]] const std::vector<std::unique_ptr<ASTNode>>& getArguments() const { return arguments_; }
+  [[nodiscard]] const std::vector<std::unique_ptr<ASTNode>>& getBody() const { return body_; }
+
+  [[nodiscard]] bool leavesValue() const override { return true; }
+
+  void generateBytecode(BytecodeEmitter& emitter, const SlotResolver& slots) const override {
+    for (auto it = arguments_.rbegin(); it != arguments_.rend(); ++it) {
+      it->get()->generateBytecode(emitter, slots);
+    }
+    // The first argument is on top.
+    for (const auto& parameter : parameters_) {
+      emitter.emit(OpCode::STORE_SLOT, {slots.slotOf(parameter).index});
+    }
+
+    // The closing `return` leaves its value where the others jump to.
+    BytecodeEmitter::Label end = emitter.newLabel();
+    emitter.pushReturnTarget(end);
+    for (size_t i = 0; i + 1 < body_.size(); ++i) {
+      body_[i]->generateStatement(emitter, slots);
+    }
+    emitter.popReturnTarget();
+    static_cast<const ReturnNode&>(*body_.back()).getExpression()->generateBytecode(emitter, slots);
+    emitter.bind(end);
   }
 
  private:
   std::string function_name_;
+  std::vector<std::string> parameters_;
   std::vector<std::unique_ptr<ASTNode>> arguments_;
+  std::vector<std::unique_ptr<ASTNode>> body_;
 };
 
 #endif //MATUR_PL_AST_FUNCTIONAST_H_
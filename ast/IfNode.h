@@ -5,6 +5,7 @@
 #include <memory>
 #include <cassert>
 #include "ASTNode.h"
+#include "CompareOpNode.h"
 
 class IfNode : public ASTNode {
  public:
@@ -20,44 +21,40 @@ class IfNode : public ASTNode {
   [[nodiscard]] ASTNode* getCondition() const { return condition_; }
   [[nodiscard]] const std::vector<std::unique_ptr<ASTNode>>& getThenBody() const { return thenBody_; }
   [[nodiscard]] const std::vector<std::unique_ptr<ASTNode>>& getElseBody() const { return elseBody_; }
+  std::vector<std::unique_ptr<ASTNode>>& getThenBody() { return thenBody_; }
+  std::vector<std::unique_ptr<ASTNode>>& getElseBody() { return elseBody_; }
 
-  std::vector<std::tuple<std::string, std::vector<int64_t>>> generateBytecode(size_t currentOffset) const override {
-    std::vector<std::tuple<std::string, std::vector<int64_t>>> bytecode;
-
-    auto conditionBytecode = condition_->generateBytecode(currentOffset);
-    bytecode.insert(bytecode.end(), conditionBytecode.begin(), conditionBytecode.end());
+  // Replaces the condition, freeing the old one.
+  void setCondition(ASTNode* condition) {
+    delete condition_;
+    condition_ = condition;
+  }
 
-    bytecode.emplace_back("JUMP_IF_FALSE", std::vector<int64_t>{0});
-    size_t jumpIfFalseIndex = bytecode.size() - 1;
+  void generateBytecode(BytecodeEmitter& emitter, const SlotResolver& slots) const override {
+    BytecodeEmitter::Label elseLabel = emitter.newLabel();
+    if (auto* compare = dynamic_cast<const CompareOpNode*>(condition_)) {
+      compare->generateBranchIfFalse(emitter, slots, elseLabel);
+    } else {
+      condition_->generateBytecode(emitter, slots);
+      emitter.emitJump(OpCode::JUMP_IF_FALSE, elseLabel);
+    }
 
-    auto then_offset = currentOffset + bytecode.size();
     for (const auto& stmt : thenBody_) {
-      auto thenBytecode = stmt->generateBytecode(then_offset);
-      then_offset += thenBytecode.size();
-      bytecode.insert(bytecode.end(), thenBytecode.begin(), thenBytecode.end());
+      stmt->generateStatement(emitter, slots);
     }
 
-    size_t jumpIndex = 0;
-    if (!elseBody_.empty()) {
-      bytecode.emplace_back("JUMP", std::vector<int64_t>{0});
-      jumpIndex = bytecode.size() - 1;
+    if (elseBody_.empty()) {
+      emitter.bind(elseLabel);
+      return;
     }
 
-    std::get<1>(bytecode[jumpIfFalseIndex])[0] =
-        elseBody_.empty() ? currentOffset + bytecode.size() : currentOffset + jumpIndex + 1;
-
-    if (!elseBody_.empty()) {
-      auto else_offset = currentOffset + bytecode.size();
-      for (const auto& stmt : elseBody_) {
-        auto elseBytecode = stmt->generateBytecode(else_offset);
-        else_offset += elseBytecode.size();
-        bytecode.insert(bytecode.end(), elseBytecode.begin(), elseBytecode.end());
-      }
-
-      std::get<1>(bytecode[jumpIndex])[0] = currentOffset + bytecode.size();
+    BytecodeEmitter::Label endLabel = emitter.newLabel();
+    emitter.emitJump(OpCode::JUMP, endLabel);
+    emitter.bind(elseLabel);
+    for (const auto& stmt : elseBody_) {
+      stmt->generateStatement(emitter, slots);
     }
-
-    return bytecode;
+    emitter.bind(endLabel);
   }
  private:
   ASTNode* condition_;
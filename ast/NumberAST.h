@@ -16,15 +16,10 @@ class NumberAST : public ASTNode {
 
   [[nodiscard]] int64_t getValue() const { return value_; }
 
-  std::vector<std::tuple<std::string, std::vector<int64_t>>> generateBytecode(size_t currentOffset) const override {
-    std::vector<std::tuple<std::string, std::vector<int64_t>>> bytecode;
+  [[nodiscard]] bool leavesValue() const override { return true; }
 
-    std::string operation = "LOAD_CONST";
-    std::vector<int64_t> operands = {getValue()};
-
-    bytecode.emplace_back(operation, operands);
-
-    return bytecode;
+  void generateBytecode(BytecodeEmitter& emitter, const SlotResolver& /*slots*/) const override {
+    emitter.emit(OpCode::LOAD_CONST, {getValue()});
   }
 
  private:
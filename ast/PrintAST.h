@@ -11,12 +11,12 @@ class PrintAST : public ASTNode {
       : expression(std::move(expression)) {}
 
   [[nodiscard]] const ASTNode* getExpression() const { return expression.get(); }
+  [[nodiscard]] ASTNode* getExpression() { return expression.get(); }
+  void setExpression(std::unique_ptr<ASTNode> value) { expression = std::move(value); }
 
-  std::vector<std::tuple<std::string, std::vector<int64_t>>> generateBytecode(size_t currentOffset) const override {
-    auto expressionBytecode = expression->generateBytecode(currentOffset);
-    currentOffset += expressionBytecode.size();
-    expressionBytecode.emplace_back("PRINT", std::vector<int64_t>());
-    return expressionBytecode;
+  void generateBytecode(BytecodeEmitter& emitter, const SlotResolver& slots) const override {
+    expression->generateBytecode(emitter, slots);
+    emitter.emit(OpCode::PRINT);
   }
 
 
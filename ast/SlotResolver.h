@@ -0,0 +1,89 @@
+#ifndef SLOT_RESOLVER_H
+#define SLOT_RESOLVER_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+// Maps every variable and array name of a program to a dense slot index.
+// Names are declared by a pass over the whole AST before bytecode
+// generation, so nodes only ever look their names up.
+//
+// The top-level resolver holds the globals. Each function gets a child
+// resolver holding its parameters (first, in order) and locals; names that
+// are not declared in the function resolve to the global slot instead.
+// Functions are numbered in declaration order; calls refer to that id until
+// the linker replaces it with the entry address. Calls of a memoized
+// function go through its memo table.
+class SlotResolver {
+ public:
+  struct Slot {
+    int64_t index;
+    bool global;  // addressed from the bottom of the frame stack, not from the frame pointer
+  };
+
+  struct Function {
+    int64_t id;
+    int64_t arity;
+    std::unique_ptr<SlotResolver> frame;
+    bool memoized = false;
+  };
+
+  SlotResolver() = default;
+  explicit SlotResolver(const SlotResolver* parent) : parent_(parent) {}
+
+  int64_t declare(const std::string& name) {
+    auto [it, inserted] = slots_.try_emplace(name, static_cast<int64_t>(slots_.size()));
+    return it->second;
+  }
+
+  [[nodiscard]] Slot slotOf(const std::string& name) const {
+    auto it = slots_.find(name);
+    if (it != slots_.end()) {
+      return {it->second, false};
+    }
+    if (parent_) {
+      return {parent_->slotOf(name).index, true};
+    }
+    throw std::runtime_error("Variable not found: " + name);
+  }
+
+  SlotResolver& declareFunction(const std::string& name, size_t arity) {
+    auto [it, inserted] = functions_.try_emplace(name);
+    if (inserted) {
+      it->second = {static_cast<int64_t>(functions_.size() - 1), static_cast<int64_t>(arity),
+                    std::make_unique<SlotResolver>(this)};
+    }
+    return *it->second.frame;
+  }
+
+  void memoize(const std::string& name) {
+    auto it = functions_.find(name);
+    if (it != functions_.end()) {
+      it->second.memoized = true;
+    }
+  }
+
+  [[nodiscard]] const Function& function(const std::string& name) const {
+    if (parent_) {
+      return parent_->function(name);
+    }
+    auto it = functions_.find(name);
+    if (it == functions_.end()) {
+      throw std::runtime_error("Function " + name + " not found");
+    }
+    return it->second;
+  }
+
+  [[nodiscard]] size_t slotCount() const { return slots_.size(); }
+
+ private:
+  const SlotResolver* parent_ = nullptr;
+  std::unordered_map<std::string, int64_t> slots_;
+  std::map<std::string, Function> functions_;
+};
+
+#endif // SLOT_RESOLVER_H
@@ -13,9 +13,7 @@ class VariableAST : public ASTNode {
 
   [[nodiscard]] const std::string& getName() const { return name; }
 
-  std::vector<std::tuple<std::string, std::vector<int64_t>>> generateBytecode(size_t currentOffset) const override {
-    return std::vector<std::tuple<std::string, std::vector<int64_t>>>();
-  }
+  void generateBytecode(BytecodeEmitter& /*emitter*/, const SlotResolver& /*slots*/) const override {}
 
  private:
   std::string name;
@@ -28,24 +26,12 @@ class VariableDeclAST : public VariableAST {
 
   [[nodiscard]] const std::string& getType() const { return type; }
   [[nodiscard]] const ASTNode* getValue() const { return value.get(); }
+  [[nodiscard]] ASTNode* getValue() { return value.get(); }
+  void setValue(std::unique_ptr<ASTNode> newValue) { value = std::move(newValue); }
 
-  [[nodiscard]] std::vector<std::tuple<std::string, std::vector<int64_t>>> generateBytecode(size_t currentOffset) const override {
-    std::vector<std::tuple<std::string, std::vector<int64_t>>> bytecode;
-
-    auto valueBytecode = value->generateBytecode(currentOffset);
-    currentOffset += valueBytecode.size();
-    bytecode.insert(bytecode.end(), valueBytecode.begin(), valueBytecode.end());
-
-    std::string operation = "DECLARE_VAR";
-    std::vector<int64_t> operands;
-    operands.push_back(static_cast<int64_t>(getName().size()));
-    for (char c : getName()) {
-      operands.push_back(static_cast<int64_t>(c));
-    }
-
-    bytecode.emplace_back(operation, operands);
-
-    return bytecode;
+  void generateBytecode(BytecodeEmitter& emitter, const SlotResolver& slots) const override {
+    value->generateBytecode(emitter, slots);
+    emitter.emit(OpCode::STORE_SLOT, {slots.slotOf(getName()).index});
   }
 
  private:
@@ -60,13 +46,11 @@ class VariableRefAST : public ASTNode {
 
   [[nodiscard]] const std::string& getName() const { return name; }
 
-  [[nodiscard]] std::vector<std::tuple<std::string, std::vector<int64_t>>> generateBytecode(size_t currentOffset) const override {
-    std::vector<int64_t> nameOperands;
-    nameOperands.push_back(name.size());
-    for (char c : name) {
-      nameOperands.push_back(static_cast<int64_t>(c));
-    }
-    return {{"LOAD_VAR", nameOperands}};
+  [[nodiscard]] bool leavesValue() const override { return true; }
+
+  void generateBytecode(BytecodeEmitter& emitter, const SlotResolver& slots) const override {
+    auto slot = slots.slotOf(name);
+    emitter.emit(slot.global ? OpCode::LOAD_GLOBAL : OpCode::LOAD_SLOT, {slot.index});
   }
 
  private:
@@ -0,0 +1,41 @@
+#!/usr/bin/env bash
+# Per-instruction cost of the arithmetic handlers, with unchecked and with
+# overflow-checked arithmetic, on the checked stack interpreter, the verified
+# stack interpreter and the register machine.
+# Usage: benchmarks/arithmetic.sh [runs]
+set -euo pipefail
+
+root="$(cd "$(dirname "$0")/.." && pwd)"
+runs="${1:-5}"
+script="$root/benchmarks/arithmetic.mpl"
+
+build() {
+  cmake -S "$root" -B "$root/build-bench-$1" -DCMAKE_BUILD_TYPE=Release "${@:2}" > /dev/null
+  cmake --build "$root/build-bench-$1" -j > /dev/null
+}
+
+build profile -DMATUR_PL_PROFILE_OPCODES=ON
+build unchecked -DMATUR_PL_CHECKED_ARITHMETIC=OFF
+build checked -DMATUR_PL_CHECKED_ARITHMETIC=ON
+
+for mode in unverified verified registers; do
+  flag=""
+  case "$mode" in
+    unverified) flag="--unverified" ;;
+    registers) flag="--registers" ;;
+  esac
+  executed=$("$root/build-bench-profile/matur_pl" $flag "$script" 2>&1 >/dev/null |
+      sed -n 's/^Executed \(.*\) instructions$/\1/p')
+
+  for variant in unchecked checked; do
+    best=""
+    for _ in $(seq "$runs"); do
+      t=$("$root/build-bench-$variant/matur_pl" $flag "$script" | sed -n 's/^Execution time: \(.*\) seconds$/\1/p')
+      if [ -z "$best" ] || awk "BEGIN { exit !($t < $best) }"; then
+        best="$t"
+      fi
+    done
+    printf '%-11s %-10s %ss, %s ns per instruction (best of %s)\n' "$mode" "$variant" "$best" \
+        "$(awk "BEGIN { printf \"%.2f\", $best * 1e9 / $executed }")" "$runs"
+  done
+done
@@ -0,0 +1,29 @@
+#!/usr/bin/env bash
+# Compares switch dispatch against computed-goto dispatch on the benchmark
+# scripts. Usage: benchmarks/dispatch.sh [runs]
+set -euo pipefail
+
+root="$(cd "$(dirname "$0")/.." && pwd)"
+runs="${1:-5}"
+
+build() {
+  cmake -S "$root" -B "$root/build-bench-$1" -DCMAKE_BUILD_TYPE=Release \
+      -DMATUR_PL_THREADED_DISPATCH="$2" > /dev/null
+  cmake --build "$root/build-bench-$1" -j > /dev/null
+}
+
+build switch OFF
+build threaded ON
+
+for script in "$root"/benchmarks/*.mpl; do
+  for mode in switch threaded; do
+    best=""
+    for _ in $(seq "$runs"); do
+      t=$("$root/build-bench-$mode/matur_pl" "$script" | sed -n 's/^Execution time: \(.*\) seconds$/\1/p')
+      if [ -z "$best" ] || awk "BEGIN { exit !($t < $best) }"; then
+        best="$t"
+      fi
+    done
+    printf '%-16s %-9s %ss (best of %s)\n' "$(basename "$script")" "$mode" "$best" "$runs"
+  done
+done
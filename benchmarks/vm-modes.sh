@@ -0,0 +1,27 @@
+#!/usr/bin/env bash
+# Compares the stack VM against the register VM on the benchmark scripts.
+# Usage: benchmarks/vm-modes.sh [runs]
+set -euo pipefail
+
+root="$(cd "$(dirname "$0")/.." && pwd)"
+runs="${1:-5}"
+
+cmake -S "$root" -B "$root/build-bench-modes" -DCMAKE_BUILD_TYPE=Release > /dev/null
+cmake --build "$root/build-bench-modes" -j > /dev/null
+
+for script in "$root"/benchmarks/*.mpl; do
+  for mode in stack registers; do
+    flag=""
+    if [ "$mode" = registers ]; then
+      flag="--registers"
+    fi
+    best=""
+    for _ in $(seq "$runs"); do
+      t=$("$root/build-bench-modes/matur_pl" $flag "$script" | sed -n 's/^Execution time: \(.*\) seconds$/\1/p')
+      if [ -z "$best" ] || awk "BEGIN { exit !($t < $best) }"; then
+        best="$t"
+      fi
+    done
+    printf '%-16s %-9s %ss (best of %s)\n' "$(basename "$script")" "$mode" "$best" "$runs"
+  done
+done
@@ -1,5 +1,7 @@
+#include <functional>
 #include <memory>
 #include <map>
+#include <set>
 #include <fstream>
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/LLVMContext.h"
@@ -16,6 +18,10 @@
 #include "ArithmeticOpNode.h"
 #include "AssigmentAST.h"
 #include "FunctionAST.h"
+#include "MemoRuntime.h"
+#include "../optimizer/ASTQueries.h"
+#include "../optimizer/CallEvaluator.h"
+#include <llvm/IR/Intrinsics.h>
 #include <llvm/IRReader/IRReader.h>
 #include <llvm/IR/Verifier.h>
 
@@ -26,6 +32,71 @@
 #include <llvm/Transforms/Scalar/GVN.h>
 
 std::map<std::string, llvm::AllocaInst*> globalNamedValues;
+// Accesses whose bounds a check ahead of their loop already covers.
+std::set<const ArrayAccessAST*> hoistedBoundsChecks;
+// Computes pure calls whose arguments are constants when the module is
+// optimized; null otherwise.
+std::unique_ptr<CallEvaluator> callEvaluator;
+// Pure functions whose calls go through a memo table, and its index in
+// MemoRuntime. Empty unless the module is memoized.
+std::map<std::string, int64_t> memoizedFunctions;
+
+namespace {
+
+// Continues in a new block if the condition holds and traps otherwise.
+void emitBoundsCheck(llvm::Value* inBounds, llvm::IRBuilder<>& builder, llvm::Module& module,
+                     llvm::Function* parentFunction) {
+  llvm::LLVMContext& context = builder.getContext();
+  llvm::BasicBlock* outOfBoundsBB = llvm::BasicBlock::Create(context, "out_of_bounds", parentFunction);
+  llvm::BasicBlock* inBoundsBB = llvm::BasicBlock::Create(context, "in_bounds", parentFunction);
+  builder.CreateCondBr(inBounds, inBoundsBB, outOfBoundsBB);
+
+  builder.SetInsertPoint(outOfBoundsBB);
+  builder.CreateCall(llvm::Intrinsic::getDeclaration(&module, llvm::Intrinsic::trap));
+  builder.CreateUnreachable();
+
+  builder.SetInsertPoint(inBoundsBB);
+}
+
+// Accesses `array[iterator]` that run on every iteration: those in the body
+// outside of nested `if`s and loops. Empty if the body can change the
+// iterator or return early.
+std::vector<const ArrayAccessAST*> iteratorAccesses(const ForNode* forNode) {
+  const std::string& iterator = forNode->getIteratorName();
+  std::unordered_set<std::string> written;
+  bool returns = false;
+  std::function<void(const ASTNode*)> scan = [&](const ASTNode* node) {
+    returns |= dynamic_cast<const ReturnNode*>(node) != nullptr;
+    forEachChild(node, scan);
+  };
+  for (const auto& stmt : forNode->getBody()) {
+    collectWrites(stmt.get(), written);
+    scan(stmt.get());
+  }
+  std::vector<const ArrayAccessAST*> accesses;
+  if (returns || written.contains(iterator)) {
+    return accesses;
+  }
+
+  std::function<void(const ASTNode*)> collect = [&](const ASTNode* node) {
+    if (dynamic_cast<const IfNode*>(node) || dynamic_cast<const ForNode*>(node)) {
+      return;
+    }
+    if (auto* access = dynamic_cast<const ArrayAccessAST*>(node)) {
+      auto* index = dynamic_cast<const VariableRefAST*>(access->getIndex());
+      if (index && index->getName() == iterator && !access->isInBounds()) {
+        accesses.push_back(access);
+      }
+    }
+    forEachChild(node, collect);
+  };
+  for (const auto& stmt : forNode->getBody()) {
+    collect(stmt.get());
+  }
+  return accesses;
+}
+
+} // namespace
 
 llvm::Value* generateIRForNumber(const NumberAST* node, llvm::IRBuilder<>& builder,
                                  llvm::Module& module,
@@ -121,14 +192,19 @@ llvm::Value* generateIRForIfNode(const IfNode* node,
   for (const auto& thenNode : node->getThenBody()) {
     generateIR(thenNode.get(), builder, module, parentFunction, namedValues);
   }
-  builder.CreateBr(mergeBB);
+  // A branch that ends in `return` already has its terminator.
+  if (!builder.GetInsertBlock()->getTerminator()) {
+    builder.CreateBr(mergeBB);
+  }
 
   parentFunction->getBasicBlockList().push_back(elseBB);
   builder.SetInsertPoint(elseBB);
   for (const auto& elseNode : node->getElseBody()) {
     generateIR(elseNode.get(), builder, module, parentFunction, namedValues);
   }
-  builder.CreateBr(mergeBB);
+  if (!builder.GetInsertBlock()->getTerminator()) {
+    builder.CreateBr(mergeBB);
+  }
 
   parentFunction->getBasicBlockList().push_back(mergeBB);
   builder.SetInsertPoint(mergeBB);
@@ -250,13 +326,21 @@ llvm::Value* generateIRForArrayAccess(const ArrayAccessAST* node,
 
   indexValue = builder.CreateIntCast(indexValue, llvm::Type::getInt64Ty(module.getContext()), true);
 
+  // Indices the optimizer proved, or that a check before the loop covers,
+  // are used as they are. Any other index is compared unsigned, which also
+  // rejects negative ones.
+  llvm::Type* arrayType = arrayVar->getValueType();
+  if (!node->isInBounds() && !hoistedBoundsChecks.contains(node)) {
+    llvm::Value* size = builder.getInt64(arrayType->getArrayNumElements());
+    emitBoundsCheck(builder.CreateICmpULT(indexValue, size, "inbounds"), builder, module, parentFunction);
+  }
+
   std::vector<llvm::Value*> indices = {
       llvm::ConstantInt::get(llvm::Type::getInt64Ty(module.getContext()), 0),
       indexValue
   };
 
-  llvm::Type* arrayType = arrayVar->getValueType();
-  llvm::Value* elementPtr = builder.CreateGEP(arrayType, arrayVar, indices, "arrayelem");
+  llvm::Value* elementPtr = builder.CreateInBoundsGEP(arrayType, arrayVar, indices, "arrayelem");
 
   return elementPtr;
 }
@@ -352,14 +436,46 @@ llvm::Value* generateIRForForNode(const ForNode* forNode,
 
   llvm::Value* start = generateIR(forNode->getStart(), builder, module, parentFunction, namedValues);
   llvm::Value* finish = generateIR(forNode->getFinish(), builder, module, parentFunction, namedValues);
-  llvm::Value* step = generateIR(forNode->getStep(), builder, module, parentFunction, namedValues);
-
-  llvm::BasicBlock* preheaderBB = builder.GetInsertBlock();
-  llvm::BasicBlock* loopBB = llvm::BasicBlock::Create(context, "loop", parentFunction);
-  llvm::BasicBlock* afterLoopBB = llvm::BasicBlock::Create(context, "after_loop", parentFunction);
+  // `for i in <start, finish>` steps by 1.
+  llvm::Value* step = forNode->getStep()
+                          ? generateIR(forNode->getStep(), builder, module, parentFunction, namedValues)
+                          : builder.getInt64(1);
 
   llvm::AllocaInst* alloca = builder.CreateAlloca(start->getType(), nullptr, forNode->getIteratorName());
   namedValues[forNode->getIteratorName()] = alloca;
+  builder.CreateStore(start, alloca);
+
+  // Like the VMs' loops, the body does not run at all for an empty range.
+  llvm::BasicBlock* entryBB = llvm::BasicBlock::Create(context, "loop_entry", parentFunction);
+  llvm::BasicBlock* afterLoopBB = llvm::BasicBlock::Create(context, "after_loop");
+  builder.CreateCondBr(builder.CreateICmpSLT(start, finish, "loopentered"), entryBB, afterLoopBB);
+  builder.SetInsertPoint(entryBB);
+
+  // Past the entry test the iterator goes from the start up to the finish
+  // minus one, so for a positive step one check here covers every
+  // `array[iterator]` each iteration performs. It traps before the loop
+  // instead of on the iteration that would go out of bounds.
+  auto* constStep = dynamic_cast<const NumberAST*>(forNode->getStep());
+  if (!forNode->getStep() || (constStep && constStep->getValue() > 0)) {
+    std::set<llvm::GlobalVariable*> checkedArrays;
+    for (const ArrayAccessAST* access : iteratorAccesses(forNode)) {
+      llvm::GlobalVariable* arrayVar = module.getNamedGlobal(access->getArrayName());
+      if (!arrayVar) {
+        continue;
+      }
+      if (checkedArrays.insert(arrayVar).second) {
+        llvm::Value* size = builder.getInt64(arrayVar->getValueType()->getArrayNumElements());
+        llvm::Value* last = builder.CreateSub(finish, builder.getInt64(1), "last");
+        llvm::Value* inBounds = builder.CreateAnd(builder.CreateICmpULT(start, size),
+                                                  builder.CreateICmpSLT(last, size), "loopinbounds");
+        emitBoundsCheck(inBounds, builder, module, parentFunction);
+      }
+      hoistedBoundsChecks.insert(access);
+    }
+  }
+
+  llvm::BasicBlock* preheaderBB = builder.GetInsertBlock();
+  llvm::BasicBlock* loopBB = llvm::BasicBlock::Create(context, "loop", parentFunction);
 
   builder.CreateBr(loopBB);
   builder.SetInsertPoint(loopBB);
@@ -380,6 +496,7 @@ llvm::Value* generateIRForForNode(const ForNode* forNode,
   builder.CreateCondBr(endCond, loopBB, afterLoopBB);
   phiNode->addIncoming(nextVar, builder.GetInsertBlock());
 
+  afterLoopBB->insertInto(parentFunction);
   builder.SetInsertPoint(afterLoopBB);
 
   return nullptr;
@@ -387,9 +504,26 @@ llvm::Value* generateIRForForNode(const ForNode* forNode,
 
 std::unique_ptr<llvm::Module> generateModuleIR(std::vector<std::unique_ptr<ASTNode>>& astNodes,
                                                llvm::LLVMContext& context,
-                                               bool withOpt) {
+                                               bool withOpt,
+                                               bool memoize) {
   auto module = std::make_unique<llvm::Module>("my_module", context);
   llvm::IRBuilder<> builder(context);
+  callEvaluator = withOpt ? std::make_unique<CallEvaluator>(astNodes) : nullptr;
+  // Set while generating loops; the nodes of an earlier module are gone.
+  hoistedBoundsChecks.clear();
+
+  // The same functions the VMs memoize, with a table each.
+  MemoRuntime::reset();
+  memoizedFunctions.clear();
+  if (memoize) {
+    std::unordered_set<std::string> pure = pureFunctions(astNodes);
+    for (const auto& node : astNodes) {
+      auto* funcDeclNode = dynamic_cast<const FunctionDeclNode*>(node.get());
+      if (funcDeclNode && pure.contains(funcDeclNode->getFunctionName())) {
+        memoizedFunctions.emplace(funcDeclNode->getFunctionName(), MemoRuntime::add(funcDeclNode->getFunctionName()));
+      }
+    }
+  }
 
   for (auto& node : astNodes) {
     if (auto* funcDeclNode = dynamic_cast<FunctionDeclNode*>(node.get())) {
@@ -510,5 +644,72 @@ llvm::Value* generateIRForFunctionCall(const FunctionCallNode* functionCallNode,
     args.push_back(argValue);
   }
 
-  return builder.CreateCall(calleeFunction, args);
+  // The builder folds constant operands, so arguments computed from
+  // constants arrive as constants too.
+  if (callEvaluator) {
+    std::vector<int64_t> constants;
+    for (llvm::Value* arg : args) {
+      auto* constant = llvm::dyn_cast<llvm::ConstantInt>(arg);
+      if (!constant || constant->getBitWidth() != 64) {
+        break;
+      }
+      constants.push_back(constant->getSExtValue());
+    }
+    if (constants.size() == args.size()) {
+      if (auto result = callEvaluator->evaluate(functionCallNode->getFunctionName(), constants)) {
+        return builder.getInt64(*result);
+      }
+    }
+  }
+
+  auto memo = memoizedFunctions.find(functionCallNode->getFunctionName());
+  if (memo == memoizedFunctions.end() || !parentFunction) {
+    return builder.CreateCall(calleeFunction, args);
+  }
+
+  // The arguments are stored for the runtime to look up, and the call only
+  // runs, and stores its result, when the lookup misses. Both buffers are
+  // allocated in the entry block, so a call in a loop does not grow the
+  // stack.
+  llvm::LLVMContext& context = builder.getContext();
+  llvm::Type* int64Type = builder.getInt64Ty();
+  llvm::PointerType* int64PtrType = int64Type->getPointerTo();
+  llvm::BasicBlock& entryBB = parentFunction->getEntryBlock();
+  llvm::IRBuilder<> entryBuilder(&entryBB, entryBB.begin());
+  llvm::AllocaInst* arguments =
+      entryBuilder.CreateAlloca(int64Type, builder.getInt64(std::max<size_t>(args.size(), 1)), "memo_args");
+  llvm::AllocaInst* cached = entryBuilder.CreateAlloca(int64Type, nullptr, "memo_result");
+  for (size_t i = 0; i < args.size(); ++i) {
+    builder.CreateStore(args[i], builder.CreateConstGEP1_64(int64Type, arguments, i));
+  }
+
+  llvm::FunctionCallee lookupFunc = module.getOrInsertFunction(
+      MemoRuntime::kLookup,
+      llvm::FunctionType::get(int64Type, {int64Type, int64PtrType, int64Type, int64PtrType}, false));
+  llvm::FunctionCallee storeFunc = module.getOrInsertFunction(
+      MemoRuntime::kStore,
+      llvm::FunctionType::get(builder.getVoidTy(), {int64Type, int64PtrType, int64Type, int64Type}, false));
+  llvm::Value* table = builder.getInt64(memo->second);
+  llvm::Value* count = builder.getInt64(args.size());
+  llvm::Value* found = builder.CreateCall(lookupFunc, {table, arguments, count, cached});
+
+  llvm::BasicBlock* hitBB = llvm::BasicBlock::Create(context, "memo_hit", parentFunction);
+  llvm::BasicBlock* missBB = llvm::BasicBlock::Create(context, "memo_miss", parentFunction);
+  llvm::BasicBlock* doneBB = llvm::BasicBlock::Create(context, "memo_done", parentFunction);
+  builder.CreateCondBr(builder.CreateICmpNE(found, builder.getInt64(0)), hitBB, missBB);
+
+  builder.SetInsertPoint(hitBB);
+  llvm::Value* cachedValue = builder.CreateLoad(int64Type, cached);
+  builder.CreateBr(doneBB);
+
+  builder.SetInsertPoint(missBB);
+  llvm::Value* computed = builder.CreateCall(calleeFunction, args);
+  builder.CreateCall(storeFunc, {table, arguments, count, computed});
+  builder.CreateBr(doneBB);
+
+  builder.SetInsertPoint(doneBB);
+  llvm::PHINode* result = builder.CreatePHI(int64Type, 2);
+  result->addIncoming(cachedValue, hitBB);
+  result->addIncoming(computed, missBB);
+  return result;
 }
@@ -120,8 +120,11 @@ llvm::Value* generateIRForForNode(const ForNode* forNode,
                                   llvm::Function* parentFunction,
                                   std::map<std::string, llvm::AllocaInst*>& namedValues);
 
+// With `memoize`, calls of pure functions (see pureFunctions) look their
+// result up in a MemoRuntime table before they run.
 std::unique_ptr<llvm::Module> generateModuleIR(std::vector<std::unique_ptr<ASTNode>>& astNodes,
                                                llvm::LLVMContext& context,
-                                               bool withOpt);
+                                               bool withOpt,
+                                               bool memoize);
 
 #endif // IR_GENERATOR_H
\ No newline at end of file
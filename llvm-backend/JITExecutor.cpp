@@ -1,4 +1,5 @@
 #include "JITExecutor.h"
+#include "MemoRuntime.h"
 #include <llvm/ExecutionEngine/ExecutionEngine.h>
 #include <llvm/ExecutionEngine/MCJIT.h>
 #include <llvm/IRReader/IRReader.h>
@@ -11,6 +12,7 @@ uint64_t executeIR(std::unique_ptr<llvm::Module>& module) {
   llvm::InitializeNativeTarget();
   llvm::InitializeNativeTargetAsmPrinter();
   llvm::InitializeNativeTargetDisassembler();
+  MemoRuntime::registerSymbols();
 
   std::string errStr;
   llvm::ExecutionEngine* engine = llvm::EngineBuilder(std::move(module))
@@ -40,6 +42,9 @@ uint64_t executeIR(std::unique_ptr<llvm::Module>& module) {
 
   std::vector<llvm::GenericValue> args;
   llvm::GenericValue result = engine->runFunction(mainFunc, args);
+  if (!MemoRuntime::empty()) {
+    MemoRuntime::printStats(std::cerr);
+  }
 
   delete engine;
   return result.IntVal.getSExtValue();
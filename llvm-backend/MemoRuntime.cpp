@@ -0,0 +1,57 @@
+#include "MemoRuntime.h"
+#include <utility>
+#include <vector>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/DynamicLibrary.h>
+#include "../vm/MemoTable.h"
+
+namespace {
+
+std::vector<std::pair<std::string, MemoTable>> tables;
+// The arguments of the call being looked up.
+std::vector<int64_t> key;
+
+}  // namespace
+
+void MemoRuntime::reset() {
+  tables.clear();
+}
+
+int64_t MemoRuntime::add(const std::string& function) {
+  tables.emplace_back(function, MemoTable());
+  return static_cast<int64_t>(tables.size() - 1);
+}
+
+// The JIT looks external symbols up in the process, which does not export
+// the executable's own functions.
+void MemoRuntime::registerSymbols() {
+  llvm::sys::DynamicLibrary::AddSymbol(kLookup, reinterpret_cast<void*>(&matur_memo_lookup));
+  llvm::sys::DynamicLibrary::AddSymbol(kStore, reinterpret_cast<void*>(&matur_memo_store));
+}
+
+bool MemoRuntime::empty() {
+  return tables.empty();
+}
+
+void MemoRuntime::printStats(std::ostream& out) {
+  out << "Memo statistics:\n";
+  for (const auto& [function, table] : tables) {
+    if (table.hits() + table.misses() != 0) {
+      table.print(out, function);
+    }
+  }
+}
+
+int64_t matur_memo_lookup(int64_t table, const int64_t* arguments, int64_t count, int64_t* result) {
+  key.assign(arguments, arguments + count);
+  auto cached = tables[table].second.find(key);
+  if (!cached) {
+    return 0;
+  }
+  *result = *cached;
+  return 1;
+}
+
+void matur_memo_store(int64_t table, const int64_t* arguments, int64_t count, int64_t result) {
+  tables[table].second.insert(std::vector<int64_t>(arguments, arguments + count), result);
+}
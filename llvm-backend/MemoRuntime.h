@@ -0,0 +1,33 @@
+#ifndef MEMO_RUNTIME_H
+#define MEMO_RUNTIME_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// Memo tables of the functions a module memoizes, for the code the JIT runs.
+// generateModuleIR adds a table per memoized function and the compiled calls
+// reach it through matur_memo_lookup and matur_memo_store, which executeIR
+// resolves to the functions below.
+class MemoRuntime {
+ public:
+  static constexpr const char* kLookup = "matur_memo_lookup";
+  static constexpr const char* kStore = "matur_memo_store";
+
+  // Drops the tables of the previous module.
+  static void reset();
+  // Returns the index compiled calls of the function pass to the runtime.
+  static int64_t add(const std::string& function);
+  static void registerSymbols();
+
+  [[nodiscard]] static bool empty();
+  // Hits and misses of every table a call was looked up in.
+  static void printStats(std::ostream& out);
+};
+
+// Returns 1 and stores the cached result if the table has one for the
+// arguments, and 0 otherwise.
+extern "C" int64_t matur_memo_lookup(int64_t table, const int64_t* arguments, int64_t count, int64_t* result);
+extern "C" void matur_memo_store(int64_t table, const int64_t* arguments, int64_t count, int64_t result);
+
+#endif // MEMO_RUNTIME_H
@@ -1,21 +1,80 @@
 #include <fstream>
 #include <sstream>
+#include <stdexcept>
 #include <string>
 #include "llvm-backend/JITExecutor.h"
 #include "llvm-backend/IRGeneratorV2.h"
 #include "parser/Parser.h"
+#include "optimizer/ASTOptimizer.h"
+#include "optimizer/BoundsCheckEliminator.h"
+#include "optimizer/Inliner.h"
+#include "optimizer/LoopOptimizer.h"
 #include "ASTToBytecodeConverter.h"
+#include "ASTToRegisterBytecodeConverter.h"
+#include "BytecodeCache.h"
+#include "BytecodeLinker.h"
+#include "BytecodeVerifier.h"
 #include "VirtualMachine.h"
 
+namespace {
+
+enum class GcStatsFormat { None, Text, Json };
+
+void printGcStats(const VirtualMachine& vm, GcStatsFormat format) {
+  if (format == GcStatsFormat::Text) {
+    vm.getGcStats().print(std::cerr);
+  } else if (format == GcStatsFormat::Json) {
+    vm.getGcStats().printJson(std::cerr);
+  }
+}
+
+} // namespace
+
 int main(int argc, char* argv[]) {
-  if (argc < 2) {
-    std::cerr << "Usage: " << argv[0] << " <source file>" << std::endl;
+  bool registerMode = false;
+  bool verify = true;
+  bool useCache = true;
+  bool verbose = false;
+  bool memoize = false;
+  int optimizationLevel = 1;
+  size_t gcBudget = GarbageCollector::kDefaultBudgetBytes;
+  size_t gcThreads = 0;
+  GcStatsFormat gcStats = GcStatsFormat::None;
+  int sourceIndex = 1;
+  for (; sourceIndex < argc; ++sourceIndex) {
+    std::string flag = argv[sourceIndex];
+    if (flag == "--registers") {
+      registerMode = true;
+    } else if (flag == "--unverified") {
+      verify = false;
+    } else if (flag == "--no-cache") {
+      useCache = false;
+    } else if (flag == "--verbose") {
+      verbose = true;
+    } else if (flag == "--memoize") {
+      memoize = true;
+    } else if (flag == "-O0" || flag == "-O1") {
+      optimizationLevel = flag[2] - '0';
+    } else if (flag == "--gc-budget" && sourceIndex + 1 < argc) {
+      gcBudget = std::stoull(argv[++sourceIndex]);
+    } else if (flag == "--gc-threads" && sourceIndex + 1 < argc) {
+      gcThreads = std::stoull(argv[++sourceIndex]);
+    } else if (flag == "--gc-stats") {
+      gcStats = GcStatsFormat::Text;
+    } else if (flag == "--gc-stats=json") {
+      gcStats = GcStatsFormat::Json;
+    } else {
+      break;
+    }
+  }
+  if (argc <= sourceIndex) {
+    std::cerr << "Usage: " << argv[0] << " [-O0|-O1] [--registers] [--unverified] [--no-cache] [--verbose] [--memoize] [--gc-budget <bytes>] [--gc-threads <n>] [--gc-stats[=json]] <source file>" << std::endl;
     return 1;
   }
 
-  std::ifstream file(argv[1]);
+  std::ifstream file(argv[sourceIndex]);
   if (!file) {
-    std::cerr << "Error: File " << argv[1] << " not found!" << std::endl;
+    std::cerr << "Error: File " << argv[sourceIndex] << " not found!" << std::endl;
     return 1;
   }
 
@@ -24,13 +83,93 @@ int main(int argc, char* argv[]) {
   std::string code = input_buffer.str();
   file.close();
 
-  Parser parser(code);
-  auto ast = parser.parse();
+  // A cached program was compiled from exactly this source, so a hit skips
+  // the parser and the code generators. --no-cache neither reads nor writes
+  // the cache. The optimization level and --memoize are part of the key,
+  // since they change the program compiled from the same source. Programs
+  // using random(n) are never stored: the elements are drawn by the parser,
+  // and a cached copy would replay the same ones.
+  const std::string sourcePath = argv[sourceIndex];
+  const uint64_t sourceKey = BytecodeCache::hashSource(code, optimizationLevel, memoize);
+  const BytecodeCache::Kind kind = registerMode ? BytecodeCache::Kind::Register : BytecodeCache::Kind::Stack;
+  const std::string cachePath = BytecodeCache::pathFor(sourcePath, kind);
+  std::optional<BytecodeCache::Mapping> cached =
+      useCache ? BytecodeCache::load(cachePath, kind, sourceKey) : std::nullopt;
 
-  auto bytecode = ASTToBytecodeConverter::generateBytecode(ast, argv[1]);
+  // Programs the verifier cannot prove safe still run, with every check on.
+  // --unverified skips the verifier and always runs the checked interpreter.
+  Bytecode bytecode;
+  BytecodeView program;
+  BytecodeVerifier::Result verification;
+  if (cached) {
+    program = cached->code();
+    // The file is not trusted to hold what this build wrote: only verified
+    // stack programs are stored, so one the verifier rejects now was damaged
+    // on disk and is compiled again.
+    if (!registerMode && verify) {
+      verification = BytecodeVerifier::verify(program);
+      if (!verification.verified) {
+        cached.reset();
+      }
+    }
+  }
+  if (!cached) {
+    // The parser and the code generators report malformed programs, such as
+    // a name used outside the scope that declares it, by throwing.
+    try {
+      Parser parser(code);
+      auto ast = parser.parse();
+      if (optimizationLevel > 0) {
+        ASTOptimizer::optimize(ast);
+        BoundsCheckEliminator::optimize(ast);
+        LoopOptimizer::optimize(ast);
+        Inliner::optimize(ast, verbose);
+      }
+      if (registerMode) {
+        bytecode = ASTToRegisterBytecodeConverter::generateBytecode(ast, argv[sourceIndex], memoize);
+      } else {
+        bytecode = ASTToBytecodeConverter::generateBytecode(ast, argv[sourceIndex], optimizationLevel > 0, memoize);
+        if (!BytecodeLinker::link(bytecode)) {
+          return 1;
+        }
+      }
+      program = bytecode;
+      if (!registerMode && verify) {
+        verification = BytecodeVerifier::verify(program);
+      }
+      if (useCache && !parser.usesRandom() && (registerMode || verification.verified)) {
+        BytecodeCache::store(cachePath, kind, sourceKey, program);
+      }
+    } catch (const std::exception& error) {
+      std::cerr << "Error: " << error.what() << std::endl;
+      return 1;
+    }
+  }
 
   VirtualMachine vm;
-  vm.execute(bytecode);
+  vm.setGcBudget(gcBudget);
+  vm.setGcThreads(gcThreads);
+  if (gcStats != GcStatsFormat::None) {
+    vm.enableGcStats();
+  }
+  if (registerMode) {
+    vm.executeRegisters(program);
+    printGcStats(vm, gcStats);
+    if (memoize) {
+      vm.printMemoStats(std::cerr);
+    }
+    return 0;
+  }
+
+  if (verification.verified) {
+    vm.executeVerified(program, verification);
+  } else {
+    vm.execute(program);
+  }
+  printGcStats(vm, gcStats);
+  if (memoize) {
+    vm.printMemoStats(std::cerr);
+  }
 
   return 0;
 }
\ No newline at end of file
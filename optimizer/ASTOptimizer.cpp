@@ -0,0 +1,339 @@
+#include "ASTOptimizer.h"
+#include <algorithm>
+#include <optional>
+#include <unordered_set>
+#include "ASTQueries.h"
+#include "CallEvaluator.h"
+#include "ArithmeticOpNode.h"
+#include "ArrayAST.h"
+#include "AssigmentAST.h"
+#include "BooleanAST.h"
+#include "CompareOpNode.h"
+#include "ForNode.h"
+#include "FunctionAST.h"
+#include "IfNode.h"
+#include "NumberAST.h"
+#include "PrintAST.h"
+#include "VariableAST.h"
+
+void ASTOptimizer::optimize(std::vector<std::unique_ptr<ASTNode>>& ast) {
+  ASTOptimizer optimizer;
+  CallEvaluator evaluator(ast);
+  optimizer.evaluator_ = &evaluator;
+  optimizer.analyze(ast);
+
+  Constants constants;
+  optimizer.foldBody(ast, optimizer.globals_, constants, true);
+  for (FunctionDeclNode* function : optimizer.pendingFunctions_) {
+    Scope& scope = optimizer.functions_.at(function->getFunctionName());
+    Constants visible;
+    for (const auto& [name, value] : optimizer.functionConstants_) {
+      if (!scope.locals.contains(name)) {
+        visible.emplace(name, value);
+      }
+    }
+    optimizer.foldBody(function->getBody(), scope, visible, true);
+  }
+
+  optimizer.removeUnusedFunctions(ast);
+
+  // Removing a declaration can leave the variables its value read unused.
+  bool changed = true;
+  while (changed) {
+    optimizer.analyze(ast);
+    changed = optimizer.removeUnusedDeclarations(ast, optimizer.globals_);
+    for (const auto& node : ast) {
+      if (auto* function = dynamic_cast<FunctionDeclNode*>(node.get())) {
+        Scope& scope = optimizer.functions_.at(function->getFunctionName());
+        changed |= optimizer.removeUnusedDeclarations(function->getBody(), scope);
+      }
+    }
+  }
+}
+
+ASTOptimizer::Usage& ASTOptimizer::Scope::resolve(const std::string& name) {
+  auto it = locals.find(name);
+  if (it != locals.end() || !globals) {
+    return locals[name];
+  }
+  return globals->resolve(name);
+}
+
+void ASTOptimizer::analyze(const Body& ast) {
+  globals_ = Scope();
+  functions_.clear();
+
+  for (const auto& node : ast) {
+    if (auto* function = dynamic_cast<const FunctionDeclNode*>(node.get())) {
+      Scope& scope = functions_[function->getFunctionName()];
+      scope.globals = &globals_;
+      // Every call assigns the parameters.
+      for (const auto& parameter : function->getParameters()) {
+        ++scope.locals[parameter].assignments;
+      }
+      for (const auto& stmt : function->getBody()) {
+        declareNames(stmt.get(), scope);
+      }
+    } else {
+      declareNames(node.get(), globals_);
+    }
+  }
+
+  for (const auto& node : ast) {
+    if (auto* function = dynamic_cast<const FunctionDeclNode*>(node.get())) {
+      Scope& scope = functions_[function->getFunctionName()];
+      for (const auto& stmt : function->getBody()) {
+        countUsage(stmt.get(), scope);
+      }
+    } else {
+      countUsage(node.get(), globals_);
+    }
+  }
+}
+
+// Mirrors ASTToBytecodeConverter::declareSlots.
+void ASTOptimizer::declareNames(const ASTNode* node, Scope& scope) {
+  if (auto* varDecl = dynamic_cast<const VariableDeclAST*>(node)) {
+    scope.locals[varDecl->getName()];
+  } else if (auto* arrayDecl = dynamic_cast<const ArrayDeclAST*>(node)) {
+    scope.locals[arrayDecl->getName()];
+  } else if (auto* forNode = dynamic_cast<const ForNode*>(node)) {
+    scope.locals[forNode->getIteratorName()];
+    for (const auto& stmt : forNode->getBody()) {
+      declareNames(stmt.get(), scope);
+    }
+  } else if (auto* ifNode = dynamic_cast<const IfNode*>(node)) {
+    for (const auto& stmt : ifNode->getThenBody()) {
+      declareNames(stmt.get(), scope);
+    }
+    for (const auto& stmt : ifNode->getElseBody()) {
+      declareNames(stmt.get(), scope);
+    }
+  }
+}
+
+void ASTOptimizer::countUsage(const ASTNode* node, Scope& scope) {
+  if (auto* variable = dynamic_cast<const VariableRefAST*>(node)) {
+    ++scope.resolve(variable->getName()).reads;
+    return;
+  }
+  if (auto* assignment = dynamic_cast<const AssignmentAST*>(node)) {
+    if (auto* variable = dynamic_cast<const VariableRefAST*>(assignment->getLHS())) {
+      ++scope.resolve(variable->getName()).assignments;
+      countUsage(assignment->getRHS(), scope);
+      return;
+    }
+  } else if (auto* varDecl = dynamic_cast<const VariableDeclAST*>(node)) {
+    ++scope.resolve(varDecl->getName()).declarations;
+  } else if (auto* arrayDecl = dynamic_cast<const ArrayDeclAST*>(node)) {
+    ++scope.resolve(arrayDecl->getName()).declarations;
+  } else if (auto* arrayAccess = dynamic_cast<const ArrayAccessAST*>(node)) {
+    ++scope.resolve(arrayAccess->getArrayName()).reads;
+  } else if (auto* forNode = dynamic_cast<const ForNode*>(node)) {
+    ++scope.resolve(forNode->getIteratorName()).assignments;
+  }
+  forEachChild(node, [&](const ASTNode* child) { countUsage(child, scope); });
+}
+
+void ASTOptimizer::foldBody(Body& body, Scope& scope, Constants& constants, bool direct) {
+  Body folded;
+  foldStatements(body, folded, scope, constants, direct);
+  body = std::move(folded);
+}
+
+void ASTOptimizer::foldStatements(Body& body, Body& out, Scope& scope, Constants& constants, bool direct) {
+  for (auto& stmt : body) {
+    if (auto* function = dynamic_cast<FunctionDeclNode*>(stmt.get())) {
+      // Folded once the top level is done, when the global constants that
+      // are set before any call are known.
+      pendingFunctions_.push_back(function);
+      out.push_back(std::move(stmt));
+      continue;
+    }
+
+    if (auto* ifNode = dynamic_cast<IfNode*>(stmt.get())) {
+      if (auto condition = fold(ifNode->getCondition(), scope, constants)) {
+        ifNode->setCondition(condition.release());
+      }
+      // The taken branch runs exactly when the `if` would have. The other one
+      // can only go if it declares nothing: its names keep their slots even
+      // though it never runs, and later statements may still refer to them.
+      auto value = constantValue(ifNode->getCondition());
+      if (value && !declaresAny(*value ? ifNode->getElseBody() : ifNode->getThenBody())) {
+        foldStatements(*value ? ifNode->getThenBody() : ifNode->getElseBody(), out, scope, constants, direct);
+        continue;
+      }
+      foldBody(ifNode->getThenBody(), scope, constants, false);
+      foldBody(ifNode->getElseBody(), scope, constants, false);
+    } else if (auto replacement = fold(stmt.get(), scope, constants)) {
+      // A pure call evaluated for nothing but its value leaves nothing to
+      // run.
+      if (dynamic_cast<const FunctionCallNode*>(stmt.get())) {
+        continue;
+      }
+      stmt = std::move(replacement);
+    }
+
+    auto* varDecl = dynamic_cast<const VariableDeclAST*>(stmt.get());
+    if (direct && varDecl) {
+      const Usage& usage = scope.resolve(varDecl->getName());
+      auto value = constantValue(varDecl->getValue());
+      if (value && usage.declarations == 1 && usage.assignments == 0) {
+        constants[varDecl->getName()] = *value;
+        if (&scope == &globals_ && !callSeen_) {
+          functionConstants_[varDecl->getName()] = *value;
+        }
+      }
+    }
+    if (&scope == &globals_ && direct && !callSeen_) {
+      callSeen_ = containsCall(stmt.get());
+    }
+
+    out.push_back(std::move(stmt));
+  }
+}
+
+std::unique_ptr<ASTNode> ASTOptimizer::fold(ASTNode* node, Scope& scope, Constants& constants) {
+  if (auto* variable = dynamic_cast<VariableRefAST*>(node)) {
+    auto it = constants.find(variable->getName());
+    if (it != constants.end()) {
+      return std::make_unique<NumberAST>(it->second);
+    }
+  } else if (auto* arithmetic = dynamic_cast<ArithmeticOpNode*>(node)) {
+    if (auto left = fold(arithmetic->getLeft(), scope, constants)) {
+      arithmetic->setLeft(left.release());
+    }
+    if (auto right = fold(arithmetic->getRight(), scope, constants)) {
+      arithmetic->setRight(right.release());
+    }
+    auto a = constantValue(arithmetic->getLeft());
+    auto b = constantValue(arithmetic->getRight());
+    if (a && b) {
+      if (auto result = evaluateArithmetic(arithmetic->getOperator(), *a, *b)) {
+        return std::make_unique<NumberAST>(*result);
+      }
+    }
+  } else if (auto* compare = dynamic_cast<CompareOpNode*>(node)) {
+    if (auto left = fold(compare->getLeft(), scope, constants)) {
+      compare->setLeft(left.release());
+    }
+    if (auto right = fold(compare->getRight(), scope, constants)) {
+      compare->setRight(right.release());
+    }
+    auto a = constantValue(compare->getLeft());
+    auto b = constantValue(compare->getRight());
+    if (a && b) {
+      return std::make_unique<NumberAST>(evaluateCompare(compare->getOperator(), *a, *b));
+    }
+  } else if (auto* arrayAccess = dynamic_cast<ArrayAccessAST*>(node)) {
+    if (auto index = fold(arrayAccess->getIndex(), scope, constants)) {
+      arrayAccess->setIndex(index.release());
+    }
+  } else if (auto* varDecl = dynamic_cast<VariableDeclAST*>(node)) {
+    if (auto value = fold(varDecl->getValue(), scope, constants)) {
+      varDecl->setValue(std::move(value));
+    }
+  } else if (auto* assignment = dynamic_cast<AssignmentAST*>(node)) {
+    // The target of a plain assignment is not a read, so only an element
+    // index is folded on the left.
+    if (auto* target = dynamic_cast<ArrayAccessAST*>(assignment->getLHS())) {
+      fold(target, scope, constants);
+    }
+    if (auto value = fold(assignment->getRHS(), scope, constants)) {
+      assignment->setRHS(std::move(value));
+    }
+  } else if (auto* print = dynamic_cast<PrintAST*>(node)) {
+    if (auto expression = fold(print->getExpression(), scope, constants)) {
+      print->setExpression(std::move(expression));
+    }
+  } else if (auto* returnNode = dynamic_cast<ReturnNode*>(node)) {
+    if (auto expression = fold(returnNode->getExpression(), scope, constants)) {
+      returnNode->setExpression(expression.release());
+    }
+  } else if (auto* call = dynamic_cast<FunctionCallNode*>(node)) {
+    for (auto& argument : call->getArguments()) {
+      if (auto folded = fold(argument.get(), scope, constants)) {
+        argument = std::move(folded);
+      }
+    }
+    if (auto result = evaluator_->evaluate(call)) {
+      return std::make_unique<NumberAST>(*result);
+    }
+  } else if (auto* forNode = dynamic_cast<ForNode*>(node)) {
+    if (auto start = fold(forNode->getStart(), scope, constants)) {
+      forNode->setStart(start.release());
+    }
+    if (auto finish = fold(forNode->getFinish(), scope, constants)) {
+      forNode->setFinish(finish.release());
+    }
+    if (forNode->getStep()) {
+      if (auto step = fold(forNode->getStep(), scope, constants)) {
+        forNode->setStep(step.release());
+      }
+    }
+    foldBody(forNode->getBody(), scope, constants, false);
+  }
+  return nullptr;
+}
+
+void ASTOptimizer::removeUnusedFunctions(Body& ast) {
+  std::unordered_map<std::string, std::vector<const FunctionDeclNode*>> declarations;
+  for (const auto& node : ast) {
+    if (auto* function = dynamic_cast<const FunctionDeclNode*>(node.get())) {
+      declarations[function->getFunctionName()].push_back(function);
+    }
+  }
+
+  std::unordered_set<std::string> reachable;
+  std::vector<std::string> worklist;
+  auto reach = [&](const std::string& name) {
+    if (reachable.insert(name).second) {
+      worklist.push_back(name);
+    }
+  };
+  for (const auto& node : ast) {
+    if (!dynamic_cast<const FunctionDeclNode*>(node.get())) {
+      forEachCall(node.get(), reach);
+    }
+  }
+  while (!worklist.empty()) {
+    std::string name = std::move(worklist.back());
+    worklist.pop_back();
+    for (const FunctionDeclNode* function : declarations[name]) {
+      for (const auto& stmt : function->getBody()) {
+        forEachCall(stmt.get(), reach);
+      }
+    }
+  }
+
+  std::erase_if(ast, [&](const std::unique_ptr<ASTNode>& node) {
+    auto* function = dynamic_cast<const FunctionDeclNode*>(node.get());
+    return function && !reachable.contains(function->getFunctionName());
+  });
+}
+
+bool ASTOptimizer::removeUnusedDeclarations(Body& body, Scope& scope) {
+  bool removed = false;
+  std::erase_if(body, [&](const std::unique_ptr<ASTNode>& node) {
+    auto* varDecl = dynamic_cast<const VariableDeclAST*>(node.get());
+    if (!varDecl) {
+      return false;
+    }
+    const Usage& usage = scope.resolve(varDecl->getName());
+    if (usage.reads != 0 || usage.assignments != 0 || !isPure(varDecl->getValue())) {
+      return false;
+    }
+    removed = true;
+    return true;
+  });
+
+  for (const auto& node : body) {
+    if (auto* ifNode = dynamic_cast<IfNode*>(node.get())) {
+      removed |= removeUnusedDeclarations(ifNode->getThenBody(), scope);
+      removed |= removeUnusedDeclarations(ifNode->getElseBody(), scope);
+    } else if (auto* forNode = dynamic_cast<ForNode*>(node.get())) {
+      removed |= removeUnusedDeclarations(forNode->getBody(), scope);
+    }
+  }
+  return removed;
+}
@@ -0,0 +1,77 @@
+#ifndef AST_OPTIMIZER_H
+#define AST_OPTIMIZER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ASTNode.h"
+
+class CallEvaluator;
+class FunctionDeclNode;
+
+// Simplifies the parsed program before either bytecode generator sees it:
+//  - folds arithmetic and comparisons whose operands are constants,
+//  - replaces reads of variables that are declared once with a constant and
+//    never assigned by that constant,
+//  - replaces calls of pure functions whose arguments are constants by
+//    their result, computed by CallEvaluator,
+//  - keeps only the taken branch of an `if` with a constant condition,
+//  - drops declarations whose variable is never used and whose value has no
+//    effect and cannot fail, and functions that no reachable code calls.
+// Folding gives up on results the VM would report as overflowing or
+// undefined, and with checked arithmetic a declaration whose value may
+// overflow is kept, so an optimized program fails exactly where the original
+// does.
+class ASTOptimizer {
+ public:
+  static void optimize(std::vector<std::unique_ptr<ASTNode>>& ast);
+
+ private:
+  using Body = std::vector<std::unique_ptr<ASTNode>>;
+  using Constants = std::unordered_map<std::string, int64_t>;
+
+  struct Usage {
+    size_t declarations = 0;
+    size_t assignments = 0;
+    size_t reads = 0;
+  };
+
+  // The variables of the top level or of one function, resolved like
+  // SlotResolver does: a function's parameters and everything it declares
+  // are its own, every other name is a global.
+  struct Scope {
+    std::unordered_map<std::string, Usage> locals;
+    Scope* globals = nullptr;
+
+    Usage& resolve(const std::string& name);
+  };
+
+  void analyze(const Body& ast);
+  static void declareNames(const ASTNode* node, Scope& scope);
+  static void countUsage(const ASTNode* node, Scope& scope);
+
+  // Folds every statement of the body. In a direct body, which runs each of
+  // its statements exactly once and in order, a declaration that folds to a
+  // constant is propagated into the statements after it.
+  void foldBody(Body& body, Scope& scope, Constants& constants, bool direct);
+  void foldStatements(Body& body, Body& out, Scope& scope, Constants& constants, bool direct);
+  // Folds the node in place and returns its replacement, if it has one.
+  std::unique_ptr<ASTNode> fold(ASTNode* node, Scope& scope, Constants& constants);
+
+  void removeUnusedFunctions(Body& ast);
+  bool removeUnusedDeclarations(Body& body, Scope& scope);
+
+  CallEvaluator* evaluator_ = nullptr;
+  Scope globals_;
+  std::unordered_map<std::string, Scope> functions_;
+  // Global constants declared before the top level first calls a function,
+  // and so set whenever a function body runs.
+  Constants functionConstants_;
+  bool callSeen_ = false;
+  std::vector<FunctionDeclNode*> pendingFunctions_;
+};
+
+#endif // AST_OPTIMIZER_H
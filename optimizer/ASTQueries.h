@@ -0,0 +1,296 @@
+#ifndef AST_QUERIES_H
+#define AST_QUERIES_H
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "ArithmeticOpNode.h"
+#include "ArrayAST.h"
+#include "AssigmentAST.h"
+#include "BooleanAST.h"
+#include "CompareOpNode.h"
+#include "ForNode.h"
+#include "FunctionAST.h"
+#include "IfNode.h"
+#include "NumberAST.h"
+#include "PrintAST.h"
+#include "VariableAST.h"
+
+// Read-only questions about the AST shared by the optimizer passes.
+
+// Whether the VM stops on integer overflow. Then `+`, `-` and `*` can fail
+// like a division can, and the passes must not drop or move them.
+#ifdef MATUR_PL_CHECKED_ARITHMETIC
+inline constexpr bool kCheckedArithmetic = true;
+#else
+inline constexpr bool kCheckedArithmetic = false;
+#endif
+
+inline std::optional<int64_t> constantValue(const ASTNode* node) {
+  if (auto* number = dynamic_cast<const NumberAST*>(node)) {
+    return number->getValue();
+  }
+  if (auto* boolean = dynamic_cast<const BooleanAST*>(node)) {
+    return boolean->getValue();
+  }
+  return std::nullopt;
+}
+
+// Only results every build of the VM agrees on: no overflow and no division
+// by zero.
+inline std::optional<int64_t> evaluateArithmetic(ArithmeticOpNode::Operator op, int64_t a, int64_t b) {
+  int64_t result = 0;
+  switch (op) {
+    case ArithmeticOpNode::Operator::ADD:
+      if (__builtin_add_overflow(a, b, &result)) {
+        return std::nullopt;
+      }
+      break;
+    case ArithmeticOpNode::Operator::SUBTRACT:
+      if (__builtin_sub_overflow(a, b, &result)) {
+        return std::nullopt;
+      }
+      break;
+    case ArithmeticOpNode::Operator::MULTIPLY:
+      if (__builtin_mul_overflow(a, b, &result)) {
+        return std::nullopt;
+      }
+      break;
+    case ArithmeticOpNode::Operator::DIVIDE:
+    case ArithmeticOpNode::Operator::MODULO:
+      if (b == 0 || (a == INT64_MIN && b == -1)) {
+        return std::nullopt;
+      }
+      result = op == ArithmeticOpNode::Operator::DIVIDE ? a / b : a % b;
+      break;
+  }
+  return result;
+}
+
+inline int64_t evaluateCompare(CompareOpNode::Operator op, int64_t a, int64_t b) {
+  switch (op) {
+    case CompareOpNode::Operator::LESS_THAN: return a < b;
+    case CompareOpNode::Operator::GREATER_THAN: return a > b;
+    case CompareOpNode::Operator::LESS_THAN_OR_EQUAL: return a <= b;
+    case CompareOpNode::Operator::GREATER_THAN_OR_EQUAL: return a >= b;
+    case CompareOpNode::Operator::EQUALS: return a == b;
+  }
+  return 0;
+}
+
+// Calls `visit` with every expression and statement directly inside the
+// node. Function declarations are walked by their callers, with the
+// function's own scope.
+template <typename Visit>
+void forEachChild(const ASTNode* node, Visit&& visit) {
+  if (auto* arithmetic = dynamic_cast<const ArithmeticOpNode*>(node)) {
+    visit(arithmetic->getLeft());
+    visit(arithmetic->getRight());
+  } else if (auto* compare = dynamic_cast<const CompareOpNode*>(node)) {
+    visit(compare->getLeft());
+    visit(compare->getRight());
+  } else if (auto* arrayAccess = dynamic_cast<const ArrayAccessAST*>(node)) {
+    visit(arrayAccess->getIndex());
+  } else if (auto* varDecl = dynamic_cast<const VariableDeclAST*>(node)) {
+    visit(varDecl->getValue());
+  } else if (auto* assignment = dynamic_cast<const AssignmentAST*>(node)) {
+    visit(assignment->getLHS());
+    visit(assignment->getRHS());
+  } else if (auto* print = dynamic_cast<const PrintAST*>(node)) {
+    visit(print->getExpression());
+  } else if (auto* returnNode = dynamic_cast<const ReturnNode*>(node)) {
+    visit(returnNode->getExpression());
+  } else if (auto* call = dynamic_cast<const FunctionCallNode*>(node)) {
+    for (const auto& argument : call->getArguments()) {
+      visit(argument.get());
+    }
+  } else if (auto* inlined = dynamic_cast<const InlinedCallNode*>(node)) {
+    for (const auto& argument : inlined->getArguments()) {
+      visit(argument.get());
+    }
+    for (const auto& stmt : inlined->getBody()) {
+      visit(stmt.get());
+    }
+  } else if (auto* ifNode = dynamic_cast<const IfNode*>(node)) {
+    visit(ifNode->getCondition());
+    for (const auto& stmt : ifNode->getThenBody()) {
+      visit(stmt.get());
+    }
+    for (const auto& stmt : ifNode->getElseBody()) {
+      visit(stmt.get());
+    }
+  } else if (auto* forNode = dynamic_cast<const ForNode*>(node)) {
+    visit(forNode->getStart());
+    visit(forNode->getFinish());
+    if (forNode->getStep()) {
+      visit(forNode->getStep());
+    }
+    for (const auto& stmt : forNode->getBody()) {
+      visit(stmt.get());
+    }
+  }
+}
+
+template <typename Visit>
+void forEachCall(const ASTNode* node, Visit&& visit) {
+  if (auto* call = dynamic_cast<const FunctionCallNode*>(node)) {
+    visit(call->getFunctionName());
+  }
+  forEachChild(node, [&](const ASTNode* child) { forEachCall(child, visit); });
+}
+
+inline bool containsCall(const ASTNode* node) {
+  bool found = false;
+  forEachCall(node, [&](const std::string&) { found = true; });
+  return found;
+}
+
+// Variables and arrays the node assigns, declares or iterates over.
+inline void collectWrites(const ASTNode* node, std::unordered_set<std::string>& written) {
+  if (auto* assignment = dynamic_cast<const AssignmentAST*>(node)) {
+    if (auto* variable = dynamic_cast<const VariableRefAST*>(assignment->getLHS())) {
+      written.insert(variable->getName());
+    } else if (auto* target = dynamic_cast<const ArrayAccessAST*>(assignment->getLHS())) {
+      written.insert(target->getArrayName());
+    }
+  } else if (auto* varDecl = dynamic_cast<const VariableDeclAST*>(node)) {
+    written.insert(varDecl->getName());
+  } else if (auto* arrayDecl = dynamic_cast<const ArrayDeclAST*>(node)) {
+    written.insert(arrayDecl->getName());
+  } else if (auto* forNode = dynamic_cast<const ForNode*>(node)) {
+    written.insert(forNode->getIteratorName());
+  }
+  forEachChild(node, [&](const ASTNode* child) { collectWrites(child, written); });
+}
+
+// The names a function declares for itself. Mirrors
+// ASTToBytecodeConverter::declareSlots.
+inline void collectDeclarations(const ASTNode* node, std::unordered_set<std::string>& names) {
+  if (auto* varDecl = dynamic_cast<const VariableDeclAST*>(node)) {
+    names.insert(varDecl->getName());
+  } else if (auto* arrayDecl = dynamic_cast<const ArrayDeclAST*>(node)) {
+    names.insert(arrayDecl->getName());
+  } else if (auto* forNode = dynamic_cast<const ForNode*>(node)) {
+    names.insert(forNode->getIteratorName());
+  } else if (auto* inlined = dynamic_cast<const InlinedCallNode*>(node)) {
+    names.insert(inlined->getParameters().begin(), inlined->getParameters().end());
+  }
+  forEachChild(node, [&](const ASTNode* child) { collectDeclarations(child, names); });
+}
+
+inline bool declaresAny(const std::vector<std::unique_ptr<ASTNode>>& body) {
+  std::unordered_set<std::string> names;
+  for (const auto& stmt : body) {
+    collectDeclarations(stmt.get(), names);
+  }
+  return !names.empty();
+}
+
+inline std::unordered_set<std::string> localsOf(const FunctionDeclNode* function) {
+  std::unordered_set<std::string> locals(function->getParameters().begin(), function->getParameters().end());
+  for (const auto& stmt : function->getBody()) {
+    collectDeclarations(stmt.get(), locals);
+  }
+  return locals;
+}
+
+// True when the node neither prints nor touches an array or a variable
+// outside `locals`.
+inline bool usesOnly(const ASTNode* node, const std::unordered_set<std::string>& locals) {
+  if (dynamic_cast<const PrintAST*>(node) || dynamic_cast<const ArrayDeclAST*>(node) ||
+      dynamic_cast<const ArrayAccessAST*>(node)) {
+    return false;
+  }
+  if (auto* variable = dynamic_cast<const VariableRefAST*>(node)) {
+    return locals.contains(variable->getName());
+  }
+  bool only = true;
+  forEachChild(node, [&](const ASTNode* child) { only = only && usesOnly(child, locals); });
+  return only;
+}
+
+// Functions whose result depends on nothing but their arguments and that
+// have no effect: they print nothing, use no arrays, read and write only
+// their own parameters and locals, and call only pure functions. A call of
+// one can run any number of times, or not at all, as long as it returns.
+inline std::unordered_set<std::string> pureFunctions(const std::vector<std::unique_ptr<ASTNode>>& ast) {
+  std::unordered_map<std::string, const FunctionDeclNode*> functions;
+  std::unordered_set<std::string> redeclared;
+  for (const auto& node : ast) {
+    if (auto* function = dynamic_cast<const FunctionDeclNode*>(node.get())) {
+      if (!functions.emplace(function->getFunctionName(), function).second) {
+        redeclared.insert(function->getFunctionName());
+      }
+    }
+  }
+
+  std::unordered_set<std::string> pure;
+  for (const auto& [name, function] : functions) {
+    std::unordered_set<std::string> locals = localsOf(function);
+    if (!redeclared.contains(name) &&
+        std::all_of(function->getBody().begin(), function->getBody().end(),
+                    [&](const auto& stmt) { return usesOnly(stmt.get(), locals); })) {
+      pure.insert(name);
+    }
+  }
+  // A call of a function that is not pure makes the caller impure too.
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    std::erase_if(pure, [&](const std::string& name) {
+      bool callsImpure = false;
+      for (const auto& stmt : functions.at(name)->getBody()) {
+        forEachCall(stmt.get(), [&](const std::string& callee) { callsImpure |= !pure.contains(callee); });
+      }
+      changed |= callsImpure;
+      return callsImpure;
+    });
+  }
+  return pure;
+}
+
+// True for expressions that can be dropped when their value is unused, or
+// for those `allowed` accepts. Calls and array reads can fail or have
+// effects, and so can a division unless its divisor is a constant other
+// than 0 and -1. With checked arithmetic, so can `+`, `-` and `*` unless
+// both operands are constants whose result fits.
+template <typename Allowed>
+bool isPureExcept(const ASTNode* node, Allowed&& allowed) {
+  if (allowed(node)) {
+    return true;
+  }
+  if (constantValue(node) || dynamic_cast<const VariableRefAST*>(node)) {
+    return true;
+  }
+  if (auto* arithmetic = dynamic_cast<const ArithmeticOpNode*>(node)) {
+    if (arithmetic->getOperator() == ArithmeticOpNode::Operator::DIVIDE ||
+        arithmetic->getOperator() == ArithmeticOpNode::Operator::MODULO) {
+      auto divisor = constantValue(arithmetic->getRight());
+      if (!divisor || *divisor == 0 || *divisor == -1) {
+        return false;
+      }
+    } else if (kCheckedArithmetic) {
+      auto left = constantValue(arithmetic->getLeft());
+      auto right = constantValue(arithmetic->getRight());
+      if (!left || !right || !evaluateArithmetic(arithmetic->getOperator(), *left, *right)) {
+        return false;
+      }
+    }
+    return isPureExcept(arithmetic->getLeft(), allowed) && isPureExcept(arithmetic->getRight(), allowed);
+  }
+  if (auto* compare = dynamic_cast<const CompareOpNode*>(node)) {
+    return isPureExcept(compare->getLeft(), allowed) && isPureExcept(compare->getRight(), allowed);
+  }
+  return false;
+}
+
+inline bool isPure(const ASTNode* node) {
+  return isPureExcept(node, [](const ASTNode*) { return false; });
+}
+
+#endif // AST_QUERIES_H
@@ -0,0 +1,202 @@
+#ifndef AST_REWRITES_H
+#define AST_REWRITES_H
+
+#include <cassert>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ArithmeticOpNode.h"
+#include "ArrayAST.h"
+#include "AssigmentAST.h"
+#include "BooleanAST.h"
+#include "CompareOpNode.h"
+#include "ForNode.h"
+#include "FunctionAST.h"
+#include "IfNode.h"
+#include "NumberAST.h"
+#include "PrintAST.h"
+#include "VariableAST.h"
+
+// Changes to the AST shared by the optimizer passes.
+
+using Renames = std::unordered_map<std::string, std::string>;
+
+inline const std::string& renamed(const std::string& name, const Renames& renames) {
+  auto it = renames.find(name);
+  return it != renames.end() ? it->second : name;
+}
+
+std::unique_ptr<ASTNode> clone(const ASTNode* node, const Renames& renames);
+
+inline std::vector<std::unique_ptr<ASTNode>> clone(const std::vector<std::unique_ptr<ASTNode>>& body,
+                                                   const Renames& renames) {
+  std::vector<std::unique_ptr<ASTNode>> copy;
+  for (const auto& node : body) {
+    copy.push_back(clone(node.get(), renames));
+  }
+  return copy;
+}
+
+// Deep copy of a statement or expression, with every variable and array
+// named in `renames` renamed. Function declarations are not copied.
+inline std::unique_ptr<ASTNode> clone(const ASTNode* node, const Renames& renames) {
+  auto expression = [&](const ASTNode* child) { return clone(child, renames).release(); };
+  if (auto* number = dynamic_cast<const NumberAST*>(node)) {
+    return std::make_unique<NumberAST>(number->getValue());
+  }
+  if (auto* boolean = dynamic_cast<const BooleanAST*>(node)) {
+    return std::make_unique<BooleanAST>(boolean->getValue());
+  }
+  if (auto* variable = dynamic_cast<const VariableRefAST*>(node)) {
+    return std::make_unique<VariableRefAST>(renamed(variable->getName(), renames));
+  }
+  if (auto* arithmetic = dynamic_cast<const ArithmeticOpNode*>(node)) {
+    return std::make_unique<ArithmeticOpNode>(expression(arithmetic->getLeft()), arithmetic->getOperator(),
+                                              expression(arithmetic->getRight()));
+  }
+  if (auto* compare = dynamic_cast<const CompareOpNode*>(node)) {
+    return std::make_unique<CompareOpNode>(expression(compare->getLeft()), compare->getOperator(),
+                                           expression(compare->getRight()));
+  }
+  if (auto* arrayAccess = dynamic_cast<const ArrayAccessAST*>(node)) {
+    auto copy = std::make_unique<ArrayAccessAST>(renamed(arrayAccess->getArrayName(), renames),
+                                                 expression(arrayAccess->getIndex()));
+    // Wherever a pass moves the access, the ranges that proved it in bounds
+    // still hold.
+    if (arrayAccess->isInBounds()) {
+      copy->markInBounds();
+    }
+    return copy;
+  }
+  if (auto* varDecl = dynamic_cast<const VariableDeclAST*>(node)) {
+    return std::make_unique<VariableDeclAST>(varDecl->getType(), renamed(varDecl->getName(), renames),
+                                             clone(varDecl->getValue(), renames));
+  }
+  if (auto* arrayDecl = dynamic_cast<const ArrayDeclAST*>(node)) {
+    return std::make_unique<ArrayDeclAST>(arrayDecl->getElementType(), renamed(arrayDecl->getName(), renames),
+                                          arrayDecl->getSize(), arrayDecl->getElements());
+  }
+  if (auto* assignment = dynamic_cast<const AssignmentAST*>(node)) {
+    return std::make_unique<AssignmentAST>(clone(assignment->getLHS(), renames), clone(assignment->getRHS(), renames));
+  }
+  if (auto* print = dynamic_cast<const PrintAST*>(node)) {
+    return std::make_unique<PrintAST>(clone(print->getExpression(), renames));
+  }
+  if (auto* returnNode = dynamic_cast<const ReturnNode*>(node)) {
+    return std::make_unique<ReturnNode>(expression(returnNode->getExpression()));
+  }
+  if (auto* call = dynamic_cast<const FunctionCallNode*>(node)) {
+    return std::make_unique<FunctionCallNode>(call->getFunctionName(), clone(call->getArguments(), renames));
+  }
+  if (auto* inlined = dynamic_cast<const InlinedCallNode*>(node)) {
+    std::vector<std::string> parameters;
+    for (const auto& parameter : inlined->getParameters()) {
+      parameters.push_back(renamed(parameter, renames));
+    }
+    return std::make_unique<InlinedCallNode>(inlined->getFunctionName(), std::move(parameters),
+                                             clone(inlined->getArguments(), renames),
+                                             clone(inlined->getBody(), renames));
+  }
+  if (auto* ifNode = dynamic_cast<const IfNode*>(node)) {
+    return std::make_unique<IfNode>(expression(ifNode->getCondition()), clone(ifNode->getThenBody(), renames),
+                                    clone(ifNode->getElseBody(), renames));
+  }
+  auto* forNode = dynamic_cast<const ForNode*>(node);
+  assert(forNode && "function declarations are not copied");
+  return std::make_unique<ForNode>(renamed(forNode->getIteratorName(), renames), expression(forNode->getStart()),
+                                   expression(forNode->getFinish()),
+                                   forNode->getStep() ? expression(forNode->getStep()) : nullptr,
+                                   clone(forNode->getBody(), renames));
+}
+
+inline std::unique_ptr<ASTNode> clone(const ASTNode* node) {
+  return clone(node, Renames());
+}
+
+// Offers every expression inside the node to `rewrite`, outermost first. An
+// expression it returns a replacement for is swapped for it, and neither is
+// walked any further.
+template <typename Rewrite>
+void rewriteExpressions(ASTNode* node, Rewrite& rewrite) {
+  auto offer = [&](ASTNode* expression) -> std::unique_ptr<ASTNode> {
+    if (auto replacement = rewrite(static_cast<const ASTNode*>(expression))) {
+      return replacement;
+    }
+    rewriteExpressions(expression, rewrite);
+    return nullptr;
+  };
+
+  if (auto* arithmetic = dynamic_cast<ArithmeticOpNode*>(node)) {
+    if (auto left = offer(arithmetic->getLeft())) {
+      arithmetic->setLeft(left.release());
+    }
+    if (auto right = offer(arithmetic->getRight())) {
+      arithmetic->setRight(right.release());
+    }
+  } else if (auto* compare = dynamic_cast<CompareOpNode*>(node)) {
+    if (auto left = offer(compare->getLeft())) {
+      compare->setLeft(left.release());
+    }
+    if (auto right = offer(compare->getRight())) {
+      compare->setRight(right.release());
+    }
+  } else if (auto* arrayAccess = dynamic_cast<ArrayAccessAST*>(node)) {
+    if (auto index = offer(arrayAccess->getIndex())) {
+      arrayAccess->setIndex(index.release());
+    }
+  } else if (auto* varDecl = dynamic_cast<VariableDeclAST*>(node)) {
+    if (auto value = offer(varDecl->getValue())) {
+      varDecl->setValue(std::move(value));
+    }
+  } else if (auto* assignment = dynamic_cast<AssignmentAST*>(node)) {
+    // The target is not a read; only an element index is.
+    if (auto* target = dynamic_cast<ArrayAccessAST*>(assignment->getLHS())) {
+      rewriteExpressions(target, rewrite);
+    }
+    if (auto value = offer(assignment->getRHS())) {
+      assignment->setRHS(std::move(value));
+    }
+  } else if (auto* print = dynamic_cast<PrintAST*>(node)) {
+    if (auto expression = offer(print->getExpression())) {
+      print->setExpression(std::move(expression));
+    }
+  } else if (auto* returnNode = dynamic_cast<ReturnNode*>(node)) {
+    if (auto expression = offer(returnNode->getExpression())) {
+      returnNode->setExpression(expression.release());
+    }
+  } else if (auto* call = dynamic_cast<FunctionCallNode*>(node)) {
+    for (auto& argument : call->getArguments()) {
+      if (auto replacement = offer(argument.get())) {
+        argument = std::move(replacement);
+      }
+    }
+  } else if (auto* ifNode = dynamic_cast<IfNode*>(node)) {
+    if (auto condition = offer(ifNode->getCondition())) {
+      ifNode->setCondition(condition.release());
+    }
+    for (auto& stmt : ifNode->getThenBody()) {
+      rewriteExpressions(stmt.get(), rewrite);
+    }
+    for (auto& stmt : ifNode->getElseBody()) {
+      rewriteExpressions(stmt.get(), rewrite);
+    }
+  } else if (auto* forNode = dynamic_cast<ForNode*>(node)) {
+    if (auto start = offer(forNode->getStart())) {
+      forNode->setStart(start.release());
+    }
+    if (auto finish = offer(forNode->getFinish())) {
+      forNode->setFinish(finish.release());
+    }
+    if (forNode->getStep()) {
+      if (auto step = offer(forNode->getStep())) {
+        forNode->setStep(step.release());
+      }
+    }
+    for (auto& stmt : forNode->getBody()) {
+      rewriteExpressions(stmt.get(), rewrite);
+    }
+  }
+}
+
+#endif // AST_REWRITES_H
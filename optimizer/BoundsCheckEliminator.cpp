@@ -0,0 +1,220 @@
+#include "BoundsCheckEliminator.h"
+#include <algorithm>
+#include <iterator>
+#include "ASTQueries.h"
+
+namespace {
+
+// Names the node may bind to a value other than the array they are declared
+// as: assigned as a whole, declared as a variable or iterated over. The
+// register machine shares the array of `a = b` into `a`.
+void collectRebinds(const ASTNode* node, std::unordered_set<std::string>& names) {
+  if (auto* assignment = dynamic_cast<const AssignmentAST*>(node)) {
+    if (auto* variable = dynamic_cast<const VariableRefAST*>(assignment->getLHS())) {
+      names.insert(variable->getName());
+    }
+  } else if (auto* varDecl = dynamic_cast<const VariableDeclAST*>(node)) {
+    names.insert(varDecl->getName());
+  } else if (auto* forNode = dynamic_cast<const ForNode*>(node)) {
+    names.insert(forNode->getIteratorName());
+  }
+  forEachChild(node, [&](const ASTNode* child) { collectRebinds(child, names); });
+}
+
+// A slot that already holds an array keeps it when it is declared again,
+// so the smallest declaration is the size the array is sure to have.
+void collectArraySizes(const ASTNode* node, std::unordered_map<std::string, int64_t>& sizes) {
+  if (auto* arrayDecl = dynamic_cast<const ArrayDeclAST*>(node)) {
+    auto [it, inserted] = sizes.try_emplace(arrayDecl->getName(), arrayDecl->getSize());
+    it->second = std::min(it->second, arrayDecl->getSize());
+  }
+  forEachChild(node, [&](const ASTNode* child) { collectArraySizes(child, sizes); });
+}
+
+} // namespace
+
+void BoundsCheckEliminator::optimize(std::vector<std::unique_ptr<ASTNode>>& ast) {
+  std::unordered_map<std::string, int64_t> globalSizes;
+  std::unordered_set<std::string> globalRebinds;
+  std::unordered_set<std::string> changedByCalls;
+  for (const auto& node : ast) {
+    auto* function = dynamic_cast<const FunctionDeclNode*>(node.get());
+    if (!function) {
+      collectArraySizes(node.get(), globalSizes);
+      collectRebinds(node.get(), globalRebinds);
+      continue;
+    }
+    std::unordered_set<std::string> locals = localsOf(function);
+    std::unordered_set<std::string> written;
+    std::unordered_set<std::string> rebinds;
+    for (const auto& stmt : function->getBody()) {
+      collectWrites(stmt.get(), written);
+      collectRebinds(stmt.get(), rebinds);
+    }
+    std::copy_if(written.begin(), written.end(), std::inserter(changedByCalls, changedByCalls.end()),
+                 [&](const std::string& name) { return !locals.contains(name); });
+    std::copy_if(rebinds.begin(), rebinds.end(), std::inserter(globalRebinds, globalRebinds.end()),
+                 [&](const std::string& name) { return !locals.contains(name); });
+  }
+  for (const std::string& name : globalRebinds) {
+    globalSizes.erase(name);
+  }
+
+  BoundsCheckEliminator eliminator;
+  eliminator.sizes_ = globalSizes;
+  eliminator.changedByCalls_ = std::move(changedByCalls);
+  for (const auto& node : ast) {
+    if (!dynamic_cast<const FunctionDeclNode*>(node.get())) {
+      eliminator.visit(node.get());
+    }
+  }
+  eliminator.changedByCalls_.clear();
+
+  for (const auto& node : ast) {
+    auto* function = dynamic_cast<const FunctionDeclNode*>(node.get());
+    if (!function) {
+      continue;
+    }
+    // An array parameter can have any size.
+    std::unordered_set<std::string> locals = localsOf(function);
+    std::unordered_map<std::string, int64_t> localSizes;
+    std::unordered_set<std::string> rebinds(function->getParameters().begin(), function->getParameters().end());
+    for (const auto& stmt : function->getBody()) {
+      collectArraySizes(stmt.get(), localSizes);
+      collectRebinds(stmt.get(), rebinds);
+    }
+    eliminator.sizes_.clear();
+    for (const auto& [name, size] : globalSizes) {
+      if (!locals.contains(name)) {
+        eliminator.sizes_.emplace(name, size);
+      }
+    }
+    for (const auto& [name, size] : localSizes) {
+      if (!rebinds.contains(name)) {
+        eliminator.sizes_.emplace(name, size);
+      }
+    }
+    for (const auto& stmt : function->getBody()) {
+      eliminator.visit(stmt.get());
+    }
+  }
+}
+
+void BoundsCheckEliminator::visit(const ASTNode* node) {
+  if (auto* loop = dynamic_cast<const ForNode*>(node)) {
+    visitLoop(loop);
+    return;
+  }
+  if (auto* access = dynamic_cast<const ArrayAccessAST*>(node)) {
+    visitAccess(access);
+  }
+  forEachChild(node, [this](const ASTNode* child) { visit(child); });
+}
+
+// The header compares the iterator with the finish before every iteration,
+// and the step only moves it up, so inside the body it lies between the
+// lowest start and the highest finish minus one. The iterator must not wrap
+// when it steps past the finish.
+void BoundsCheckEliminator::visitLoop(const ForNode* loop) {
+  visit(loop->getStart());
+  visit(loop->getFinish());
+  if (loop->getStep()) {
+    visit(loop->getStep());
+  }
+
+  const std::string& iterator = loop->getIteratorName();
+  std::unordered_set<std::string> written;
+  bool calls = containsCall(loop->getFinish()) || (loop->getStep() && containsCall(loop->getStep()));
+  for (const auto& stmt : loop->getBody()) {
+    collectWrites(stmt.get(), written);
+    calls |= containsCall(stmt.get());
+  }
+
+  auto start = rangeOf(loop->getStart());
+  auto finish = rangeOf(loop->getFinish());
+  auto step = loop->getStep() ? rangeOf(loop->getStep()) : Range{1, 1};
+  bool bounded = start && finish && step && step->low > 0 &&
+      static_cast<__int128>(finish->high) + step->high <= INT64_MAX &&
+      !written.contains(iterator) && !(calls && changedByCalls_.contains(iterator));
+
+  auto outer = iterators_.extract(iterator);
+  if (bounded && start->low <= finish->high - 1) {
+    iterators_[iterator] = {start->low, finish->high - 1};
+  }
+  for (const auto& stmt : loop->getBody()) {
+    visit(stmt.get());
+  }
+  iterators_.erase(iterator);
+  if (outer) {
+    iterators_.insert(std::move(outer));
+  }
+}
+
+void BoundsCheckEliminator::visitAccess(const ArrayAccessAST* access) {
+  auto size = sizes_.find(access->getArrayName());
+  if (size == sizes_.end()) {
+    return;
+  }
+  auto index = rangeOf(access->getIndex());
+  if (index && index->low >= 0 && index->high < size->second) {
+    // The walk is read-only; the access is the one node the pass changes.
+    const_cast<ArrayAccessAST*>(access)->markInBounds();
+  }
+}
+
+std::optional<BoundsCheckEliminator::Range> BoundsCheckEliminator::rangeOf(const ASTNode* node) const {
+  if (auto value = constantValue(node)) {
+    return Range{*value, *value};
+  }
+  if (auto* variable = dynamic_cast<const VariableRefAST*>(node)) {
+    auto it = iterators_.find(variable->getName());
+    return it != iterators_.end() ? std::optional<Range>(it->second) : std::nullopt;
+  }
+  auto* arithmetic = dynamic_cast<const ArithmeticOpNode*>(node);
+  if (!arithmetic) {
+    return std::nullopt;
+  }
+  auto left = rangeOf(arithmetic->getLeft());
+  auto right = rangeOf(arithmetic->getRight());
+  if (!left || !right) {
+    return std::nullopt;
+  }
+
+  // Bounds are computed in 128 bits. Every value in range fits into 64, so
+  // no machine wraps or reports an overflow while computing it.
+  auto within = [](__int128 low, __int128 high) -> std::optional<Range> {
+    if (low < INT64_MIN || high > INT64_MAX) {
+      return std::nullopt;
+    }
+    return Range{static_cast<int64_t>(low), static_cast<int64_t>(high)};
+  };
+  using Wide = __int128;
+  using Operator = ArithmeticOpNode::Operator;
+  switch (arithmetic->getOperator()) {
+    case Operator::ADD:
+      return within(Wide{left->low} + right->low, Wide{left->high} + right->high);
+    case Operator::SUBTRACT:
+      return within(Wide{left->low} - right->high, Wide{left->high} - right->low);
+    case Operator::MULTIPLY: {
+      Wide products[] = {Wide{left->low} * right->low, Wide{left->low} * right->high,
+                         Wide{left->high} * right->low, Wide{left->high} * right->high};
+      auto [low, high] = std::minmax_element(std::begin(products), std::end(products));
+      return within(*low, *high);
+    }
+    case Operator::DIVIDE:
+    case Operator::MODULO: {
+      // Only by a positive constant, which keeps division monotonic and
+      // bounds the remainder by the divisor.
+      if (right->low != right->high || right->low <= 0) {
+        return std::nullopt;
+      }
+      int64_t divisor = right->low;
+      if (arithmetic->getOperator() == Operator::DIVIDE) {
+        return Range{left->low / divisor, left->high / divisor};
+      }
+      return Range{left->low < 0 ? std::max(left->low, 1 - divisor) : 0,
+                   left->high > 0 ? std::min(left->high, divisor - 1) : 0};
+    }
+  }
+  return std::nullopt;
+}
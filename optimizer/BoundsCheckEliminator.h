@@ -0,0 +1,49 @@
+#ifndef BOUNDS_CHECK_ELIMINATOR_H
+#define BOUNDS_CHECK_ELIMINATOR_H
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "ASTNode.h"
+
+class ArrayAccessAST;
+class ForNode;
+
+// Marks the element accesses whose index is always inside the array, so the
+// bytecode generators emit them without a bounds check. An index is bounded
+// by a range analysis: constants are their own range, the iterator of a
+// `for` loop with a bounded start, finish and positive step ranges from the
+// start to the finish minus one, and sums, differences and products combine
+// the ranges of their operands. The array's size is the smallest one it is
+// declared with, for arrays that no assignment, declaration or call can
+// replace with another array.
+class BoundsCheckEliminator {
+ public:
+  static void optimize(std::vector<std::unique_ptr<ASTNode>>& ast);
+
+ private:
+  struct Range {
+    int64_t low;
+    int64_t high;
+  };
+
+  void visit(const ASTNode* node);
+  void visitLoop(const ForNode* loop);
+  void visitAccess(const ArrayAccessAST* access);
+
+  [[nodiscard]] std::optional<Range> rangeOf(const ASTNode* node) const;
+
+  // Smallest declared size of every array of the scope that keeps its size.
+  std::unordered_map<std::string, int64_t> sizes_;
+  // Range of the iterators of the enclosing loops the body cannot change.
+  std::unordered_map<std::string, Range> iterators_;
+  // Globals that some function assigns, and so any call may change. Empty
+  // inside a function, whose iterators are its own.
+  std::unordered_set<std::string> changedByCalls_;
+};
+
+#endif // BOUNDS_CHECK_ELIMINATOR_H
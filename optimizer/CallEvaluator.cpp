@@ -0,0 +1,168 @@
+#include "CallEvaluator.h"
+#include "ASTQueries.h"
+#include "ASTRewrites.h"
+
+CallEvaluator::CallEvaluator(const std::vector<std::unique_ptr<ASTNode>>& ast) {
+  std::unordered_set<std::string> pure = pureFunctions(ast);
+  for (const auto& node : ast) {
+    auto* function = dynamic_cast<const FunctionDeclNode*>(node.get());
+    if (function && pure.contains(function->getFunctionName())) {
+      functions_.emplace(function->getFunctionName(),
+                         Function{function->getParameters(), clone(function->getBody(), Renames())});
+    }
+  }
+}
+
+std::optional<int64_t> CallEvaluator::evaluate(const FunctionCallNode* call) {
+  std::vector<int64_t> arguments;
+  for (const auto& argument : call->getArguments()) {
+    auto value = constantValue(argument.get());
+    if (!value) {
+      return std::nullopt;
+    }
+    arguments.push_back(*value);
+  }
+  return evaluate(call->getFunctionName(), arguments);
+}
+
+std::optional<int64_t> CallEvaluator::evaluate(const std::string& function, const std::vector<int64_t>& arguments) {
+  auto [it, inserted] = results_.try_emplace({function, arguments});
+  if (inserted) {
+    steps_ = 0;
+    it->second = call(function, arguments, 0);
+  }
+  return it->second;
+}
+
+// A new frame holds the arguments and zero in every other local.
+std::optional<int64_t> CallEvaluator::call(const std::string& function, const std::vector<int64_t>& arguments,
+                                           size_t depth) {
+  auto it = functions_.find(function);
+  if (it == functions_.end() || it->second.parameters.size() != arguments.size() || depth >= kMaxDepth) {
+    return std::nullopt;
+  }
+  Frame frame;
+  for (size_t i = 0; i < arguments.size(); ++i) {
+    frame[it->second.parameters[i]] = arguments[i];
+  }
+  int64_t result = 0;
+  if (run(it->second.body, frame, depth, result) != Flow::Return) {
+    return std::nullopt;
+  }
+  return result;
+}
+
+CallEvaluator::Flow CallEvaluator::run(const Body& body, Frame& frame, size_t depth, int64_t& result) {
+  for (const auto& stmt : body) {
+    Flow flow = run(stmt.get(), frame, depth, result);
+    if (flow != Flow::Next) {
+      return flow;
+    }
+  }
+  return Flow::Next;
+}
+
+CallEvaluator::Flow CallEvaluator::run(const ASTNode* stmt, Frame& frame, size_t depth, int64_t& result) {
+  if (++steps_ > kStepBudget) {
+    return Flow::Fail;
+  }
+
+  if (auto* varDecl = dynamic_cast<const VariableDeclAST*>(stmt)) {
+    auto value = this->value(varDecl->getValue(), frame, depth);
+    if (!value) {
+      return Flow::Fail;
+    }
+    frame[varDecl->getName()] = *value;
+    return Flow::Next;
+  }
+  if (auto* assignment = dynamic_cast<const AssignmentAST*>(stmt)) {
+    auto* variable = dynamic_cast<const VariableRefAST*>(assignment->getLHS());
+    auto value = this->value(assignment->getRHS(), frame, depth);
+    if (!variable || !value) {
+      return Flow::Fail;
+    }
+    frame[variable->getName()] = *value;
+    return Flow::Next;
+  }
+  if (auto* returnNode = dynamic_cast<const ReturnNode*>(stmt)) {
+    auto value = this->value(returnNode->getExpression(), frame, depth);
+    if (!value) {
+      return Flow::Fail;
+    }
+    result = *value;
+    return Flow::Return;
+  }
+  if (auto* ifNode = dynamic_cast<const IfNode*>(stmt)) {
+    auto condition = value(ifNode->getCondition(), frame, depth);
+    if (!condition) {
+      return Flow::Fail;
+    }
+    return run(*condition ? ifNode->getThenBody() : ifNode->getElseBody(), frame, depth, result);
+  }
+  if (auto* forNode = dynamic_cast<const ForNode*>(stmt)) {
+    // The finish is compared before every iteration and the step added
+    // after it, both as the loop's header evaluates them.
+    const std::string& iterator = forNode->getIteratorName();
+    auto start = value(forNode->getStart(), frame, depth);
+    if (!start) {
+      return Flow::Fail;
+    }
+    frame[iterator] = *start;
+    while (true) {
+      auto finish = value(forNode->getFinish(), frame, depth);
+      if (!finish) {
+        return Flow::Fail;
+      }
+      if (frame[iterator] >= *finish) {
+        return Flow::Next;
+      }
+      Flow flow = run(forNode->getBody(), frame, depth, result);
+      if (flow != Flow::Next) {
+        return flow;
+      }
+      auto step = forNode->getStep() ? value(forNode->getStep(), frame, depth) : std::optional<int64_t>(1);
+      auto next = step ? evaluateArithmetic(ArithmeticOpNode::Operator::ADD, frame[iterator], *step) : std::nullopt;
+      if (!next) {
+        return Flow::Fail;
+      }
+      frame[iterator] = *next;
+    }
+  }
+  // An expression statement, whose value is dropped.
+  return value(stmt, frame, depth) ? Flow::Next : Flow::Fail;
+}
+
+std::optional<int64_t> CallEvaluator::value(const ASTNode* node, Frame& frame, size_t depth) {
+  if (++steps_ > kStepBudget) {
+    return std::nullopt;
+  }
+
+  if (auto value = constantValue(node)) {
+    return value;
+  }
+  if (auto* variable = dynamic_cast<const VariableRefAST*>(node)) {
+    return frame[variable->getName()];
+  }
+  if (auto* arithmetic = dynamic_cast<const ArithmeticOpNode*>(node)) {
+    auto left = value(arithmetic->getLeft(), frame, depth);
+    auto right = left ? value(arithmetic->getRight(), frame, depth) : std::nullopt;
+    return right ? evaluateArithmetic(arithmetic->getOperator(), *left, *right) : std::nullopt;
+  }
+  if (auto* compare = dynamic_cast<const CompareOpNode*>(node)) {
+    auto left = value(compare->getLeft(), frame, depth);
+    auto right = left ? value(compare->getRight(), frame, depth) : std::nullopt;
+    return right ? std::optional(evaluateCompare(compare->getOperator(), *left, *right)) : std::nullopt;
+  }
+  if (auto* call = dynamic_cast<const FunctionCallNode*>(node)) {
+    std::vector<int64_t> arguments;
+    for (const auto& argument : call->getArguments()) {
+      auto value = this->value(argument.get(), frame, depth);
+      if (!value) {
+        return std::nullopt;
+      }
+      arguments.push_back(*value);
+    }
+    return this->call(call->getFunctionName(), arguments, depth + 1);
+  }
+  return std::nullopt;
+}
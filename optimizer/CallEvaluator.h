@@ -0,0 +1,58 @@
+#ifndef CALL_EVALUATOR_H
+#define CALL_EVALUATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "ASTNode.h"
+
+class FunctionCallNode;
+
+// Runs calls of pure functions (see pureFunctions) at compile time, so a
+// call whose arguments are constants becomes its result. The evaluator
+// interprets a copy of each pure function taken when it is built, so later
+// passes can change the program freely. It gives up, and the call stays, on
+// anything the VM would fail on or that ASTOptimizer would not fold: an
+// overflow, a division by zero, a wrong argument count, a function that ends
+// without `return`, and calls nested more than kMaxDepth deep or taking
+// more than kStepBudget steps.
+class CallEvaluator {
+ public:
+  static constexpr size_t kStepBudget = 100'000;
+  static constexpr size_t kMaxDepth = 256;
+
+  explicit CallEvaluator(const std::vector<std::unique_ptr<ASTNode>>& ast);
+
+  // The call's result, if its function is pure and its arguments constants.
+  std::optional<int64_t> evaluate(const FunctionCallNode* call);
+  std::optional<int64_t> evaluate(const std::string& function, const std::vector<int64_t>& arguments);
+
+ private:
+  using Body = std::vector<std::unique_ptr<ASTNode>>;
+  using Frame = std::unordered_map<std::string, int64_t>;
+
+  struct Function {
+    std::vector<std::string> parameters;
+    Body body;
+  };
+
+  enum class Flow { Next, Return, Fail };
+
+  std::optional<int64_t> call(const std::string& function, const std::vector<int64_t>& arguments, size_t depth);
+  Flow run(const Body& body, Frame& frame, size_t depth, int64_t& result);
+  Flow run(const ASTNode* stmt, Frame& frame, size_t depth, int64_t& result);
+  std::optional<int64_t> value(const ASTNode* node, Frame& frame, size_t depth);
+
+  std::unordered_map<std::string, Function> functions_;
+  // Every call evaluate() was asked for, and its result if it had one.
+  std::map<std::pair<std::string, std::vector<int64_t>>, std::optional<int64_t>> results_;
+  size_t steps_ = 0;
+};
+
+#endif // CALL_EVALUATOR_H
@@ -0,0 +1,332 @@
+#include "Inliner.h"
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <set>
+#include "ASTQueries.h"
+#include "ASTRewrites.h"
+
+namespace {
+
+size_t sizeOf(const ASTNode* node) {
+  size_t size = 1;
+  forEachChild(node, [&](const ASTNode* child) { size += sizeOf(child); });
+  return size;
+}
+
+// Variables and arrays the node reads or assigns.
+void collectNames(const ASTNode* node, std::set<std::string>& names) {
+  if (auto* variable = dynamic_cast<const VariableRefAST*>(node)) {
+    names.insert(variable->getName());
+  } else if (auto* arrayAccess = dynamic_cast<const ArrayAccessAST*>(node)) {
+    names.insert(arrayAccess->getArrayName());
+  }
+  forEachChild(node, [&](const ASTNode* child) { collectNames(child, names); });
+}
+
+bool mentions(const ASTNode* node, const std::string& name) {
+  std::set<std::string> names;
+  collectNames(node, names);
+  return names.contains(name);
+}
+
+void collectArrays(const ASTNode* node, std::unordered_set<std::string>& arrays) {
+  if (auto* arrayDecl = dynamic_cast<const ArrayDeclAST*>(node)) {
+    arrays.insert(arrayDecl->getName());
+  }
+  forEachChild(node, [&](const ASTNode* child) { collectArrays(child, arrays); });
+}
+
+// The parameters and locals of calls inlined into the node, which every
+// copy assigns or zeroes itself.
+void collectInlinedLocals(const ASTNode* node, std::unordered_set<std::string>& names) {
+  if (dynamic_cast<const InlinedCallNode*>(node)) {
+    collectDeclarations(node, names);
+    return;
+  }
+  forEachChild(node, [&](const ASTNode* child) { collectInlinedLocals(child, names); });
+}
+
+// A local is assigned before it is read when the first statement of the
+// body that mentions it declares it, or starts a loop over it, without
+// reading it. Any other local may be read while it still holds the value of
+// an earlier inlined copy, where a call would find it zeroed.
+std::vector<std::string> readBeforeAssigned(const FunctionDeclNode* function,
+                                            const std::unordered_set<std::string>& locals) {
+  std::unordered_set<std::string> seen(function->getParameters().begin(), function->getParameters().end());
+  for (const auto& stmt : function->getBody()) {
+    collectInlinedLocals(stmt.get(), seen);
+  }
+  std::vector<std::string> zeroed;
+  for (const auto& stmt : function->getBody()) {
+    std::set<std::string> names;
+    collectNames(stmt.get(), names);
+    std::unordered_set<std::string> declared;
+    collectDeclarations(stmt.get(), declared);
+    names.insert(declared.begin(), declared.end());
+
+    for (const std::string& name : names) {
+      if (!locals.contains(name) || !seen.insert(name).second) {
+        continue;
+      }
+      auto* varDecl = dynamic_cast<const VariableDeclAST*>(stmt.get());
+      auto* forNode = dynamic_cast<const ForNode*>(stmt.get());
+      bool assigned = (varDecl && varDecl->getName() == name && !mentions(varDecl->getValue(), name)) ||
+          (forNode && forNode->getIteratorName() == name && !mentions(forNode->getStart(), name));
+      if (!assigned) {
+        zeroed.push_back(name);
+      }
+    }
+  }
+  return zeroed;
+}
+
+} // namespace
+
+void Inliner::optimize(std::vector<std::unique_ptr<ASTNode>>& ast, bool verbose) {
+  Inliner inliner;
+  std::unordered_map<std::string, FunctionDeclNode*> functions;
+  std::unordered_set<std::string> redeclared;
+  std::unordered_map<std::string, std::vector<std::string>> calls;
+  for (const auto& node : ast) {
+    auto* function = dynamic_cast<FunctionDeclNode*>(node.get());
+    if (!function) {
+      collectArrays(node.get(), inliner.arrays_);
+      continue;
+    }
+    if (!functions.emplace(function->getFunctionName(), function).second) {
+      redeclared.insert(function->getFunctionName());
+    }
+    for (const auto& stmt : function->getBody()) {
+      collectArrays(stmt.get(), inliner.arrays_);
+      forEachCall(stmt.get(), [&](const std::string& callee) { calls[function->getFunctionName()].push_back(callee); });
+    }
+  }
+
+  auto recursive = [&](const std::string& name) {
+    std::unordered_set<std::string> reached;
+    std::vector<std::string> pending = calls[name];
+    while (!pending.empty()) {
+      std::string next = std::move(pending.back());
+      pending.pop_back();
+      if (next == name) {
+        return true;
+      }
+      if (reached.insert(next).second) {
+        pending.insert(pending.end(), calls[next].begin(), calls[next].end());
+      }
+    }
+    return false;
+  };
+
+  auto inlinable = [&](const FunctionDeclNode* function) {
+    const Body& body = function->getBody();
+    const std::vector<std::string>& parameters = function->getParameters();
+    if (body.empty() || !dynamic_cast<const ReturnNode*>(body.back().get()) ||
+        std::unordered_set<std::string>(parameters.begin(), parameters.end()).size() != parameters.size()) {
+      return false;
+    }
+    size_t size = 0;
+    std::unordered_set<std::string> arrays;
+    for (const auto& stmt : body) {
+      size += sizeOf(stmt.get());
+      collectArrays(stmt.get(), arrays);
+    }
+    return size <= kMaxSize && arrays.empty();
+  };
+
+  // Callees first, so a copy is made of a body whose own calls are already
+  // inlined and it is measured as it will be copied.
+  std::unordered_set<std::string> expanded;
+  std::function<void(const std::string&)> expand = [&](const std::string& name) {
+    auto it = functions.find(name);
+    if (it == functions.end() || !expanded.insert(name).second) {
+      return;
+    }
+    for (const std::string& callee : calls[name]) {
+      expand(callee);
+    }
+    FunctionDeclNode* function = it->second;
+    std::unordered_set<std::string> locals = localsOf(function);
+    inliner.caller_ = name;
+    inliner.callerLocals_ = &locals;
+    inliner.expandBody(function->getBody());
+    inliner.callerLocals_ = nullptr;
+
+    if (redeclared.contains(name) || recursive(name) || !inlinable(function)) {
+      return;
+    }
+    Callee callee{function, localsOf(function), {}, {}};
+    callee.zeroed = readBeforeAssigned(function, callee.locals);
+    std::set<std::string> names;
+    for (const auto& stmt : function->getBody()) {
+      collectNames(stmt.get(), names);
+    }
+    std::copy_if(names.begin(), names.end(), std::inserter(callee.globals, callee.globals.end()),
+                 [&](const std::string& used) { return !callee.locals.contains(used); });
+    inliner.callees_.emplace(name, std::move(callee));
+  };
+  for (const auto& node : ast) {
+    if (auto* function = dynamic_cast<const FunctionDeclNode*>(node.get())) {
+      expand(function->getFunctionName());
+    }
+  }
+  inliner.caller_.clear();
+  inliner.expandBody(ast);
+
+  // Dropping a function can leave the functions only it called uncalled.
+  std::unordered_set<std::string> inlinedCallees;
+  for (const auto& [site, count] : inliner.inlined_) {
+    inlinedCallees.insert(site.second);
+  }
+  std::vector<std::string> dropped;
+  bool changed = true;
+  while (changed) {
+    std::unordered_set<std::string> called;
+    for (const auto& node : ast) {
+      forEachCall(node.get(), [&](const std::string& name) { called.insert(name); });
+      if (auto* function = dynamic_cast<const FunctionDeclNode*>(node.get())) {
+        for (const auto& stmt : function->getBody()) {
+          forEachCall(stmt.get(), [&](const std::string& name) { called.insert(name); });
+        }
+      }
+    }
+    changed = false;
+    std::erase_if(ast, [&](const std::unique_ptr<ASTNode>& node) {
+      auto* function = dynamic_cast<const FunctionDeclNode*>(node.get());
+      if (!function || !inlinedCallees.contains(function->getFunctionName()) ||
+          called.contains(function->getFunctionName())) {
+        return false;
+      }
+      dropped.push_back(function->getFunctionName());
+      changed = true;
+      return true;
+    });
+  }
+
+  if (!verbose) {
+    return;
+  }
+  for (const auto& [site, count] : inliner.inlined_) {
+    std::cerr << "inlined " << site.second << " into " << (site.first.empty() ? "the top level" : site.first)
+              << ": " << count << (count == 1 ? " call" : " calls") << "\n";
+  }
+  for (const std::string& name : dropped) {
+    std::cerr << "dropped " << name << ": no calls left\n";
+  }
+}
+
+void Inliner::expandBody(Body& body) {
+  for (auto& stmt : body) {
+    if (auto* call = dynamic_cast<const FunctionCallNode*>(stmt.get())) {
+      if (auto inlined = inlineCall(call)) {
+        stmt = std::move(inlined);
+        continue;
+      }
+    }
+    expandStatement(stmt.get());
+  }
+}
+
+void Inliner::expandStatement(ASTNode* node) {
+  auto rewrite = [this](const ASTNode* expression) -> std::unique_ptr<ASTNode> {
+    auto* call = dynamic_cast<const FunctionCallNode*>(expression);
+    return call ? inlineCall(call) : nullptr;
+  };
+  auto offer = [&](ASTNode* expression) -> std::unique_ptr<ASTNode> {
+    if (auto replacement = rewrite(expression)) {
+      return replacement;
+    }
+    rewriteExpressions(expression, rewrite);
+    return nullptr;
+  };
+
+  // Statements nested in `if` and `for` can be calls themselves.
+  if (auto* ifNode = dynamic_cast<IfNode*>(node)) {
+    if (auto condition = offer(ifNode->getCondition())) {
+      ifNode->setCondition(condition.release());
+    }
+    expandBody(ifNode->getThenBody());
+    expandBody(ifNode->getElseBody());
+  } else if (auto* forNode = dynamic_cast<ForNode*>(node)) {
+    if (auto start = offer(forNode->getStart())) {
+      forNode->setStart(start.release());
+    }
+    if (auto finish = offer(forNode->getFinish())) {
+      forNode->setFinish(finish.release());
+    }
+    if (forNode->getStep()) {
+      if (auto step = offer(forNode->getStep())) {
+        forNode->setStep(step.release());
+      }
+    }
+    expandBody(forNode->getBody());
+  } else {
+    rewriteExpressions(node, rewrite);
+  }
+}
+
+void Inliner::expandExpression(std::unique_ptr<ASTNode>& expression) {
+  auto rewrite = [this](const ASTNode* node) -> std::unique_ptr<ASTNode> {
+    auto* call = dynamic_cast<const FunctionCallNode*>(node);
+    return call ? inlineCall(call) : nullptr;
+  };
+  if (auto replacement = rewrite(expression.get())) {
+    expression = std::move(replacement);
+  } else {
+    rewriteExpressions(expression.get(), rewrite);
+  }
+}
+
+std::unique_ptr<ASTNode> Inliner::inlineCall(const FunctionCallNode* call) {
+  auto it = callees_.find(call->getFunctionName());
+  if (it == callees_.end()) {
+    return nullptr;
+  }
+  const Callee& callee = it->second;
+  const std::vector<std::string>& parameters = callee.function->getParameters();
+  // A wrong argument count fails as the call would. A local of the caller
+  // hides the global the body means, and an array argument cannot be
+  // stored into a variable.
+  if (call->getArguments().size() != parameters.size()) {
+    return nullptr;
+  }
+  if (callerLocals_ && std::any_of(callee.globals.begin(), callee.globals.end(),
+                                   [this](const std::string& name) { return callerLocals_->contains(name); })) {
+    return nullptr;
+  }
+  for (const auto& argument : call->getArguments()) {
+    auto* variable = dynamic_cast<const VariableRefAST*>(argument.get());
+    if (variable && arrays_.contains(variable->getName())) {
+      return nullptr;
+    }
+  }
+
+  // The call is replaced by the new node, so its arguments move over.
+  auto& arguments = const_cast<FunctionCallNode*>(call)->getArguments();
+  for (auto& argument : arguments) {
+    expandExpression(argument);
+  }
+
+  const std::string& name = call->getFunctionName();
+  std::string prefix = name + "." + std::to_string(copies_[name]++) + ".";
+  Renames renames;
+  for (const std::string& local : callee.locals) {
+    renames.emplace(local, prefix + local);
+  }
+  std::vector<std::string> renamedParameters;
+  for (const std::string& parameter : parameters) {
+    renamedParameters.push_back(renames.at(parameter));
+  }
+  Body body;
+  for (const std::string& local : callee.zeroed) {
+    body.push_back(std::make_unique<VariableDeclAST>("int", renames.at(local), std::make_unique<NumberAST>(0)));
+  }
+  for (const auto& stmt : callee.function->getBody()) {
+    body.push_back(clone(stmt.get(), renames));
+  }
+
+  ++inlined_[{caller_, name}];
+  return std::make_unique<InlinedCallNode>(name, std::move(renamedParameters), std::move(arguments),
+                                           std::move(body));
+}
@@ -0,0 +1,62 @@
+#ifndef INLINER_H
+#define INLINER_H
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "ASTNode.h"
+
+class FunctionCallNode;
+class FunctionDeclNode;
+
+// Replaces calls of small functions with a copy of the function's body, an
+// InlinedCallNode, so the call costs no frame. A function is inlined when it
+// does not call itself, directly or through other functions, ends with a
+// `return`, declares no arrays and has at most kMaxSize nodes once its own
+// calls are inlined. The copy's parameters and locals are renamed to
+// `<function>.<copy>.<name>`, which no program can spell, and its locals
+// that a call would see zeroed are zeroed first. A function nothing calls
+// any more after inlining is dropped.
+class Inliner {
+ public:
+  static constexpr size_t kMaxSize = 40;
+
+  // With `verbose`, reports every function inlined into every caller.
+  static void optimize(std::vector<std::unique_ptr<ASTNode>>& ast, bool verbose);
+
+ private:
+  using Body = std::vector<std::unique_ptr<ASTNode>>;
+
+  struct Callee {
+    const FunctionDeclNode* function;
+    std::unordered_set<std::string> locals;
+    // Locals a call would read before assigning them.
+    std::vector<std::string> zeroed;
+    // Globals the body uses.
+    std::unordered_set<std::string> globals;
+  };
+
+  void expandBody(Body& body);
+  void expandStatement(ASTNode* node);
+  void expandExpression(std::unique_ptr<ASTNode>& expression);
+  // The inlined call, or null when the call stays.
+  std::unique_ptr<ASTNode> inlineCall(const FunctionCallNode* call);
+
+  std::unordered_map<std::string, Callee> callees_;
+  // Variables and arrays the program declares as arrays.
+  std::unordered_set<std::string> arrays_;
+  // Locals of the function being expanded. Null at the top level, where
+  // the callee's globals are the caller's own variables.
+  const std::unordered_set<std::string>* callerLocals_ = nullptr;
+  std::string caller_;
+  std::unordered_map<std::string, size_t> copies_;
+  // Calls inlined per caller and callee.
+  std::map<std::pair<std::string, std::string>, size_t> inlined_;
+};
+
+#endif // INLINER_H
@@ -0,0 +1,342 @@
+#include "LoopOptimizer.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <functional>
+#include <iterator>
+#include <map>
+#include "ASTQueries.h"
+#include "ASTRewrites.h"
+
+namespace {
+
+bool isTrivial(const ASTNode* node) {
+  return dynamic_cast<const NumberAST*>(node) || dynamic_cast<const BooleanAST*>(node) ||
+      dynamic_cast<const VariableRefAST*>(node);
+}
+
+std::string key(const ASTNode* node);
+
+// "(left op right)". Appended piece by piece: chained operator+ on
+// temporaries trips GCC's -Wrestrict.
+std::string binaryKey(const ASTNode* left, const char* op, const ASTNode* right) {
+  std::string result = "(";
+  result += key(left);
+  result += op;
+  result += key(right);
+  result += ')';
+  return result;
+}
+
+// Spells out an expression clone() can copy, so equal expressions share one
+// variable.
+std::string key(const ASTNode* node) {
+  if (auto* number = dynamic_cast<const NumberAST*>(node)) {
+    return std::to_string(number->getValue());
+  }
+  if (auto* boolean = dynamic_cast<const BooleanAST*>(node)) {
+    return std::to_string(boolean->getValue());
+  }
+  if (auto* variable = dynamic_cast<const VariableRefAST*>(node)) {
+    return variable->getName();
+  }
+  if (auto* arithmetic = dynamic_cast<const ArithmeticOpNode*>(node)) {
+    static const char* const kOperators[] = {"+", "-", "*", "/", "%"};
+    return binaryKey(arithmetic->getLeft(), kOperators[static_cast<int>(arithmetic->getOperator())],
+                     arithmetic->getRight());
+  }
+  if (auto* compare = dynamic_cast<const CompareOpNode*>(node)) {
+    static const char* const kOperators[] = {"<", ">", "<=", ">=", "=="};
+    return binaryKey(compare->getLeft(), kOperators[static_cast<int>(compare->getOperator())], compare->getRight());
+  }
+  auto* arrayAccess = dynamic_cast<const ArrayAccessAST*>(node);
+  std::string result = arrayAccess->getArrayName();
+  result += '[';
+  result += key(arrayAccess->getIndex());
+  result += ']';
+  return result;
+}
+
+// The constant factor of `iterator * c` or `c * iterator`.
+std::optional<int64_t> iteratorFactor(const ASTNode* node, const std::string& iterator) {
+  auto* product = dynamic_cast<const ArithmeticOpNode*>(node);
+  if (!product || product->getOperator() != ArithmeticOpNode::Operator::MULTIPLY) {
+    return std::nullopt;
+  }
+  auto isIterator = [&](const ASTNode* operand) {
+    auto* variable = dynamic_cast<const VariableRefAST*>(operand);
+    return variable && variable->getName() == iterator;
+  };
+  if (isIterator(product->getLeft())) {
+    return constantValue(product->getRight());
+  }
+  if (isIterator(product->getRight())) {
+    return constantValue(product->getLeft());
+  }
+  return std::nullopt;
+}
+
+} // namespace
+
+void LoopOptimizer::optimize(std::vector<std::unique_ptr<ASTNode>>& ast) {
+  LoopOptimizer optimizer;
+  optimizer.optimizeBody(ast);
+
+  for (const auto& node : ast) {
+    if (auto* function = dynamic_cast<FunctionDeclNode*>(node.get())) {
+      std::unordered_set<std::string> locals = localsOf(function);
+      optimizer.locals_ = &locals;
+      optimizer.optimizeBody(function->getBody());
+      optimizer.locals_ = nullptr;
+    }
+  }
+}
+
+void LoopOptimizer::optimizeBody(Body& body) {
+  Body optimized;
+  for (auto& stmt : body) {
+    if (auto* ifNode = dynamic_cast<IfNode*>(stmt.get())) {
+      optimizeBody(ifNode->getThenBody());
+      optimizeBody(ifNode->getElseBody());
+    } else if (auto* forNode = dynamic_cast<ForNode*>(stmt.get())) {
+      optimizeBody(forNode->getBody());
+      optimizeLoop(forNode, optimized);
+    }
+    optimized.push_back(std::move(stmt));
+  }
+  body = std::move(optimized);
+}
+
+void LoopOptimizer::optimizeLoop(ForNode* loop, Body& preheader) {
+  std::unordered_set<std::string> bodyWrites;
+  for (const auto& stmt : loop->getBody()) {
+    collectWrites(stmt.get(), bodyWrites);
+  }
+  if (!bodyWrites.contains(loop->getIteratorName())) {
+    reduceStrength(loop, preheader);
+  }
+
+  // After strength reduction, whose variables the body advances.
+  Loop info;
+  for (const auto& stmt : loop->getBody()) {
+    collectWrites(stmt.get(), info.written);
+    info.calls |= containsCall(stmt.get());
+  }
+  info.written.insert(loop->getIteratorName());
+  info.calls |= containsCall(loop->getFinish()) || (loop->getStep() && containsCall(loop->getStep()));
+
+  // The header evaluates the finish on entry, right after the start, so it
+  // can move before the start when either of the two cannot fail.
+  if (!isTrivial(loop->getFinish()) && isInvariant(loop->getFinish(), info) &&
+      (isPure(loop->getFinish()) || isPure(loop->getStart()))) {
+    std::string limit = declareTemporary(loop->getFinish(), preheader);
+    loop->setFinish(new VariableRefAST(limit));
+  }
+  // The step is only evaluated after an iteration, so it has to be safe to
+  // evaluate early.
+  if (loop->getStep() && !isTrivial(loop->getStep()) && isInvariant(loop->getStep(), info) &&
+      isPure(loop->getStep())) {
+    std::string step = declareTemporary(loop->getStep(), preheader);
+    loop->setStep(new VariableRefAST(step));
+  }
+
+  std::unordered_map<std::string, std::string> hoisted;
+  auto hoist = [&](const ASTNode* expression) -> std::unique_ptr<ASTNode> {
+    if (isTrivial(expression) || !isPure(expression) || !isInvariant(expression, info)) {
+      return nullptr;
+    }
+    auto [it, inserted] = hoisted.try_emplace(key(expression));
+    if (inserted) {
+      it->second = declareTemporary(expression, preheader);
+    }
+    return std::make_unique<VariableRefAST>(it->second);
+  };
+  for (auto& stmt : loop->getBody()) {
+    rewriteExpressions(stmt.get(), hoist);
+  }
+
+  hoistFallible(loop, info, preheader);
+}
+
+// Only worth a variable when the product is computed on every iteration or
+// more than once per iteration, since the variable is advanced on every one.
+// The loop's range must be constant, so every value the variable takes is
+// known to fit into a slot.
+void LoopOptimizer::reduceStrength(ForNode* loop, Body& preheader) {
+  auto start = constantValue(loop->getStart());
+  auto finish = constantValue(loop->getFinish());
+  auto step = loop->getStep() ? constantValue(loop->getStep()) : std::optional<int64_t>(1);
+  if (!start || !finish || !step || *step <= 0) {
+    return;
+  }
+  const std::string& iterator = loop->getIteratorName();
+
+  std::map<int64_t, size_t> uses;
+  std::function<void(const ASTNode*, bool)> count = [&](const ASTNode* node, bool everyIteration) {
+    if (auto factor = iteratorFactor(node, iterator)) {
+      uses[*factor] += everyIteration ? 2 : 1;
+      return;
+    }
+    // Only the condition of an `if` and the header of a loop run every time.
+    bool nested = dynamic_cast<const IfNode*>(node) || dynamic_cast<const ForNode*>(node);
+    forEachChild(node, [&](const ASTNode* child) { count(child, everyIteration && !nested); });
+  };
+  for (const auto& stmt : loop->getBody()) {
+    count(stmt.get(), true);
+  }
+
+  // The iterator never leaves [start, finish + step), so no value of the
+  // variable is further from zero than bound * |factor|.
+  int64_t bound;
+  if (*start == INT64_MIN || *finish == INT64_MIN || __builtin_add_overflow(std::abs(*finish), *step, &bound)) {
+    return;
+  }
+  bound = std::max(std::abs(*start), bound);
+  std::unordered_map<int64_t, std::string> reduced;
+  for (const auto& [factor, weight] : uses) {
+    int64_t extreme;
+    if (weight < 2 || factor == INT64_MIN || __builtin_mul_overflow(bound, std::abs(factor), &extreme)) {
+      continue;
+    }
+    NumberAST first(*start * factor);
+    reduced[factor] = declareTemporary(&first, preheader);
+  }
+  if (reduced.empty()) {
+    return;
+  }
+
+  auto replace = [&](const ASTNode* expression) -> std::unique_ptr<ASTNode> {
+    auto factor = iteratorFactor(expression, iterator);
+    if (!factor || !reduced.contains(*factor)) {
+      return nullptr;
+    }
+    return std::make_unique<VariableRefAST>(reduced[*factor]);
+  };
+  for (auto& stmt : loop->getBody()) {
+    rewriteExpressions(stmt.get(), replace);
+  }
+  for (const auto& [factor, name] : reduced) {
+    auto* advanced = new ArithmeticOpNode(new VariableRefAST(name), ArithmeticOpNode::Operator::ADD,
+                                          new NumberAST(*step * factor));
+    loop->getBody().push_back(std::make_unique<AssignmentAST>(std::make_unique<VariableRefAST>(name),
+                                                              std::unique_ptr<ASTNode>(advanced)));
+  }
+}
+
+// Element reads, divisions and, with checked arithmetic, any arithmetic can
+// fail, so they only move when the first iteration is sure to evaluate them
+// before anything else could fail or print. They are evaluated behind the
+// loop's own entry check, re-evaluated from its start and finish, so a loop
+// that never runs evaluates nothing.
+void LoopOptimizer::hoistFallible(ForNode* loop, const Loop& info, Body& preheader) {
+  if (!isPure(loop->getStart()) || !isPure(loop->getFinish())) {
+    return;
+  }
+  std::function<bool(const ASTNode*)> isCandidate = [&](const ASTNode* node) {
+    if (isPure(node) || !isInvariant(node, info)) {
+      return false;
+    }
+    if (auto* arrayAccess = dynamic_cast<const ArrayAccessAST*>(node)) {
+      return isPureExcept(arrayAccess->getIndex(), isCandidate);
+    }
+    auto* arithmetic = dynamic_cast<const ArithmeticOpNode*>(node);
+    return arithmetic && isPureExcept(arithmetic->getLeft(), isCandidate) &&
+           isPureExcept(arithmetic->getRight(), isCandidate);
+  };
+
+  std::vector<const ASTNode*> fallible;
+  std::function<void(const ASTNode*)> collect = [&](const ASTNode* node) {
+    if (isCandidate(node)) {
+      fallible.push_back(node);
+      return;
+    }
+    forEachChild(node, collect);
+  };
+  for (const auto& stmt : loop->getBody()) {
+    const ASTNode* value = nullptr;
+    bool last = false;
+    if (auto* varDecl = dynamic_cast<const VariableDeclAST*>(stmt.get())) {
+      value = varDecl->getValue();
+    } else if (auto* assignment = dynamic_cast<const AssignmentAST*>(stmt.get());
+               assignment && dynamic_cast<const VariableRefAST*>(assignment->getLHS())) {
+      value = assignment->getRHS();
+    } else if (auto* print = dynamic_cast<const PrintAST*>(stmt.get())) {
+      value = print->getExpression();
+      last = true;
+    }
+    if (!value || !isPureExcept(value, isCandidate)) {
+      break;
+    }
+    collect(value);
+    if (last) {
+      break;
+    }
+  }
+  if (fallible.empty()) {
+    return;
+  }
+
+  // With constant bounds it is known whether the loop runs.
+  auto start = constantValue(loop->getStart());
+  auto finish = constantValue(loop->getFinish());
+  if (start && finish && *start >= *finish) {
+    return;
+  }
+
+  Body guarded;
+  std::unordered_map<std::string, std::string> hoisted;
+  for (const ASTNode* expression : fallible) {
+    auto [it, inserted] = hoisted.try_emplace(key(expression));
+    if (inserted) {
+      it->second = declareTemporary(expression, guarded);
+    }
+  }
+  auto replace = [&](const ASTNode* expression) -> std::unique_ptr<ASTNode> {
+    // Only invariant expressions can be spelled out by key().
+    if (!isInvariant(expression, info)) {
+      return nullptr;
+    }
+    auto it = hoisted.find(key(expression));
+    return it != hoisted.end() ? std::make_unique<VariableRefAST>(it->second) : nullptr;
+  };
+  for (auto& stmt : loop->getBody()) {
+    rewriteExpressions(stmt.get(), replace);
+  }
+
+  if (start && finish) {
+    std::move(guarded.begin(), guarded.end(), std::back_inserter(preheader));
+    return;
+  }
+  auto* entered = new CompareOpNode(clone(loop->getStart()).release(), CompareOpNode::Operator::LESS_THAN,
+                                    clone(loop->getFinish()).release());
+  preheader.push_back(std::make_unique<IfNode>(entered, std::move(guarded), Body()));
+}
+
+bool LoopOptimizer::isInvariant(const ASTNode* node, const Loop& loop) const {
+  auto unchanged = [&](const std::string& name) {
+    return !loop.written.contains(name) && (!loop.calls || (locals_ && locals_->contains(name)));
+  };
+  if (dynamic_cast<const NumberAST*>(node) || dynamic_cast<const BooleanAST*>(node)) {
+    return true;
+  }
+  if (auto* variable = dynamic_cast<const VariableRefAST*>(node)) {
+    return unchanged(variable->getName());
+  }
+  if (auto* arithmetic = dynamic_cast<const ArithmeticOpNode*>(node)) {
+    return isInvariant(arithmetic->getLeft(), loop) && isInvariant(arithmetic->getRight(), loop);
+  }
+  if (auto* compare = dynamic_cast<const CompareOpNode*>(node)) {
+    return isInvariant(compare->getLeft(), loop) && isInvariant(compare->getRight(), loop);
+  }
+  if (auto* arrayAccess = dynamic_cast<const ArrayAccessAST*>(node)) {
+    return unchanged(arrayAccess->getArrayName()) && isInvariant(arrayAccess->getIndex(), loop);
+  }
+  return false;
+}
+
+std::string LoopOptimizer::declareTemporary(const ASTNode* value, Body& body) {
+  // Not a valid identifier, so it cannot clash with a name in the program.
+  std::string name = "loop." + std::to_string(temporaries_++);
+  body.push_back(std::make_unique<VariableDeclAST>("int", name, clone(value)));
+  return name;
+}
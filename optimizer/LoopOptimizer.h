@@ -0,0 +1,56 @@
+#ifndef LOOP_OPTIMIZER_H
+#define LOOP_OPTIMIZER_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "ASTNode.h"
+
+class ForNode;
+
+// Moves work out of `for` loops, innermost loops first. Values it computes
+// ahead of the loop go into fresh variables declared right before it, the
+// loop's preheader:
+//  - a finish or step expression that does not change while the loop runs is
+//    evaluated once instead of on every iteration,
+//  - invariant arithmetic in the body that cannot fail is evaluated once
+//    before the loop,
+//  - an invariant expression that can fail, such as `a[k]` or `x / d`, in
+//    the first statements of the body is evaluated once, behind a check that
+//    the loop runs at all,
+//  - `i * c` on the iterator becomes a variable that the body advances by
+//    `step * c`.
+// Only expressions that cannot fail and have no effect are evaluated ahead
+// of where they were, so the program fails and prints exactly as before.
+class LoopOptimizer {
+ public:
+  static void optimize(std::vector<std::unique_ptr<ASTNode>>& ast);
+
+ private:
+  using Body = std::vector<std::unique_ptr<ASTNode>>;
+
+  // What running one loop can change.
+  struct Loop {
+    std::unordered_set<std::string> written;
+    bool calls = false;
+  };
+
+  void optimizeBody(Body& body);
+  void optimizeLoop(ForNode* loop, Body& preheader);
+  void reduceStrength(ForNode* loop, Body& preheader);
+  void hoistFallible(ForNode* loop, const Loop& info, Body& preheader);
+
+  [[nodiscard]] bool isInvariant(const ASTNode* node, const Loop& loop) const;
+  // Declares a fresh variable holding the expression at the end of `body`.
+  std::string declareTemporary(const ASTNode* value, Body& body);
+
+  // Parameters and variables of the function being optimized, which a call
+  // cannot change. Null at the top level, where every variable is a global.
+  const std::unordered_set<std::string>* locals_ = nullptr;
+  size_t temporaries_ = 0;
+};
+
+#endif // LOOP_OPTIMIZER_H
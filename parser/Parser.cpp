@@ -258,6 +258,7 @@ ASTNode* Parser::parseArrayDeclaration() {
       int size_r = parseValue(elementType);
       expect(TokenType::RParen);
       expect(TokenType::Semicolon);
+      usesRandom_ = true;
       return new ArrayDeclAST(elementType, arrayName, size_r, generateRandomVector(size_r));
     }
     auto elements = parseArrayElements(elementType);
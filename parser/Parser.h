@@ -16,9 +16,14 @@ class Parser {
 
   std::vector<std::unique_ptr<ASTNode>> parse();
 
+  // Whether an array was filled by random(n). Its elements are drawn while
+  // parsing, so the program differs from run to run.
+  [[nodiscard]] bool usesRandom() const { return usesRandom_; }
+
  private:
   Lexer lexer;
   Token currentToken;
+  bool usesRandom_ = false;
 
   void consumeToken();
 
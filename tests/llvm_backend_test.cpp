@@ -0,0 +1,210 @@
+// Runs programs through the LLVM backend, which matur_pl does not use, and
+// checks what they compute and the code generateModuleIR emits for them.
+//
+//   llvm_backend_test <case>
+//
+// generateModuleIR prints each module and writes it to output_*.ll in the
+// working directory.
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Verifier.h>
+#include "IRGeneratorV2.h"
+#include "JITExecutor.h"
+#include "MemoRuntime.h"
+#include "Parser.h"
+
+namespace {
+
+// What a program's main returned and printed, or that it trapped.
+struct Run {
+  int64_t result = 0;
+  std::string output;
+  bool trapped = false;
+};
+
+bool failed = false;
+
+void expect(bool condition, const std::string& what) {
+  if (!condition) {
+    std::cerr << "FAILED: " << what << "\n";
+    failed = true;
+  }
+}
+
+std::unique_ptr<llvm::Module> compile(const std::string& code, llvm::LLVMContext& context, bool withOpt,
+                                      bool memoize) {
+  Parser parser(code);
+  auto ast = parser.parse();
+  auto module = generateModuleIR(ast, context, withOpt, memoize);
+  expect(!llvm::verifyModule(*module, &llvm::errs()), "the module verifies");
+  return module;
+}
+
+// Calls to `callee` in the function `caller`, up to the block named `stop`
+// if given. Blocks are laid out in the order they were generated.
+int countCalls(const llvm::Module& module, const std::string& caller, const std::string& callee,
+               const std::string& stop = "") {
+  int calls = 0;
+  for (const auto& block : *module.getFunction(caller)) {
+    if (!stop.empty() && block.getName() == stop) {
+      break;
+    }
+    for (const auto& instruction : block) {
+      auto* call = llvm::dyn_cast<llvm::CallInst>(&instruction);
+      if (call && call->getCalledFunction() && call->getCalledFunction()->getName() == callee) {
+        ++calls;
+      }
+    }
+  }
+  return calls;
+}
+
+// Runs main in a child process, so that a trap ends the child and not the
+// test. Its output is unbuffered, so whatever it printed before a trap
+// still arrives.
+Run runInChild(std::unique_ptr<llvm::Module>& module) {
+  int output[2];
+  int result[2];
+  if (pipe(output) != 0 || pipe(result) != 0) {
+    throw std::runtime_error("pipe failed");
+  }
+  std::fflush(stdout);
+  pid_t child = fork();
+  if (child == 0) {
+    dup2(output[1], STDOUT_FILENO);
+    close(output[0]);
+    close(result[0]);
+    std::setvbuf(stdout, nullptr, _IONBF, 0);
+    auto value = static_cast<int64_t>(executeIR(module));
+    ssize_t written = write(result[1], &value, sizeof(value));
+    _exit(written == sizeof(value) ? 0 : 1);
+  }
+  close(output[1]);
+  close(result[1]);
+
+  Run run;
+  char buffer[256];
+  ssize_t count;
+  while ((count = read(output[0], buffer, sizeof(buffer))) > 0) {
+    run.output.append(buffer, count);
+  }
+  run.trapped = read(result[0], &run.result, sizeof(run.result)) != sizeof(run.result);
+  close(output[0]);
+  close(result[0]);
+  int status;
+  waitpid(child, &status, 0);
+  run.trapped |= !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+  return run;
+}
+
+// Sums a[0] to a[n - 1] of a ten-element array, printing each index first.
+std::string sumProgram(int n) {
+  return "def main() {\n"
+         "  array<int> a(10) = [1, 2, 3, 4, 5, 6, 7, 8, 9, 10];\n"
+         "  int n = " + std::to_string(n) + ";\n"
+         "  int s = 0;\n"
+         "  for i in <0, n> {\n"
+         "    print(i);\n"
+         "    s = s + a[i];\n"
+         "  };\n"
+         "  return s;\n"
+         "};\n"
+         "jawohl\n";
+}
+
+// The loop checks its range against the array once, before the first
+// iteration, instead of checking a[i] on every one. Without LLVM's passes,
+// which would fold the constant n, the check is still there at run time.
+void hoistedBoundsCheck() {
+  llvm::LLVMContext context;
+  auto inRange = compile(sumProgram(10), context, false, false);
+  expect(countCalls(*inRange, "main", "llvm.trap") == 1, "main has a single bounds check");
+  expect(countCalls(*inRange, "main", "llvm.trap", "loop") == 1, "the bounds check comes before the loop");
+  Run run = runInChild(inRange);
+  expect(!run.trapped && run.result == 55, "the sum of a[0] to a[9] is 55, got " + std::to_string(run.result));
+  expect(run.output == "0\n1\n2\n3\n4\n5\n6\n7\n8\n9\n", "every index is printed, got:\n" + run.output);
+
+  auto outOfRange = compile(sumProgram(11), context, false, false);
+  run = runInChild(outOfRange);
+  expect(run.trapped, "a[10] traps");
+  expect(run.output.empty(), "the trap comes before the loop, got:\n" + run.output);
+
+  auto empty = compile(sumProgram(0), context, false, false);
+  run = runInChild(empty);
+  expect(!run.trapped && run.result == 0 && run.output.empty(), "a loop that never runs checks nothing");
+}
+
+// With optimization, a pure call whose arguments are constants becomes its
+// result, computed by CallEvaluator. A call with a variable argument stays.
+void foldedCalls() {
+  const std::string code = "def square(x) {\n"
+                           "  return x * x;\n"
+                           "};\n"
+                           "def main() {\n"
+                           "  int n = 13;\n"
+                           "  return square(12) + square(n);\n"
+                           "};\n"
+                           "jawohl\n";
+  llvm::LLVMContext context;
+  auto plain = compile(code, context, false, false);
+  expect(countCalls(*plain, "main", "square") == 2, "both calls are made without optimization");
+  auto folded = compile(code, context, true, false);
+  expect(countCalls(*folded, "main", "square") == 1, "square(12) is folded");
+  Run run = runInChild(folded);
+  expect(!run.trapped && run.result == 313, "144 + 169 is 313, got " + std::to_string(run.result));
+}
+
+// With memoize, every call of fib looks its argument up in fib's memo table
+// first, so fib(25) computes each fib(k) once.
+void memoizedCalls() {
+  const std::string code = "def fib(n) {\n"
+                           "  if (n < 2) {\n"
+                           "    return n;\n"
+                           "  };\n"
+                           "  return fib(n - 1) + fib(n - 2);\n"
+                           "};\n"
+                           "def main() {\n"
+                           "  return fib(25);\n"
+                           "};\n"
+                           "jawohl\n";
+  llvm::LLVMContext context;
+  auto module = compile(code, context, false, true);
+  expect(countCalls(*module, "fib", MemoRuntime::kLookup) == 2, "both calls in fib are looked up");
+  expect(countCalls(*module, "fib", MemoRuntime::kStore) == 2, "both calls in fib are stored");
+  // The tables live in this process, so the program runs here.
+  auto result = static_cast<int64_t>(executeIR(module));
+  expect(result == 75025, "fib(25) is 75025, got " + std::to_string(result));
+
+  std::ostringstream stats;
+  MemoRuntime::printStats(stats);
+  expect(stats.str() == "Memo statistics:\n  fib: 23 hits, 26 misses (46.9% hit rate), 26 entries\n",
+         "fib(0) to fib(25) miss once each, and fib(k - 2) hits from fib(3) on, got:\n" + stats.str());
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const std::map<std::string, std::function<void()>> cases = {
+      {"hoisted_bounds_check", hoistedBoundsCheck},
+      {"folded_calls", foldedCalls},
+      {"memoized_calls", memoizedCalls},
+  };
+  auto selected = argc == 2 ? cases.find(argv[1]) : cases.end();
+  if (selected == cases.end()) {
+    std::cerr << "Usage: llvm_backend_test <case>\n";
+    return 2;
+  }
+  selected->second();
+  return failed ? 1 : 0;
+}
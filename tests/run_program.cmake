@@ -0,0 +1,59 @@
+# Runs one program under matur_pl and compares what it prints with its
+# golden output, GOLDEN.
+#
+#   cmake -DMATUR_PL=<interpreter> -DPROGRAM=<name.mpl> -DGOLDEN=<name.out>
+#         -DWORK_DIR=<dir> -DFLAGS=<interpreter flags> [-DEXPECT_ERROR=<regex>]
+#         [-DDIFFERS_BETWEEN_RUNS=ON] -P run_program.cmake
+#
+# The interpreter writes its disassembly and bytecode cache next to the
+# script, so the program is copied to a fresh WORK_DIR. It runs twice: the
+# second run starts from the cache the first one wrote. The execution time
+# and the --memoize statistics are left out of the comparison. Standard error
+# must be empty, which also fails a program the verifier rejects, unless it
+# matches EXPECT_ERROR. With DIFFERS_BETWEEN_RUNS the two runs must print
+# different output and leave no cache behind, as for random(n) arrays.
+
+get_filename_component(name "${PROGRAM}" NAME)
+file(REMOVE_RECURSE "${WORK_DIR}")
+file(MAKE_DIRECTORY "${WORK_DIR}")
+file(COPY "${PROGRAM}" DESTINATION "${WORK_DIR}")
+separate_arguments(flags UNIX_COMMAND "${FLAGS}")
+
+function(run_program run)
+  execute_process(COMMAND "${MATUR_PL}" ${flags} "${WORK_DIR}/${name}"
+                  OUTPUT_VARIABLE output
+                  ERROR_VARIABLE errors
+                  RESULT_VARIABLE status)
+  string(REGEX REPLACE "Execution time: [^\n]*\n" "" output "${output}")
+  string(REGEX REPLACE "Memo statistics:\n(  [^\n]*\n)*" "" errors "${errors}")
+
+  if (EXPECT_ERROR)
+    if (NOT errors MATCHES "${EXPECT_ERROR}")
+      message(FATAL_ERROR "run ${run}: expected an error matching '${EXPECT_ERROR}', got:\n${errors}")
+    endif ()
+  elseif (NOT status EQUAL 0 OR NOT errors STREQUAL "")
+    message(FATAL_ERROR "run ${run}: exited with ${status}:\n${errors}")
+  endif ()
+  set(output_${run} "${output}" PARENT_SCOPE)
+endfunction()
+
+run_program(1)
+run_program(2)
+
+if (DIFFERS_BETWEEN_RUNS)
+  if (output_1 STREQUAL output_2)
+    message(FATAL_ERROR "both runs printed:\n${output_1}")
+  endif ()
+  file(GLOB cached "${WORK_DIR}/*.mplc")
+  if (cached)
+    message(FATAL_ERROR "the program was cached: ${cached}")
+  endif ()
+  return()
+endif ()
+
+file(READ "${GOLDEN}" expected)
+foreach (run 1 2)
+  if (NOT output_${run} STREQUAL expected)
+    message(FATAL_ERROR "run ${run} printed:\n${output_${run}}\nexpected:\n${expected}")
+  endif ()
+endforeach ()
@@ -1,35 +1,97 @@
 #include "ASTToBytecodeConverter.h"
+#include <cstring>
 #include <fstream>
+#include "ArrayAST.h"
+#include "ForNode.h"
+#include "FunctionAST.h"
+#include "IfNode.h"
+#include "PeepholeOptimizer.h"
+#include "VariableAST.h"
+#include "../optimizer/ASTQueries.h"
 
-std::vector<std::tuple<std::string, std::vector<int64_t>>>
-ASTToBytecodeConverter::generateBytecode(const std::vector<std::unique_ptr<ASTNode>>& ast, char* src_filename) {
-  std::vector<std::tuple<std::string, std::vector<int64_t>>> bytecode;
-
-  size_t currentOffset = 0;
+Bytecode
+ASTToBytecodeConverter::generateBytecode(const std::vector<std::unique_ptr<ASTNode>>& ast, char* src_filename, bool optimize,
+                                         bool memoize) {
+  SlotResolver slots;
+  for (const auto& node : ast) {
+    declareSlots(node.get(), slots);
+  }
+  if (memoize) {
+    memoizePureFunctions(ast, slots);
+  }
 
+  BytecodeEmitter emitter;
+  emitter.emit(OpCode::RESERVE_SLOTS, {static_cast<int64_t>(slots.slotCount())});
   for (const auto& node : ast) {
-    auto nodeBytecode = node->generateBytecode(currentOffset);
-    currentOffset += nodeBytecode.size();
-    bytecode.insert(bytecode.end(), nodeBytecode.begin(), nodeBytecode.end());
+    node->generateStatement(emitter, slots);
   }
+  emitter.emit(OpCode::HALT);
+  Bytecode bytecode = emitter.take();
+  size_t removed = optimize ? PeepholeOptimizer::optimize(bytecode) : 0;
 
   size_t filenameLength = std::strlen(src_filename);
 
-  size_t newFilenameLength = filenameLength + 1;
+  size_t newFilenameLength = filenameLength + 5;
   char* outputFilename = new char[newFilenameLength];
   std::strncpy(outputFilename, src_filename, filenameLength - 4);
   std::strcpy(outputFilename + filenameLength - 4, ".bytempl");
 
   std::ofstream bytecode_file(outputFilename);
-
-  for (const auto& [instruction, operands] : bytecode) {
-    bytecode_file << instruction << " ";
-    for (const auto& operand : operands) {
-      bytecode_file << operand << " ";
-    }
-    bytecode_file << std::endl;
+  if (optimize) {
+    bytecode_file << "; peephole: removed " << removed << " instructions\n";
   }
+  disassemble(bytecode, bytecode_file);
 
   delete[] outputFilename;
   return bytecode;
-};
\ No newline at end of file
+}
+
+// Declares names in the order the statements and expressions mention them.
+// An inlined call's parameters and locals belong to the enclosing frame.
+void ASTToBytecodeConverter::declareSlots(const ASTNode* node, SlotResolver& slots) {
+  if (auto* funcDecl = dynamic_cast<const FunctionDeclNode*>(node)) {
+    SlotResolver& frame = slots.declareFunction(funcDecl->getFunctionName(), funcDecl->getParameters().size());
+    for (const auto& parameter : funcDecl->getParameters()) {
+      frame.declare(parameter);
+    }
+    for (const auto& stmt : funcDecl->getBody()) {
+      declareSlots(stmt.get(), frame);
+    }
+    return;
+  }
+
+  if (auto* varDecl = dynamic_cast<const VariableDeclAST*>(node)) {
+    slots.declare(varDecl->getName());
+  } else if (auto* arrayDecl = dynamic_cast<const ArrayDeclAST*>(node)) {
+    slots.declare(arrayDecl->getName());
+  } else if (auto* forNode = dynamic_cast<const ForNode*>(node)) {
+    slots.declare(forNode->getIteratorName());
+  } else if (auto* inlined = dynamic_cast<const InlinedCallNode*>(node)) {
+    for (const auto& parameter : inlined->getParameters()) {
+      slots.declare(parameter);
+    }
+  }
+  forEachChild(node, [&](const ASTNode* child) { declareSlots(child, slots); });
+}
+
+// The VM keys a memoized function's results by its arguments alone, which
+// is sound only for functions nothing else can change the result of.
+void ASTToBytecodeConverter::memoizePureFunctions(const std::vector<std::unique_ptr<ASTNode>>& ast,
+                                                  SlotResolver& slots) {
+  for (const std::string& name : pureFunctions(ast)) {
+    slots.memoize(name);
+  }
+}
+
+void ASTToBytecodeConverter::disassemble(const Bytecode& bytecode, std::ostream& out) {
+  size_t pc = 0;
+  while (pc < bytecode.size()) {
+    size_t length = instructionLength(&bytecode[pc]);
+    out << pc << ": " << opcodeName(static_cast<OpCode>(bytecode[pc])) << " ";
+    for (size_t i = 1; i < length; ++i) {
+      out << bytecode[pc + i] << " ";
+    }
+    out << "\n";
+    pc += length;
+  }
+}
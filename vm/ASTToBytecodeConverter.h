@@ -2,15 +2,24 @@
 #define AST_TO_BYTECODE_CONVERTER_H
 
 #include "ASTNode.h"
+#include <ostream>
 #include <vector>
-#include <tuple>
 #include <memory>
 #include <string>
 
 class ASTToBytecodeConverter {
  public:
-  static std::vector<std::tuple<std::string, std::vector<int64_t>>>
-  generateBytecode(const std::vector<std::unique_ptr<ASTNode>>& ast, char* src_filename);
+  // With `optimize`, the generated code goes through the PeepholeOptimizer
+  // before it is written out and returned. With `memoize`, calls of pure
+  // functions (see pureFunctions) cache their results at runtime.
+  static Bytecode
+  generateBytecode(const std::vector<std::unique_ptr<ASTNode>>& ast, char* src_filename, bool optimize,
+                   bool memoize);
+
+  static void disassemble(const Bytecode& bytecode, std::ostream& out);
+
+  static void declareSlots(const ASTNode* node, SlotResolver& slots);
+  static void memoizePureFunctions(const std::vector<std::unique_ptr<ASTNode>>& ast, SlotResolver& slots);
 };
 
-#endif // AST_TO_BYTECODE_CONVERTER_H
\ No newline at end of file
+#endif // AST_TO_BYTECODE_CONVERTER_H
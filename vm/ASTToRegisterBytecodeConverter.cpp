@@ -0,0 +1,438 @@
+#include "ASTToRegisterBytecodeConverter.h"
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include "ASTToBytecodeConverter.h"
+#include "ArithmeticOpNode.h"
+#include "ArrayAST.h"
+#include "AssigmentAST.h"
+#include "BooleanAST.h"
+#include "CompareOpNode.h"
+#include "ForNode.h"
+#include "FunctionAST.h"
+#include "IfNode.h"
+#include "NumberAST.h"
+#include "PrintAST.h"
+#include "VariableAST.h"
+
+RegisterBytecode
+ASTToRegisterBytecodeConverter::generateBytecode(const std::vector<std::unique_ptr<ASTNode>>& ast,
+                                                 char* src_filename, bool memoize) {
+  SlotResolver slots;
+  for (const auto& node : ast) {
+    ASTToBytecodeConverter::declareSlots(node.get(), slots);
+  }
+  if (memoize) {
+    ASTToBytecodeConverter::memoizePureFunctions(ast, slots);
+  }
+
+  ASTToRegisterBytecodeConverter converter(slots);
+  RegisterBytecode& bytecode = converter.bytecode_;
+
+  emit(bytecode, RegOp::RESERVE_SLOTS, {0});
+  converter.compileBody(ast);
+  emit(bytecode, RegOp::HALT);
+  bytecode[1] = converter.frameSize_;
+
+  // Function bodies are laid out after the top-level HALT.
+  for (size_t i = 0; i < converter.functions_.size(); ++i) {
+    converter.compileFunction(converter.functions_[i]);
+  }
+
+  for (const CallSite& call : converter.callSites_) {
+    const FunctionEntry& function = converter.entries_[call.functionId];
+    bytecode[call.pc + 2] = function.entry;
+    bytecode[call.pc + 3] = function.frameSize;
+  }
+
+  std::string outputFilename(src_filename);
+  outputFilename = outputFilename.substr(0, outputFilename.size() - 4) + ".reg.bytempl";
+  std::ofstream bytecode_file(outputFilename);
+  disassemble(bytecode, bytecode_file);
+
+  return std::move(converter.bytecode_);
+}
+
+ASTToRegisterBytecodeConverter::ASTToRegisterBytecodeConverter(const SlotResolver& globals)
+    : globals_(globals), slots_(&globals),
+      nextTemp_(static_cast<int64_t>(globals.slotCount())),
+      frameSize_(static_cast<int64_t>(globals.slotCount())) {}
+
+void ASTToRegisterBytecodeConverter::compileFunction(const FunctionDeclNode* function) {
+  const SlotResolver::Function& declared = globals_.function(function->getFunctionName());
+  slots_ = declared.frame.get();
+  nextTemp_ = frameSize_ = static_cast<int64_t>(slots_->slotCount());
+
+  auto entry = static_cast<int64_t>(bytecode_.size());
+  compileBody(function->getBody());
+  emit(bytecode_, RegOp::RETURN_VOID);
+
+  if (static_cast<size_t>(declared.id) >= entries_.size()) {
+    entries_.resize(declared.id + 1);
+  }
+  entries_[declared.id] = {entry, frameSize_};
+}
+
+void ASTToRegisterBytecodeConverter::compileBody(const std::vector<std::unique_ptr<ASTNode>>& body) {
+  for (const auto& stmt : body) {
+    compileStatement(stmt.get());
+  }
+}
+
+void ASTToRegisterBytecodeConverter::compileStatement(const ASTNode* node) {
+  int64_t mark = nextTemp_;
+
+  if (auto* varDecl = dynamic_cast<const VariableDeclAST*>(node)) {
+    compileExpression(varDecl->getValue(), slots_->slotOf(varDecl->getName()).index);
+  } else if (auto* arrayDecl = dynamic_cast<const ArrayDeclAST*>(node)) {
+    int64_t size = arrayDecl->getSize();
+    const std::vector<int64_t>& elements = arrayDecl->getElements();
+    emit(bytecode_, RegOp::DECLARE_ARRAY, {slots_->slotOf(arrayDecl->getName()).index, size});
+    for (int64_t i = 0; i < size; ++i) {
+      bytecode_.push_back(i < static_cast<int64_t>(elements.size()) ? elements[i] : 0);
+    }
+  } else if (auto* assignment = dynamic_cast<const AssignmentAST*>(node)) {
+    if (auto* arrayAccess = dynamic_cast<const ArrayAccessAST*>(assignment->getLHS())) {
+      int64_t index = keepValue(compileExpression(arrayAccess->getIndex()), assignment->getRHS());
+      int64_t value = compileExpression(assignment->getRHS());
+      auto slot = slots_->slotOf(arrayAccess->getArrayName());
+      RegOp op = arrayAccess->isInBounds()
+          ? (slot.global ? RegOp::STORE_GLOBAL_ELEMENT_UNCHECKED : RegOp::STORE_ELEMENT_UNCHECKED)
+          : (slot.global ? RegOp::STORE_GLOBAL_ELEMENT : RegOp::STORE_ELEMENT);
+      emit(bytecode_, op, {slot.index, index, value});
+    } else if (auto* variable = dynamic_cast<const VariableRefAST*>(assignment->getLHS())) {
+      auto slot = slots_->slotOf(variable->getName());
+      if (slot.global) {
+        emit(bytecode_, RegOp::STORE_GLOBAL, {slot.index, compileExpression(assignment->getRHS())});
+      } else {
+        compileExpression(assignment->getRHS(), slot.index);
+      }
+    } else {
+      std::cerr << "Unsupported LHS type in AssignmentAST\n";
+    }
+  } else if (auto* print = dynamic_cast<const PrintAST*>(node)) {
+    emit(bytecode_, RegOp::PRINT, {compileExpression(print->getExpression())});
+  } else if (auto* ifNode = dynamic_cast<const IfNode*>(node)) {
+    if (auto* compare = dynamic_cast<const CompareOpNode*>(ifNode->getCondition())) {
+      int64_t lhs = keepValue(compileExpression(compare->getLeft()), compare->getRight());
+      int64_t rhs = compileExpression(compare->getRight());
+      RegOp op = RegOp::JUMP_IF_NOT_EQUALS;
+      switch (compare->getOperator()) {
+        case CompareOpNode::Operator::LESS_THAN: op = RegOp::JUMP_IF_NOT_LESS_THAN;
+          break;
+        case CompareOpNode::Operator::GREATER_THAN: op = RegOp::JUMP_IF_NOT_GREATER_THAN;
+          break;
+        case CompareOpNode::Operator::LESS_THAN_OR_EQUAL: op = RegOp::JUMP_IF_NOT_LESS_THAN_OR_EQUAL;
+          break;
+        case CompareOpNode::Operator::GREATER_THAN_OR_EQUAL: op = RegOp::JUMP_IF_NOT_GREATER_THAN_OR_EQUAL;
+          break;
+        case CompareOpNode::Operator::EQUALS: op = RegOp::JUMP_IF_NOT_EQUALS;
+          break;
+      }
+      emit(bytecode_, op, {lhs, rhs, 0});
+    } else {
+      emit(bytecode_, RegOp::JUMP_IF_FALSE, {compileExpression(ifNode->getCondition()), 0});
+    }
+    size_t jumpIfFalseIndex = bytecode_.size() - 1;
+    nextTemp_ = mark;
+
+    compileBody(ifNode->getThenBody());
+    if (ifNode->getElseBody().empty()) {
+      patchJump(jumpIfFalseIndex);
+    } else {
+      emit(bytecode_, RegOp::JUMP, {0});
+      size_t jumpIndex = bytecode_.size() - 1;
+      patchJump(jumpIfFalseIndex);
+      compileBody(ifNode->getElseBody());
+      patchJump(jumpIndex);
+    }
+  } else if (auto* forNode = dynamic_cast<const ForNode*>(node)) {
+    int64_t iterator = slots_->slotOf(forNode->getIteratorName()).index;
+    compileExpression(forNode->getStart(), iterator);
+
+    auto loopStart = static_cast<int64_t>(bytecode_.size());
+    emit(bytecode_, RegOp::JUMP_IF_NOT_LESS_THAN, {iterator, compileExpression(forNode->getFinish()), 0});
+    size_t jumpToEndIndex = bytecode_.size() - 1;
+    nextTemp_ = mark;
+
+    auto bodyStart = static_cast<int64_t>(bytecode_.size());
+    compileBody(forNode->getBody());
+
+    auto* constStep = forNode->getStep() ? dynamic_cast<const NumberAST*>(forNode->getStep()) : nullptr;
+    auto* constFinish = dynamic_cast<const NumberAST*>(forNode->getFinish());
+    int64_t stepValue = constStep ? constStep->getValue() : 1;
+
+    if ((constStep || !forNode->getStep()) && constFinish) {
+      emit(bytecode_, RegOp::FOR_LOOP, {iterator, stepValue, constFinish->getValue(), bodyStart});
+    } else {
+      if (constStep || !forNode->getStep()) {
+        emit(bytecode_, RegOp::ADD_CONST, {iterator, iterator, stepValue});
+      } else {
+        emit(bytecode_, RegOp::ADD, {iterator, iterator, compileExpression(forNode->getStep())});
+      }
+      emit(bytecode_, RegOp::JUMP, {loopStart});
+    }
+    patchJump(jumpToEndIndex);
+  } else if (auto* returnNode = dynamic_cast<const ReturnNode*>(node)) {
+    if (inlinedReturns_.empty()) {
+      emit(bytecode_, RegOp::RETURN, {compileExpression(returnNode->getExpression())});
+    } else {
+      compileExpression(returnNode->getExpression(), inlinedReturns_.back().result);
+      emit(bytecode_, RegOp::JUMP, {0});
+      inlinedReturns_.back().jumps.push_back(bytecode_.size() - 1);
+    }
+  } else if (auto* funcDecl = dynamic_cast<const FunctionDeclNode*>(node)) {
+    functions_.push_back(funcDecl);
+  } else {
+    // Expression statement, e.g. a call whose result is not used.
+    compileExpression(node);
+  }
+
+  nextTemp_ = mark;
+}
+
+int64_t ASTToRegisterBytecodeConverter::compileExpression(const ASTNode* node, int64_t target) {
+  if (auto* number = dynamic_cast<const NumberAST*>(node)) {
+    int64_t dst = resultRegister(target);
+    emit(bytecode_, RegOp::LOAD_CONST, {dst, number->getValue()});
+    return dst;
+  }
+
+  if (auto* boolean = dynamic_cast<const BooleanAST*>(node)) {
+    int64_t dst = resultRegister(target);
+    emit(bytecode_, RegOp::LOAD_CONST, {dst, boolean->getValue()});
+    return dst;
+  }
+
+  if (auto* variable = dynamic_cast<const VariableRefAST*>(node)) {
+    auto slot = slots_->slotOf(variable->getName());
+    if (slot.global) {
+      int64_t dst = resultRegister(target);
+      emit(bytecode_, RegOp::LOAD_GLOBAL, {dst, slot.index});
+      return dst;
+    }
+    if (target >= 0 && target != slot.index) {
+      emit(bytecode_, RegOp::MOVE, {target, slot.index});
+      return target;
+    }
+    return slot.index;
+  }
+
+  int64_t mark = nextTemp_;
+
+  if (auto* arithmetic = dynamic_cast<const ArithmeticOpNode*>(node)) {
+    using Operator = ArithmeticOpNode::Operator;
+    const ASTNode* left = arithmetic->getLeft();
+    const ASTNode* right = arithmetic->getRight();
+
+    // `e + c`, `c + e` and `e - c` add an inline constant.
+    const ASTNode* operand = nullptr;
+    int64_t constant = 0;
+    auto* rightNumber = dynamic_cast<const NumberAST*>(right);
+    auto* leftNumber = dynamic_cast<const NumberAST*>(left);
+    if (arithmetic->getOperator() == Operator::ADD && rightNumber) {
+      operand = left;
+      constant = rightNumber->getValue();
+    } else if (arithmetic->getOperator() == Operator::ADD && leftNumber) {
+      operand = right;
+      constant = leftNumber->getValue();
+    } else if (arithmetic->getOperator() == Operator::SUBTRACT && rightNumber &&
+        rightNumber->getValue() != std::numeric_limits<int64_t>::min()) {
+      operand = left;
+      constant = -rightNumber->getValue();
+    }
+    if (operand) {
+      int64_t src = compileExpression(operand);
+      nextTemp_ = mark;
+      int64_t dst = resultRegister(target);
+      emit(bytecode_, RegOp::ADD_CONST, {dst, src, constant});
+      return dst;
+    }
+
+    // `e / 2^k` and `e % 2^k` shift instead of dividing.
+    int64_t shift = rightNumber ? powerOfTwoShift(rightNumber->getValue()) : 0;
+    if (shift && (arithmetic->getOperator() == Operator::DIVIDE || arithmetic->getOperator() == Operator::MODULO)) {
+      int64_t src = compileExpression(left);
+      nextTemp_ = mark;
+      int64_t dst = resultRegister(target);
+      RegOp op = arithmetic->getOperator() == Operator::DIVIDE ? RegOp::DIVIDE_POW2 : RegOp::MODULO_POW2;
+      emit(bytecode_, op, {dst, src, shift});
+      return dst;
+    }
+
+    int64_t lhs = keepValue(compileExpression(left), right);
+    int64_t rhs = compileExpression(right);
+    nextTemp_ = mark;
+    int64_t dst = resultRegister(target);
+    RegOp op = RegOp::ADD;
+    switch (arithmetic->getOperator()) {
+      case Operator::ADD: op = RegOp::ADD;
+        break;
+      case Operator::SUBTRACT: op = RegOp::SUBTRACT;
+        break;
+      case Operator::MULTIPLY: op = RegOp::MULTIPLY;
+        break;
+      case Operator::DIVIDE: op = RegOp::DIVIDE;
+        break;
+      case Operator::MODULO: op = RegOp::MODULO;
+        break;
+    }
+    emit(bytecode_, op, {dst, lhs, rhs});
+    return dst;
+  }
+
+  if (auto* compare = dynamic_cast<const CompareOpNode*>(node)) {
+    using Operator = CompareOpNode::Operator;
+    int64_t lhs = keepValue(compileExpression(compare->getLeft()), compare->getRight());
+    int64_t rhs = compileExpression(compare->getRight());
+    nextTemp_ = mark;
+    int64_t dst = resultRegister(target);
+    RegOp op = RegOp::EQUALS;
+    switch (compare->getOperator()) {
+      case Operator::LESS_THAN: op = RegOp::LESS_THAN;
+        break;
+      case Operator::GREATER_THAN: op = RegOp::GREATER_THAN;
+        break;
+      case Operator::LESS_THAN_OR_EQUAL: op = RegOp::LESS_THAN_OR_EQUAL;
+        break;
+      case Operator::GREATER_THAN_OR_EQUAL: op = RegOp::GREATER_THAN_OR_EQUAL;
+        break;
+      case Operator::EQUALS: op = RegOp::EQUALS;
+        break;
+    }
+    emit(bytecode_, op, {dst, lhs, rhs});
+    return dst;
+  }
+
+  if (auto* arrayAccess = dynamic_cast<const ArrayAccessAST*>(node)) {
+    int64_t index = compileExpression(arrayAccess->getIndex());
+    nextTemp_ = mark;
+    int64_t dst = resultRegister(target);
+    auto slot = slots_->slotOf(arrayAccess->getArrayName());
+    RegOp op = arrayAccess->isInBounds()
+        ? (slot.global ? RegOp::LOAD_GLOBAL_ELEMENT_UNCHECKED : RegOp::LOAD_ELEMENT_UNCHECKED)
+        : (slot.global ? RegOp::LOAD_GLOBAL_ELEMENT : RegOp::LOAD_ELEMENT);
+    emit(bytecode_, op, {dst, slot.index, index});
+    return dst;
+  }
+
+  if (dynamic_cast<const FunctionCallNode*>(node)) {
+    return compileCall(node, target);
+  }
+
+  if (auto* inlined = dynamic_cast<const InlinedCallNode*>(node)) {
+    return compileInlinedCall(inlined, target);
+  }
+
+  throw std::runtime_error("Unsupported expression in register bytecode");
+}
+
+int64_t ASTToRegisterBytecodeConverter::compileCall(const ASTNode* node, int64_t target) {
+  auto* call = static_cast<const FunctionCallNode*>(node);
+  const SlotResolver::Function& function = slots_->function(call->getFunctionName());
+  auto argumentCount = static_cast<int64_t>(call->getArguments().size());
+  if (argumentCount != function.arity) {
+    throw std::runtime_error("Function " + call->getFunctionName() + " expects " + std::to_string(function.arity) +
+        " arguments, got " + std::to_string(argumentCount));
+  }
+
+  // Arguments are evaluated into consecutive temporaries; CALL moves them
+  // into the parameter slots of the new frame.
+  int64_t mark = nextTemp_;
+  int64_t firstArgument = nextTemp_;
+  for (int64_t i = 0; i < argumentCount; ++i) {
+    allocateTemp();
+  }
+  for (int64_t i = 0; i < argumentCount; ++i) {
+    compileExpression(call->getArguments()[i].get(), firstArgument + i);
+  }
+  nextTemp_ = mark;
+
+  int64_t dst = resultRegister(target);
+  callSites_.push_back({bytecode_.size(), function.id});
+  if (function.memoized) {
+    emit(bytecode_, RegOp::CALL_MEMO, {dst, 0, 0, firstArgument, argumentCount, function.id});
+  } else {
+    emit(bytecode_, RegOp::CALL, {dst, 0, 0, firstArgument, argumentCount});
+  }
+  return dst;
+}
+
+// The arguments go straight into the parameters, which are variables of
+// the caller's frame, and every `return` leaves its value in the result.
+int64_t ASTToRegisterBytecodeConverter::compileInlinedCall(const InlinedCallNode* call, int64_t target) {
+  const std::vector<std::string>& parameters = call->getParameters();
+  for (size_t i = 0; i < parameters.size(); ++i) {
+    compileExpression(call->getArguments()[i].get(), slots_->slotOf(parameters[i]).index);
+  }
+
+  int64_t dst = resultRegister(target);
+  inlinedReturns_.push_back({dst, {}});
+  const auto& body = call->getBody();
+  for (size_t i = 0; i + 1 < body.size(); ++i) {
+    compileStatement(body[i].get());
+  }
+  std::vector<size_t> jumps = std::move(inlinedReturns_.back().jumps);
+  inlinedReturns_.pop_back();
+  compileExpression(static_cast<const ReturnNode&>(*body.back()).getExpression(), dst);
+  for (size_t jump : jumps) {
+    patchJump(jump);
+  }
+  return dst;
+}
+
+int64_t ASTToRegisterBytecodeConverter::keepValue(int64_t reg, const ASTNode* later) {
+  // Only globals can change under a call, and top-level code addresses them
+  // as plain registers of the bottom frame.
+  if (slots_ != &globals_ || reg >= static_cast<int64_t>(slots_->slotCount()) || !containsCall(later)) {
+    return reg;
+  }
+  int64_t temp = allocateTemp();
+  emit(bytecode_, RegOp::MOVE, {temp, reg});
+  return temp;
+}
+
+bool ASTToRegisterBytecodeConverter::containsCall(const ASTNode* node) {
+  if (dynamic_cast<const FunctionCallNode*>(node) || dynamic_cast<const InlinedCallNode*>(node)) {
+    return true;
+  }
+  if (auto* arithmetic = dynamic_cast<const ArithmeticOpNode*>(node)) {
+    return containsCall(arithmetic->getLeft()) || containsCall(arithmetic->getRight());
+  }
+  if (auto* compare = dynamic_cast<const CompareOpNode*>(node)) {
+    return containsCall(compare->getLeft()) || containsCall(compare->getRight());
+  }
+  if (auto* arrayAccess = dynamic_cast<const ArrayAccessAST*>(node)) {
+    return containsCall(arrayAccess->getIndex());
+  }
+  return false;
+}
+
+int64_t ASTToRegisterBytecodeConverter::allocateTemp() {
+  int64_t reg = nextTemp_++;
+  frameSize_ = std::max(frameSize_, nextTemp_);
+  return reg;
+}
+
+int64_t ASTToRegisterBytecodeConverter::resultRegister(int64_t target) {
+  return target >= 0 ? target : allocateTemp();
+}
+
+void ASTToRegisterBytecodeConverter::patchJump(size_t operandIndex) {
+  bytecode_[operandIndex] = static_cast<int64_t>(bytecode_.size());
+}
+
+void ASTToRegisterBytecodeConverter::disassemble(const RegisterBytecode& bytecode, std::ostream& out) {
+  size_t pc = 0;
+  while (pc < bytecode.size()) {
+    size_t length = registerInstructionLength(&bytecode[pc]);
+    out << pc << ": " << opcodeName(static_cast<RegOp>(bytecode[pc])) << " ";
+    for (size_t i = 1; i < length; ++i) {
+      out << bytecode[pc + i] << " ";
+    }
+    out << "\n";
+    pc += length;
+  }
+}
@@ -0,0 +1,76 @@
+#ifndef AST_TO_REGISTER_BYTECODE_CONVERTER_H
+#define AST_TO_REGISTER_BYTECODE_CONVERTER_H
+
+#include "ASTNode.h"
+#include "RegisterBytecode.h"
+#include <ostream>
+#include <vector>
+#include <memory>
+
+class FunctionDeclNode;
+class InlinedCallNode;
+
+// Compiles the AST into three-address code for the register VM. Variables
+// are used in place as registers; every sub-expression result gets a
+// temporary slot above the frame's variables, and temporaries are reused as
+// soon as the expression that needed them is done.
+class ASTToRegisterBytecodeConverter {
+ public:
+  // With `memoize`, calls of pure functions cache their results at runtime,
+  // as for the stack machine.
+  static RegisterBytecode
+  generateBytecode(const std::vector<std::unique_ptr<ASTNode>>& ast, char* src_filename, bool memoize);
+
+  static void disassemble(const RegisterBytecode& bytecode, std::ostream& out);
+
+ private:
+  struct CallSite {
+    size_t pc;
+    int64_t functionId;
+  };
+
+  struct FunctionEntry {
+    int64_t entry = -1;
+    int64_t frameSize = 0;
+  };
+
+  // An inlined call being compiled: where its `return`s leave the result,
+  // and the jumps they take past its body.
+  struct InlinedReturn {
+    int64_t result;
+    std::vector<size_t> jumps;
+  };
+
+  explicit ASTToRegisterBytecodeConverter(const SlotResolver& globals);
+
+  void compileStatement(const ASTNode* node);
+  void compileBody(const std::vector<std::unique_ptr<ASTNode>>& body);
+  void compileFunction(const FunctionDeclNode* function);
+
+  // Returns the register holding the value of the expression. With a
+  // target, the value is always left in that register.
+  int64_t compileExpression(const ASTNode* node, int64_t target = -1);
+  int64_t compileCall(const ASTNode* node, int64_t target);
+  int64_t compileInlinedCall(const InlinedCallNode* call, int64_t target);
+
+  // Copies a global variable register into a temporary when a later call
+  // could assign the variable before the value is used.
+  int64_t keepValue(int64_t reg, const ASTNode* later);
+  static bool containsCall(const ASTNode* node);
+
+  int64_t allocateTemp();
+  int64_t resultRegister(int64_t target);
+  void patchJump(size_t operandIndex);
+
+  RegisterBytecode bytecode_;
+  const SlotResolver& globals_;
+  const SlotResolver* slots_;
+  int64_t nextTemp_ = 0;
+  int64_t frameSize_ = 0;
+  std::vector<const FunctionDeclNode*> functions_;
+  std::vector<CallSite> callSites_;
+  std::vector<FunctionEntry> entries_;
+  std::vector<InlinedReturn> inlinedReturns_;
+};
+
+#endif // AST_TO_REGISTER_BYTECODE_CONVERTER_H
@@ -0,0 +1,158 @@
+#include "ArrayHeap.h"
+#include <algorithm>
+#include <bit>
+#include <utility>
+
+uint64_t ArrayHeap::allocate(const int64_t* elements, size_t size) {
+  size_t bytes = size * sizeof(int64_t);
+  ++allocations_;
+  allocatedBytes_ += bytes;
+  youngBytes_ += bytes;
+  liveBytes_ += bytes;
+  peakLiveBytes_ = std::max(peakLiveBytes_, liveBytes_);
+
+  uint64_t handle = reuseHandle(size);
+  if (handle < arrays_.size()) {
+    arrays_[handle].assign(elements, elements + size);
+    references_[handle] = 1;
+    live_[handle] = true;
+    old_[handle] = false;
+  } else {
+    arrays_.emplace_back(elements, elements + size);
+    references_.push_back(1);
+    marked_.push_back(false);
+    live_.push_back(true);
+    old_.push_back(false);
+    youngMarked_.push_back(false);
+  }
+  young_.push_back(handle);
+
+  // Arrays allocated while a collection runs survive it: marking already
+  // scanned slots that may end up holding them, and the sweep has not
+  // reached handles past its cursor yet.
+  marked_[handle] = marking_ || (sweeping_ && handle >= sweepCursor_);
+  return handle;
+}
+
+uint64_t ArrayHeap::clone(uint64_t handle) {
+  // Element buffers do not move when arrays_ grows, so the source stays valid.
+  const std::vector<int64_t>& source = arrays_[handle];
+  return allocate(source.data(), source.size());
+}
+
+std::vector<int64_t>& ArrayHeap::writable(uint64_t& handle) {
+  if (references_[handle] > 1) {
+    --references_[handle];
+    handle = clone(handle);
+  }
+  return arrays_[handle];
+}
+
+void ArrayHeap::sweepYoung() {
+  for (uint64_t handle : young_) {
+    if (!live_[handle] || old_[handle]) {
+      continue;
+    }
+    if (youngMarked_[handle]) {
+      youngMarked_[handle] = false;
+      old_[handle] = true;
+      promotedBytes_ += bytesOf(arrays_[handle]);
+    } else {
+      free(handle, nullptr);
+    }
+  }
+  young_.clear();
+  youngBytes_ = 0;
+}
+
+void ArrayHeap::beginSweep() {
+  marking_ = false;
+  sweeping_ = true;
+  sweepCursor_ = 0;
+}
+
+bool ArrayHeap::sweepStep(size_t limit, std::vector<std::vector<int64_t>>* released) {
+  uint64_t end = std::min<uint64_t>(arrays_.size(), sweepCursor_ + limit);
+  for (; sweepCursor_ < end; ++sweepCursor_) {
+    uint64_t handle = sweepCursor_;
+    if (live_[handle] && !marked_[handle]) {
+      free(handle, released);
+    }
+    marked_[handle] = false;
+  }
+
+  if (sweepCursor_ < arrays_.size()) {
+    return false;
+  }
+  sweeping_ = false;
+  return true;
+}
+
+void ArrayHeap::free(uint64_t handle, std::vector<std::vector<int64_t>>* released) {
+  std::vector<int64_t>& buffer = arrays_[handle];
+  liveBytes_ -= bytesOf(buffer);
+  freedBytes_ += bytesOf(buffer);
+  live_[handle] = false;
+
+  if (keptBytes_ + capacityBytes(buffer) <= keptLimit_) {
+    keptBytes_ += capacityBytes(buffer);
+    buffer.clear();
+  } else if (released) {
+    released->push_back(std::move(buffer));
+    buffer = std::vector<int64_t>();
+  } else {
+    std::vector<int64_t>().swap(buffer);
+  }
+  freeHandles_[std::bit_width(buffer.capacity())].push_back(handle);
+  ++freeCount_;
+}
+
+uint64_t ArrayHeap::reuseHandle(size_t size) {
+  if (freeCount_ == 0) {
+    return arrays_.size();
+  }
+  // A buffer in the size's own class may still be too small. The next
+  // classes always fit; stop after two so a small array does not pin a
+  // buffer many times its size.
+  size_t first = std::bit_width(size);
+  for (size_t sizeClass = first; sizeClass < std::min(first + 3, kSizeClasses); ++sizeClass) {
+    if (!freeHandles_[sizeClass].empty() && arrays_[freeHandles_[sizeClass].back()].capacity() >= size) {
+      return popFree(sizeClass);
+    }
+  }
+  // Nothing fits: take the smallest buffer and let the allocation grow it.
+  for (size_t sizeClass = 0; sizeClass < kSizeClasses; ++sizeClass) {
+    if (!freeHandles_[sizeClass].empty()) {
+      return popFree(sizeClass);
+    }
+  }
+  return arrays_.size();
+}
+
+uint64_t ArrayHeap::popFree(size_t sizeClass) {
+  uint64_t handle = freeHandles_[sizeClass].back();
+  freeHandles_[sizeClass].pop_back();
+  --freeCount_;
+  keptBytes_ -= capacityBytes(arrays_[handle]);
+  return handle;
+}
+
+void ArrayHeap::clear() {
+  arrays_.clear();
+  references_.clear();
+  marked_.clear();
+  live_.clear();
+  old_.clear();
+  youngMarked_.clear();
+  young_.clear();
+  for (std::vector<uint64_t>& handles : freeHandles_) {
+    handles.clear();
+  }
+  freeCount_ = 0;
+  keptBytes_ = 0;
+  youngBytes_ = 0;
+  liveBytes_ = 0;
+  marking_ = false;
+  sweeping_ = false;
+  sweepCursor_ = 0;
+}
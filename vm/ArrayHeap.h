@@ -0,0 +1,137 @@
+#ifndef ARRAY_HEAP_H
+#define ARRAY_HEAP_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Owns every array of the running program. Slots hold a handle (an index
+// into this heap) instead of the elements, so copying a slot never copies
+// an array. Handles of swept arrays are reused by later allocations.
+//
+// A freed array keeps its element buffer, up to the kept limit in total, and
+// its handle goes to a free list by the buffer's capacity. An allocation
+// takes a handle whose buffer already fits, so programs that keep
+// allocating arrays of the same sizes stop calling malloc.
+//
+// Arrays keep value semantics through copy-on-write: every slot that holds
+// a handle is counted as a reference, and a write through a handle that is
+// referenced more than once first gives the writer its own copy. Counts may
+// run high (a slot overwritten with an integer is not released), which only
+// costs an extra copy.
+//
+// Reclaiming is left to GarbageCollector. New arrays start in the young
+// generation; a minor collection frees the young arrays no slot references
+// and promotes the rest to the old generation, visiting young arrays only.
+// Arrays hold integers, never handles, so slots are the only references and
+// no old array can keep a young one alive.
+//
+// A major collection marks and sweeps the whole heap in small steps between
+// instructions. While it marks, arrays that are shared or allocated are
+// marked right away, so a handle copied into a slot the collector already
+// scanned is never lost.
+class ArrayHeap {
+ public:
+  // Allocates an array holding a copy of [elements, elements + size).
+  uint64_t allocate(const int64_t* elements, size_t size);
+  // Allocates a copy of an existing array and returns its handle.
+  uint64_t clone(uint64_t handle);
+
+  std::vector<int64_t>& get(uint64_t handle) { return arrays_[handle]; }
+  // Returns the array for writing. If it is shared, the handle is replaced
+  // with the one of a private copy.
+  std::vector<int64_t>& writable(uint64_t& handle);
+
+  // Another slot now references the array.
+  void share(uint64_t handle) {
+    ++references_[handle];
+    if (marking_) {
+      marked_[handle] = true;
+    }
+  }
+  // A slot stopped referencing the array.
+  void release(uint64_t handle) {
+    if (references_[handle] > 0) {
+      --references_[handle];
+    }
+  }
+
+  // Minor collection: mark the young arrays referenced from the roots, then
+  // sweep the young generation.
+  void markYoung(uint64_t handle) {
+    if (!old_[handle]) {
+      youngMarked_[handle] = true;
+    }
+  }
+  void sweepYoung();
+
+  void beginMarking() { marking_ = true; }
+  void mark(uint64_t handle) { marked_[handle] = true; }
+  // Ends marking. The sweep then visits every handle once, in order.
+  void beginSweep();
+  // Frees the unmarked arrays among the next `limit` handles and clears the
+  // marks of the others. Returns true once every handle was visited. With
+  // `released`, the buffers that are not kept are moved there for the
+  // caller to free instead of being freed right away.
+  bool sweepStep(size_t limit, std::vector<std::vector<int64_t>>* released = nullptr);
+  void clear();
+
+  // Bytes of freed buffers kept for reuse at most.
+  void setKeptLimit(size_t bytes) { keptLimit_ = bytes; }
+
+  // Arrays and bytes of elements allocated since the program started.
+  [[nodiscard]] uint64_t allocations() const { return allocations_; }
+  [[nodiscard]] size_t allocatedBytes() const { return allocatedBytes_; }
+  // Bytes of elements of arrays freed by collections.
+  [[nodiscard]] size_t freedBytes() const { return freedBytes_; }
+  // Most bytes that were live at once.
+  [[nodiscard]] size_t peakLiveBytes() const { return peakLiveBytes_; }
+  // Bytes allocated since the last minor collection.
+  [[nodiscard]] size_t youngBytes() const { return youngBytes_; }
+  // Bytes moved to the old generation since the program started.
+  [[nodiscard]] size_t promotedBytes() const { return promotedBytes_; }
+  // Bytes of elements held by arrays that were not freed yet.
+  [[nodiscard]] size_t liveBytes() const { return liveBytes_; }
+  [[nodiscard]] size_t liveCount() const { return arrays_.size() - freeCount_; }
+
+ private:
+  // Free list i holds the handles whose buffer capacity has bit width i.
+  static constexpr size_t kSizeClasses = 65;
+
+  static size_t bytesOf(const std::vector<int64_t>& elements) { return elements.size() * sizeof(int64_t); }
+  static size_t capacityBytes(const std::vector<int64_t>& elements) {
+    return elements.capacity() * sizeof(int64_t);
+  }
+  void free(uint64_t handle, std::vector<std::vector<int64_t>>* released);
+  // Returns a free handle for `size` elements, preferring one whose buffer
+  // already fits, or arrays_.size() if there is none.
+  uint64_t reuseHandle(size_t size);
+  uint64_t popFree(size_t sizeClass);
+
+  std::vector<std::vector<int64_t>> arrays_;
+  std::vector<uint32_t> references_;
+  std::vector<bool> marked_;
+  std::vector<bool> live_;
+  std::vector<bool> old_;
+  std::vector<bool> youngMarked_;
+  // Handles allocated since the last minor collection. A handle freed by a
+  // major collection and allocated again may appear twice.
+  std::vector<uint64_t> young_;
+  std::array<std::vector<uint64_t>, kSizeClasses> freeHandles_;
+  size_t freeCount_ = 0;
+  size_t keptBytes_ = 0;
+  size_t keptLimit_ = 0;
+  uint64_t allocations_ = 0;
+  size_t allocatedBytes_ = 0;
+  size_t freedBytes_ = 0;
+  size_t peakLiveBytes_ = 0;
+  size_t youngBytes_ = 0;
+  size_t promotedBytes_ = 0;
+  size_t liveBytes_ = 0;
+  bool marking_ = false;
+  bool sweeping_ = false;
+  uint64_t sweepCursor_ = 0;
+};
+
+#endif // ARRAY_HEAP_H
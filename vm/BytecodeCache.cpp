@@ -0,0 +1,131 @@
+#include "BytecodeCache.h"
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace {
+
+constexpr char kMagic[4] = {'M', 'P', 'L', 'C'};
+
+
+struct Header {
+  char magic[4];
+  uint32_t version;
+  uint32_t kind;
+  uint32_t reserved32;
+  uint64_t key;
+  uint64_t words;
+  uint64_t checksum;
+  uint64_t reserved[3];
+};
+
+static_assert(sizeof(Header) == 64, "cache header layout changed");
+
+constexpr uint64_t kFnvOffset = 14695981039346656037ull;
+constexpr uint64_t kFnvPrime = 1099511628211ull;
+
+// 64-bit FNV-1a, one word at a time, of the program's words.
+uint64_t checksumOf(BytecodeView code) {
+  uint64_t hash = kFnvOffset;
+  for (int64_t word : code) {
+    hash ^= static_cast<uint64_t>(word);
+    hash *= kFnvPrime;
+  }
+  return hash;
+}
+
+} // namespace
+
+BytecodeCache::Mapping::Mapping(Mapping&& other) noexcept
+    : address_(std::exchange(other.address_, nullptr)), length_(std::exchange(other.length_, 0)) {}
+
+BytecodeCache::Mapping::~Mapping() {
+  if (address_) {
+    munmap(address_, length_);
+  }
+}
+
+BytecodeView BytecodeCache::Mapping::code() const {
+  const auto* header = static_cast<const Header*>(address_);
+  const auto* words = reinterpret_cast<const int64_t*>(header + 1);
+  return {words, static_cast<size_t>(header->words)};
+}
+
+uint64_t BytecodeCache::hashSource(std::string_view source, int optimizationLevel, bool memoize) {
+  uint64_t hash = kFnvOffset;
+  for (unsigned char c : source) {
+    hash ^= c;
+    hash *= kFnvPrime;
+  }
+  hash ^= static_cast<unsigned char>(optimizationLevel);
+  hash *= kFnvPrime;
+  hash ^= static_cast<unsigned char>(memoize);
+  hash *= kFnvPrime;
+  return hash;
+}
+
+std::string BytecodeCache::pathFor(const std::string& sourcePath, Kind kind) {
+  std::string base = sourcePath;
+  if (base.size() > 4 && base.compare(base.size() - 4, 4, ".mpl") == 0) {
+    base.resize(base.size() - 4);
+  }
+  return base + (kind == Kind::Register ? ".reg.mplc" : ".mplc");
+}
+
+std::optional<BytecodeCache::Mapping> BytecodeCache::load(const std::string& path, Kind kind, uint64_t key) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return std::nullopt;
+  }
+  struct stat status {};
+  if (fstat(fd, &status) != 0 || static_cast<size_t>(status.st_size) < sizeof(Header)) {
+    close(fd);
+    return std::nullopt;
+  }
+  auto length = static_cast<size_t>(status.st_size);
+  void* address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (address == MAP_FAILED) {
+    return std::nullopt;
+  }
+
+  Mapping mapping(address, length);
+  const auto* header = static_cast<const Header*>(address);
+  if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 || header->version != kFormatVersion ||
+      header->kind != static_cast<uint32_t>(kind) || header->key != key ||
+      header->words != (length - sizeof(Header)) / sizeof(int64_t) ||
+      (length - sizeof(Header)) % sizeof(int64_t) != 0 || header->checksum != checksumOf(mapping.code())) {
+    return std::nullopt;
+  }
+  return mapping;
+}
+
+void BytecodeCache::store(const std::string& path, Kind kind, uint64_t key, BytecodeView code) {
+  Header header{};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kFormatVersion;
+  header.kind = static_cast<uint32_t>(kind);
+  header.key = key;
+  header.words = code.size();
+  header.checksum = checksumOf(code);
+
+  std::string temporary = path + "." + std::to_string(getpid()) + ".tmp";
+  {
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(code.data()), static_cast<std::streamsize>(code.size_bytes()));
+    if (!out) {
+      out.close();
+      std::remove(temporary.c_str());
+      return;
+    }
+  }
+  if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+    std::remove(temporary.c_str());
+  }
+}
@@ -0,0 +1,65 @@
+#ifndef BYTECODE_CACHE_H
+#define BYTECODE_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include "Bytecode.h"
+
+// Compiled programs cached on disk next to their source, so running an
+// unchanged script again skips lexing, parsing and code generation.
+//
+// A cache file is a 64-byte header followed by the program's words, in
+// host byte order. The header holds "MPLC", the format version, the kind,
+// the source key, the word count and a checksum of the words.
+//
+// The words are the linked program exactly as the VM runs it. Constants are
+// operands inline in the instruction stream, so there is no separate pool
+// to resolve. A hit maps the file read-only and the VM runs the mapped
+// words in place. A file whose words do not match the checksum is a miss.
+// Only stack bytecode the verifier accepted is stored, and it is verified
+// again when loaded rather than trusting the file to hold what was written.
+class BytecodeCache {
+ public:
+  // Bump whenever the compilers' output or the instruction encoding
+  // changes, so files written by an older build are never run.
+  static constexpr uint32_t kFormatVersion = 14;
+
+  enum class Kind : uint32_t { Stack = 1, Register = 2 };
+
+  // A read-only mapping of a cache file, unmapped on destruction.
+  class Mapping {
+   public:
+    Mapping(Mapping&& other) noexcept;
+    Mapping& operator=(Mapping&&) = delete;
+    Mapping(const Mapping&) = delete;
+    Mapping& operator=(const Mapping&) = delete;
+    ~Mapping();
+
+    [[nodiscard]] BytecodeView code() const;
+
+   private:
+    friend class BytecodeCache;
+    Mapping(void* address, size_t length) : address_(address), length_(length) {}
+
+    void* address_;
+    size_t length_;
+  };
+
+  // 64-bit FNV-1a of the source text followed by the optimization level and
+  // whether calls are memoized.
+  static uint64_t hashSource(std::string_view source, int optimizationLevel, bool memoize);
+  // script.mpl -> script.mplc, or script.reg.mplc for register bytecode.
+  static std::string pathFor(const std::string& sourcePath, Kind kind);
+
+  // Maps the file if it holds `kind` bytecode in the current format for a
+  // source with this key, intact. Any other file is a miss.
+  static std::optional<Mapping> load(const std::string& path, Kind kind, uint64_t key);
+  // Writes the file through a temporary and a rename, so concurrent runs
+  // never map a partial file. A failure only costs the next run a compile.
+  static void store(const std::string& path, Kind kind, uint64_t key, BytecodeView code);
+};
+
+#endif // BYTECODE_CACHE_H
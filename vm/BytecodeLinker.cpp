@@ -0,0 +1,55 @@
+#include "BytecodeLinker.h"
+#include <iostream>
+
+namespace {
+
+struct LinkedFunction {
+  int64_t entry = -1;
+  int64_t arity = 0;
+  int64_t frameSize = 0;
+};
+
+}  // namespace
+
+bool BytecodeLinker::link(Bytecode& bytecode) {
+  std::vector<LinkedFunction> functions;
+
+  for (size_t pc = 0; pc < bytecode.size(); pc += instructionLength(&bytecode[pc])) {
+    if (static_cast<OpCode>(bytecode[pc]) != OpCode::FUNC_DEF) {
+      continue;
+    }
+    auto id = static_cast<size_t>(bytecode[pc + 1]);
+    if (id >= functions.size()) {
+      functions.resize(id + 1);
+    }
+    functions[id] = {static_cast<int64_t>(pc + instructionLength(&bytecode[pc])), bytecode[pc + 2], bytecode[pc + 3]};
+  }
+
+  for (size_t pc = 0; pc < bytecode.size(); pc += instructionLength(&bytecode[pc])) {
+    auto op = static_cast<OpCode>(bytecode[pc]);
+    if (op != OpCode::CALL_FUNC && op != OpCode::CALL_FUNC_MEMO) {
+      continue;
+    }
+    auto id = static_cast<size_t>(bytecode[pc + 1]);
+    int64_t argumentCount = bytecode[pc + 2];
+    if (id >= functions.size() || functions[id].entry < 0) {
+      std::cerr << "Link failed: call at " << pc << " to undefined function #" << id << "\n";
+      return false;
+    }
+    const LinkedFunction& function = functions[id];
+    if (argumentCount != function.arity) {
+      std::cerr << "Link failed: call at " << pc << " passes " << argumentCount << " arguments to function #" << id
+                << ", which expects " << function.arity << "\n";
+      return false;
+    }
+    bytecode[pc] = static_cast<int64_t>(op == OpCode::CALL_FUNC ? OpCode::CALL : OpCode::CALL_MEMO);
+    bytecode[pc + 1] = function.entry;
+    bytecode[pc + 2] = function.frameSize;
+    bytecode[pc + 3] = argumentCount;
+    if (op == OpCode::CALL_FUNC_MEMO) {
+      bytecode[pc + 4] = static_cast<int64_t>(id);
+    }
+  }
+
+  return true;
+}
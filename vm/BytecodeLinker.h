@@ -0,0 +1,17 @@
+#ifndef BYTECODE_LINKER_H
+#define BYTECODE_LINKER_H
+
+#include "Bytecode.h"
+
+class BytecodeLinker {
+ public:
+  // Builds the function table from the FUNC_DEF headers and rewrites every
+  // CALL_FUNC in place into a CALL with the entry address and frame size of
+  // its target, so functions can be called before their definition and calls
+  // need no lookup at runtime. A CALL_FUNC_MEMO becomes a CALL_MEMO that
+  // keeps the function id for its memo table. Returns false if a call has no
+  // target.
+  static bool link(Bytecode& bytecode);
+};
+
+#endif // BYTECODE_LINKER_H
@@ -0,0 +1,389 @@
+#include "BytecodeVerifier.h"
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+
+namespace {
+
+// A piece of code that runs in its own frame: the top level or the body of
+// one function.
+struct Region {
+  size_t begin = 0;
+  size_t end = 0;
+  int64_t arity = 0;
+  int64_t frameSize = 0;
+  // The function's id from its FUNC_DEF, -1 for the top level.
+  int64_t id = -1;
+  // Slots that a DECLARE_ARRAY of this region may turn into arrays.
+  std::vector<bool> arraySlots;
+  size_t maxDepth = 0;
+};
+
+struct CallSite {
+  size_t caller;
+  size_t callee;
+  // Operand stack depth the caller keeps below the callee's values.
+  size_t depth;
+};
+
+class Verifier {
+ public:
+  explicit Verifier(BytecodeView bytecode) : code_(bytecode), starts_(bytecode.size() + 1) {}
+
+  BytecodeVerifier::Result run() {
+    BytecodeVerifier::Result result;
+    if (!decode()) {
+      return result;
+    }
+    for (size_t region = 0; region < regions_.size(); ++region) {
+      if (!verifyRegion(region)) {
+        return result;
+      }
+      result.maxFrameStackHeight = std::max(result.maxFrameStackHeight, regions_[region].maxDepth);
+    }
+    result.maxStackHeight = programHeight(result.recursive);
+    result.verified = true;
+    return result;
+  }
+
+ private:
+  static constexpr size_t kTopLevel = 0;
+
+  bool fail(size_t pc, const std::string& reason) {
+    std::cerr << "Verification failed at " << pc << ": " << reason << "\n";
+    return false;
+  }
+
+  // Walks the instruction stream once, records where instructions start and
+  // splits the program into the top level and the function bodies.
+  bool decode() {
+    if (code_.size() < 2 || static_cast<OpCode>(code_[0]) != OpCode::RESERVE_SLOTS || code_[1] < 0) {
+      return fail(0, "program does not start with RESERVE_SLOTS");
+    }
+    regions_.push_back({0, code_.size(), 0, code_[1], -1, std::vector<bool>(code_[1])});
+
+    size_t functionEnd = 0;
+    for (size_t pc = 0; pc < code_.size();) {
+      if (code_[pc] < 0 || code_[pc] >= static_cast<int64_t>(OpCode::COUNT)) {
+        return fail(pc, "unknown opcode " + std::to_string(code_[pc]));
+      }
+      auto op = static_cast<OpCode>(code_[pc]);
+      if (op == OpCode::DECLARE_ARRAY && (pc + 2 >= code_.size() || code_[pc + 2] < 0)) {
+        return fail(pc, "bad array size");
+      }
+      size_t length = instructionLength(&code_[pc]);
+      if (length > code_.size() - pc) {
+        return fail(pc, "instruction runs past the end of the program");
+      }
+      if (op == OpCode::RESERVE_SLOTS && pc != 0) {
+        return fail(pc, "RESERVE_SLOTS inside the program");
+      }
+
+      if (functionEnd != 0 && pc >= functionEnd) {
+        functionEnd = 0;
+      }
+      if (op == OpCode::FUNC_DEF) {
+        if (functionEnd != 0) {
+          return fail(pc, "nested function definition");
+        }
+        int64_t arity = code_[pc + 2];
+        int64_t frameSize = code_[pc + 3];
+        int64_t bodyLength = code_[pc + 4];
+        size_t begin = pc + length;
+        if (arity < 0 || frameSize < arity || bodyLength <= 0 ||
+            static_cast<uint64_t>(bodyLength) > code_.size() - begin) {
+          return fail(pc, "bad function header");
+        }
+        functionEnd = begin + bodyLength;
+        functions_.push_back(regions_.size());
+        regions_.push_back({begin, functionEnd, arity, frameSize, code_[pc + 1], std::vector<bool>(frameSize)});
+      }
+
+      starts_[pc] = true;
+      pc += length;
+    }
+    starts_[code_.size()] = true;
+    for (size_t function : functions_) {
+      if (!starts_[regions_[function].end]) {
+        return fail(regions_[function].begin, "function body ends inside an instruction");
+      }
+    }
+
+    // DECLARE_ARRAY is the only instruction that puts an array into a slot
+    // of the stack machine, so every other slot always holds an integer.
+    for (size_t pc = 0; pc < code_.size(); pc += instructionLength(&code_[pc])) {
+      if (static_cast<OpCode>(code_[pc]) != OpCode::DECLARE_ARRAY) {
+        continue;
+      }
+      Region& region = regions_[regionOf(pc)];
+      if (code_[pc + 1] < 0 || code_[pc + 1] >= region.frameSize) {
+        return fail(pc, "slot outside the frame");
+      }
+      region.arraySlots[code_[pc + 1]] = true;
+    }
+    return true;
+  }
+
+  size_t regionOf(size_t pc) const {
+    auto it = std::upper_bound(functions_.begin(), functions_.end(), pc,
+                               [this](size_t value, size_t region) { return value < regions_[region].begin; });
+    if (it != functions_.begin()) {
+      size_t region = *(it - 1);
+      if (pc < regions_[region].end) {
+        return region;
+      }
+    }
+    return kTopLevel;
+  }
+
+  bool scalarSlot(size_t pc, const Region& region, int64_t slot) {
+    if (slot < 0 || slot >= region.frameSize) {
+      return fail(pc, "slot outside the frame");
+    }
+    if (region.arraySlots[slot]) {
+      return fail(pc, "scalar access to an array slot");
+    }
+    return true;
+  }
+
+  bool arraySlot(size_t pc, const Region& region, int64_t slot) {
+    if (slot < 0 || slot >= region.frameSize) {
+      return fail(pc, "slot outside the frame");
+    }
+    return true;
+  }
+
+  // Abstract interpretation of the operand stack depth over the control
+  // flow graph of one region, starting from an empty stack at its entry.
+  bool verifyRegion(size_t index) {
+    Region& region = regions_[index];
+    const Region& globals = regions_[kTopLevel];
+    // Keyed by instruction: the top level spans array literals that can be
+    // millions of words long.
+    std::unordered_map<size_t, int64_t> depths;
+    std::vector<size_t> worklist;
+
+    auto reach = [&](size_t from, size_t target, int64_t depth) {
+      if (target < region.begin || target >= region.end || !starts_[target] || regionOf(target) != index) {
+        return fail(from, "jump to " + std::to_string(target) + " leaves the function or splits an instruction");
+      }
+      auto [known, inserted] = depths.emplace(target, depth);
+      if (inserted) {
+        worklist.push_back(target);
+      } else if (known->second != depth) {
+        return fail(target, "operand stack depth " + std::to_string(depth) + " differs from " +
+            std::to_string(known->second));
+      }
+      return true;
+    };
+
+    if (!reach(region.begin, region.begin, 0)) {
+      return false;
+    }
+    while (!worklist.empty()) {
+      size_t pc = worklist.back();
+      worklist.pop_back();
+      int64_t depth = depths[pc];
+      const int64_t* ip = &code_[pc];
+      size_t next = pc + instructionLength(ip);
+      int64_t pops = 0;
+      int64_t pushes = 0;
+      bool fallsThrough = true;
+
+      switch (static_cast<OpCode>(ip[0])) {
+        case OpCode::LOAD_CONST:
+          pushes = 1;
+          break;
+        case OpCode::RESERVE_SLOTS:
+          break;
+        case OpCode::STORE_SLOT:
+          if (!scalarSlot(pc, region, ip[1])) return false;
+          pops = 1;
+          break;
+        case OpCode::LOAD_SLOT:
+          if (!scalarSlot(pc, region, ip[1])) return false;
+          pushes = 1;
+          break;
+        case OpCode::DECLARE_ARRAY:
+          break;
+        case OpCode::ASSIGN_ARRAY_ELEMENT:
+        case OpCode::ASSIGN_ARRAY_ELEMENT_UNCHECKED:
+          if (!arraySlot(pc, region, ip[1])) return false;
+          pops = 2;
+          break;
+        case OpCode::LOAD_ARRAY_ELEMENT:
+        case OpCode::LOAD_ARRAY_ELEMENT_UNCHECKED:
+          if (!arraySlot(pc, region, ip[1])) return false;
+          pops = 1;
+          pushes = 1;
+          break;
+        case OpCode::STORE_GLOBAL:
+          if (!scalarSlot(pc, globals, ip[1])) return false;
+          pops = 1;
+          break;
+        case OpCode::LOAD_GLOBAL:
+          if (!scalarSlot(pc, globals, ip[1])) return false;
+          pushes = 1;
+          break;
+        case OpCode::ASSIGN_GLOBAL_ELEMENT:
+        case OpCode::ASSIGN_GLOBAL_ELEMENT_UNCHECKED:
+          if (!arraySlot(pc, globals, ip[1])) return false;
+          pops = 2;
+          break;
+        case OpCode::LOAD_GLOBAL_ELEMENT:
+        case OpCode::LOAD_GLOBAL_ELEMENT_UNCHECKED:
+          if (!arraySlot(pc, globals, ip[1])) return false;
+          pops = 1;
+          pushes = 1;
+          break;
+        case OpCode::ADD:
+        case OpCode::SUBTRACT:
+        case OpCode::MULTIPLY:
+        case OpCode::DIVIDE:
+        case OpCode::MODULO:
+        case OpCode::EQUALS:
+        case OpCode::LESS_THAN:
+        case OpCode::GREATER_THAN:
+        case OpCode::LESS_THAN_OR_EQUAL:
+        case OpCode::GREATER_THAN_OR_EQUAL:
+          pops = 2;
+          pushes = 1;
+          break;
+        case OpCode::JUMP:
+          fallsThrough = false;
+          if (!reach(pc, ip[1], depth)) return false;
+          break;
+        case OpCode::JUMP_IF_FALSE:
+          if (depth < 1) return fail(pc, "operand stack underflow");
+          if (!reach(pc, ip[1], depth - 1)) return false;
+          pops = 1;
+          break;
+        case OpCode::ADD_SLOT_CONST:
+          if (!scalarSlot(pc, region, ip[1])) return false;
+          pushes = 1;
+          break;
+        case OpCode::JUMP_IF_NOT_EQUALS:
+        case OpCode::JUMP_IF_NOT_LESS_THAN:
+        case OpCode::JUMP_IF_NOT_GREATER_THAN:
+        case OpCode::JUMP_IF_NOT_LESS_THAN_OR_EQUAL:
+        case OpCode::JUMP_IF_NOT_GREATER_THAN_OR_EQUAL:
+          if (depth < 2) return fail(pc, "operand stack underflow");
+          if (!reach(pc, ip[1], depth - 2)) return false;
+          pops = 2;
+          break;
+        case OpCode::FOR_LOOP:
+          if (!scalarSlot(pc, region, ip[1])) return false;
+          if (!reach(pc, ip[4], depth)) return false;
+          break;
+        case OpCode::STORE_SLOT_KEEP:
+          if (!scalarSlot(pc, region, ip[1])) return false;
+          pops = 1;
+          pushes = 1;
+          break;
+        case OpCode::DIVIDE_POW2:
+        case OpCode::MODULO_POW2:
+          if (ip[1] < 1 || ip[1] > 62) return fail(pc, "shift out of range");
+          pops = 1;
+          pushes = 1;
+          break;
+        case OpCode::FUNC_DEF:
+          // Only the top level reaches a header; it jumps over the body.
+          next = pc + instructionLength(ip) + ip[4];
+          break;
+        case OpCode::CALL_FUNC:
+        case OpCode::CALL_FUNC_MEMO:
+          return fail(pc, "unlinked call");
+        case OpCode::CALL:
+        case OpCode::CALL_MEMO: {
+          auto callee = std::find_if(functions_.begin(), functions_.end(),
+                                     [&](size_t f) { return static_cast<int64_t>(regions_[f].begin) == ip[1]; });
+          if (callee == functions_.end()) {
+            return fail(pc, "call target is not a function entry");
+          }
+          const Region& function = regions_[*callee];
+          if (ip[2] != function.frameSize || ip[3] != function.arity) {
+            return fail(pc, "call does not match the frame of its target");
+          }
+          // The VM keeps a memo table per function id.
+          if (static_cast<OpCode>(ip[0]) == OpCode::CALL_MEMO && ip[4] != function.id) {
+            return fail(pc, "memoized call does not name its target");
+          }
+          pops = ip[3];
+          pushes = 1;
+          if (depth >= pops) {
+            calls_.push_back({index, *callee, static_cast<size_t>(depth - pops)});
+          }
+          break;
+        }
+        case OpCode::RETURN:
+          if (index == kTopLevel) return fail(pc, "RETURN outside a function");
+          if (depth != 1) return fail(pc, "function returns with " + std::to_string(depth) + " values on the stack");
+          fallsThrough = false;
+          break;
+        case OpCode::PRINT:
+        case OpCode::POP:
+          pops = 1;
+          break;
+        case OpCode::HALT:
+          if (index != kTopLevel) return fail(pc, "HALT inside a function");
+          fallsThrough = false;
+          break;
+        case OpCode::COUNT:
+          return fail(pc, "unknown opcode");
+      }
+
+      if (depth < pops) {
+        return fail(pc, "operand stack underflow");
+      }
+      int64_t after = depth - pops + pushes;
+      region.maxDepth = std::max(region.maxDepth, static_cast<size_t>(std::max(depth, after)));
+      if (fallsThrough && !reach(pc, next, after)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // The deepest stack the top level can build together with the frames it
+  // calls. Meaningless once a function can reach itself through calls.
+  size_t programHeight(bool& recursive) {
+    std::vector<int> state(regions_.size(), 0);  // 0 new, 1 on the call path, 2 done
+    std::vector<size_t> height(regions_.size(), 0);
+    recursive = false;
+
+    auto visit = [&](auto& self, size_t region) -> size_t {
+      if (state[region] == 2) {
+        return height[region];
+      }
+      if (state[region] == 1) {
+        recursive = true;
+        return 0;
+      }
+      state[region] = 1;
+      size_t deepest = regions_[region].maxDepth;
+      for (const CallSite& call : calls_) {
+        if (call.caller == region) {
+          deepest = std::max(deepest, call.depth + self(self, call.callee));
+        }
+      }
+      state[region] = 2;
+      return height[region] = deepest;
+    };
+
+    return visit(visit, kTopLevel);
+  }
+
+  BytecodeView code_;
+  std::vector<bool> starts_;
+  std::vector<Region> regions_;
+  // Region indices of the functions, in the order of their bodies.
+  std::vector<size_t> functions_;
+  std::vector<CallSite> calls_;
+};
+
+}  // namespace
+
+BytecodeVerifier::Result BytecodeVerifier::verify(BytecodeView bytecode) {
+  return Verifier(bytecode).run();
+}
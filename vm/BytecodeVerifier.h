@@ -0,0 +1,29 @@
+#ifndef BYTECODE_VERIFIER_H
+#define BYTECODE_VERIFIER_H
+
+#include "Bytecode.h"
+
+class BytecodeVerifier {
+ public:
+  struct Result {
+    bool verified = false;
+    // Deepest operand stack of a single frame, the top level included.
+    size_t maxFrameStackHeight = 0;
+    // Deepest operand stack of the whole program across nested calls. Only
+    // known when no function can reach itself through calls.
+    bool recursive = false;
+    size_t maxStackHeight = 0;
+  };
+
+  // Checks linked bytecode before it runs: every instruction decodes inside
+  // the program, jumps land on instruction starts of the same function, slot
+  // and global operands are inside their frames, scalar slots are never
+  // declared as arrays, calls match the arity and frame size of their
+  // target, and the operand stack has the same depth on every path into an
+  // instruction, never underflows and holds exactly the result at RETURN.
+  // A verified program can run without per-instruction checks. Returns an
+  // unverified result and reports the first problem otherwise.
+  static Result verify(BytecodeView bytecode);
+};
+
+#endif // BYTECODE_VERIFIER_H
@@ -1,53 +1,124 @@
 #include "GarbageCollector.h"
-#include <sstream>
+#include <algorithm>
 
-GarbageCollector::GarbageCollector(std::unordered_map<std::string, Value>& storage,
+GarbageCollector::GarbageCollector(Slots& storage,
                                    std::vector<int64_t>& stack,
-                                   std::stack<std::unordered_map<std::string, Value>>& scopes)
-    : storage(storage), stack(stack), scopes(scopes) {}
+                                   ArrayHeap& heap,
+                                   const size_t& liveSlots)
+    : storage(storage), stack(stack), heap(heap), liveSlots(liveSlots) {
+  heap.setKeptLimit(kDefaultBudgetBytes + kNurseryBytes);
+}
 
-void GarbageCollector::collect() {
-  std::unordered_set<std::string> marked;
-  mark(marked);
+// Garbage grows to about a nursery plus the budget before it is collected,
+// so keeping that much for reuse does not raise the peak.
+void GarbageCollector::setBudget(size_t bytes) {
+  budgetBytes = bytes;
+  nextCollection = heap.promotedBytes() + bytes;
+  heap.setKeptLimit(bytes + kNurseryBytes);
+}
 
-  std::vector<std::string> removedItems;
-  sweep(marked, removedItems);
+void GarbageCollector::setSweepThreads(size_t threads) {
+  workers = threads > 0 ? std::make_unique<SweepWorkers>(threads) : nullptr;
 }
 
-void GarbageCollector::cleanup() {
-  storage.clear();
-  stack.clear();
-  while (!scopes.empty()) {
-    scopes.pop();
+void GarbageCollector::step() {
+  if (!timePauses) {
+    advance();
+    return;
+  }
+  auto start = std::chrono::steady_clock::now();
+  if (advance()) {
+    auto pause = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+    pauses.record(pause.count());
   }
 }
 
-void GarbageCollector::mark(std::unordered_set<std::string>& marked) {
-  for (const auto& value : stack) {
-    marked.insert(std::to_string(value));
+bool GarbageCollector::advance() {
+  switch (phase) {
+    case Phase::Idle: {
+      // A running major collection takes care of the young arrays too.
+      bool minor = heap.youngBytes() >= kNurseryBytes;
+      if (minor) {
+        minorCollection();
+      }
+      if (heap.promotedBytes() < nextCollection) {
+        return minor;
+      }
+      phase = Phase::Marking;
+      markCursor = 0;
+      heap.beginMarking();
+      break;
+    }
+    case Phase::Marking:
+      if (markStep()) {
+        phase = Phase::Sweeping;
+        heap.beginSweep();
+      }
+      break;
+    case Phase::Sweeping: {
+      // The workers are woken once per collection, not once per step.
+      if (heap.sweepStep(kStepWork, workers ? &released : nullptr)) {
+        if (!released.empty()) {
+          workers->release(released);
+        }
+        finishCollection();
+      }
+      break;
+    }
   }
+  return true;
+}
 
-  for (const auto& [key, val] : storage) {
-    marked.insert(key);
-  }
+void GarbageCollector::cleanup() {
+  storage.clear();
+  stack.clear();
+  heap.clear();
+  phase = Phase::Idle;
+  nextCollection = heap.promotedBytes() + budgetBytes;
+}
 
-  std::stack<std::unordered_map<std::string, Value>> tempScopes = scopes;
-  while (!tempScopes.empty()) {
-    const auto& scope = tempScopes.top();
-    for (const auto& [key, val] : scope) {
-      marked.insert(key);
+void GarbageCollector::minorCollection() {
+  size_t roots = std::min(liveSlots, storage.size());
+  for (size_t slot = 0; slot < roots; ++slot) {
+    if (storage[slot].isArray()) {
+      heap.markYoung(storage[slot].asArray());
     }
-    tempScopes.pop();
   }
+  heap.sweepYoung();
+  ++minorCollections;
 }
 
-void GarbageCollector::sweep(const std::unordered_set<std::string>& marked, std::vector<std::string>& removedItems) {
-  for (auto it = storage.begin(); it != storage.end();) {
-    if (marked.find(it->first) == marked.end()) {
-      removedItems.push_back(it->first);
-      it = storage.erase(it);
-    } else {
-      ++it;
+// The roots are the slots of the live frames; the operand stack only ever
+// holds integers. Slots past liveSlots belong to frames that already
+// returned, so arrays referenced only from there are garbage. The frame
+// stack may grow and shrink between steps; the heap's barrier marks what
+// is copied below the cursor meanwhile, and call arguments only ever move
+// to higher slots.
+bool GarbageCollector::markStep() {
+  size_t end = std::min({liveSlots, storage.size(), markCursor + kStepWork});
+  for (; markCursor < end; ++markCursor) {
+    if (storage[markCursor].isArray()) {
+      heap.mark(storage[markCursor].asArray());
     }
   }
-}
\ No newline at end of file
+  return markCursor >= std::min(liveSlots, storage.size());
+}
+
+void GarbageCollector::finishCollection() {
+  ++majorCollections;
+  phase = Phase::Idle;
+  nextCollection = heap.promotedBytes() + std::max(budgetBytes, heap.liveBytes());
+}
+
+GcStats GarbageCollector::getStats() const {
+  GcStats stats;
+  stats.minorCollections = minorCollections;
+  stats.majorCollections = majorCollections;
+  stats.allocations = heap.allocations();
+  stats.allocatedBytes = heap.allocatedBytes();
+  stats.reclaimedBytes = heap.freedBytes();
+  stats.promotedBytes = heap.promotedBytes();
+  stats.peakLiveBytes = heap.peakLiveBytes();
+  stats.pauses = pauses;
+  return stats;
+}
@@ -1,33 +1,78 @@
 #ifndef GARBAGE_COLLECTOR_H
 #define GARBAGE_COLLECTOR_H
 
-#include <unordered_map>
-#include <unordered_set>
-#include <string>
-#include <variant>
 #include <vector>
 #include <iostream>
 #include <chrono>
-#include <stack>
-
-using Value = std::variant<int64_t, std::vector<int64_t>>;
+#include <memory>
+#include "ArrayHeap.h"
+#include "GcStats.h"
+#include "SweepWorkers.h"
+#include "Value.h"
 
+// Generational, incremental mark and sweep over the ArrayHeap.
+//
+// Once kNurseryBytes were allocated, a minor collection scans the live
+// slots and sweeps only the arrays allocated since the previous one, so its
+// cost follows the young arrays and not the size of the heap. Survivors are
+// promoted to the old generation.
+//
+// A major collection starts once the budget (or as many bytes as are live,
+// if that is more) was promoted since the previous one ended. It runs as a
+// series of steps, one around each allocation, and every step visits at most
+// kStepWork slots or heap handles, so no single pause grows with the heap.
+//
+// Arrays hold no handles, so marking is only the root scan and needs no
+// remark: the heap marks every array shared while it runs. With sweep
+// threads, the sweep hands the buffers of dead arrays it does not keep to
+// SweepWorkers and the interpreter thread only flips bits.
 class GarbageCollector {
  public:
-  GarbageCollector(std::unordered_map<std::string, Value>& storage,
+  static constexpr size_t kNurseryBytes = size_t{2} << 20;
+  static constexpr size_t kDefaultBudgetBytes = size_t{8} << 20;
+  static constexpr size_t kStepWork = 4096;
+
+  GarbageCollector(Slots& storage,
                    std::vector<int64_t>& stack,
-                   std::stack<std::unordered_map<std::string, Value>>& scopes);
+                   ArrayHeap& heap,
+                   const size_t& liveSlots);
 
-  void collect();
+  void setBudget(size_t bytes);
+  // 0 frees swept arrays on the interpreter thread.
+  void setSweepThreads(size_t threads);
+  // Called around every allocation.
+  void step();
   void cleanup();
 
+  // Pauses are only timed once enabled: reading the clock costs more than
+  // a step that has nothing to do.
+  void enableStats() { timePauses = true; }
+  [[nodiscard]] GcStats getStats() const;
+
  private:
-  std::unordered_map<std::string, Value>& storage;
+  enum class Phase { Idle, Marking, Sweeping };
+
+  Slots& storage;
   std::vector<int64_t>& stack;
-  std::stack<std::unordered_map<std::string, Value>>& scopes;
+  ArrayHeap& heap;
+  const size_t& liveSlots;
+
+  Phase phase = Phase::Idle;
+  size_t markCursor = 0;
+  size_t budgetBytes = kDefaultBudgetBytes;
+  size_t nextCollection = kDefaultBudgetBytes;
+  std::unique_ptr<SweepWorkers> workers;
+  std::vector<std::vector<int64_t>> released;
+  bool timePauses = false;
+  uint64_t minorCollections = 0;
+  uint64_t majorCollections = 0;
+  PauseHistogram pauses;
 
-  void mark(std::unordered_set<std::string>& marked);
-  void sweep(const std::unordered_set<std::string>& marked, std::vector<std::string>& removedItems);
+  // Returns false when there was nothing to do.
+  bool advance();
+  void minorCollection();
+  bool markStep();
+  void finishCollection();
 };
 
-#endif // GARBAGE_COLLECTOR_H
\ No newline at end of file
+#endif // GARBAGE_COLLECTOR_H
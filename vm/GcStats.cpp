@@ -0,0 +1,80 @@
+#include "GcStats.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+void PauseHistogram::record(uint64_t nanoseconds) {
+  ++buckets_[bucketOf(nanoseconds)];
+  ++count_;
+  total_ += nanoseconds;
+  max_ = std::max(max_, nanoseconds);
+}
+
+uint64_t PauseHistogram::percentile(double percent) const {
+  if (count_ == 0) {
+    return 0;
+  }
+  auto rank = static_cast<uint64_t>(std::ceil(percent / 100 * static_cast<double>(count_)));
+  rank = std::clamp<uint64_t>(rank, 1, count_);
+
+  uint64_t seen = 0;
+  for (size_t bucket = 0; bucket < kBuckets; ++bucket) {
+    seen += buckets_[bucket];
+    if (seen >= rank) {
+      return std::min(upperBound(bucket), max_);
+    }
+  }
+  return max_;
+}
+
+// Values below 2 * kSubBuckets get a bucket each. Above, the bucket is the
+// power of two plus the two bits after the leading one.
+size_t PauseHistogram::bucketOf(uint64_t nanoseconds) {
+  if (nanoseconds < kSubBuckets) {
+    return nanoseconds;
+  }
+  auto width = static_cast<size_t>(std::bit_width(nanoseconds));
+  size_t sub = (nanoseconds >> (width - 3)) & (kSubBuckets - 1);
+  return kSubBuckets * (width - 2) + sub;
+}
+
+uint64_t PauseHistogram::upperBound(size_t bucket) {
+  if (bucket < kSubBuckets) {
+    return bucket;
+  }
+  size_t shift = bucket / kSubBuckets - 1;
+  uint64_t lower = (kSubBuckets + bucket % kSubBuckets) << shift;
+  return lower + (uint64_t{1} << shift) - 1;
+}
+
+void GcStats::print(std::ostream& out) const {
+  auto micro = [](uint64_t nanoseconds) { return static_cast<double>(nanoseconds) / 1000; };
+  out << "GC statistics:\n"
+      << "  collections: " << minorCollections << " minor, " << majorCollections << " major\n"
+      << "  allocated:   " << allocations << " arrays, " << allocatedBytes << " bytes\n"
+      << "  reclaimed:   " << reclaimedBytes << " bytes\n"
+      << "  promoted:    " << promotedBytes << " bytes\n"
+      << "  peak live:   " << peakLiveBytes << " bytes\n"
+      << "  pauses:      " << pauses.count() << ", total " << micro(pauses.totalNanoseconds()) << " us"
+      << ", p50 " << micro(pauses.percentile(50)) << " us"
+      << ", p99 " << micro(pauses.percentile(99)) << " us"
+      << ", max " << micro(pauses.maxNanoseconds()) << " us\n";
+}
+
+void GcStats::printJson(std::ostream& out) const {
+  out << "{\"gc\": {"
+      << "\"minor_collections\": " << minorCollections
+      << ", \"major_collections\": " << majorCollections
+      << ", \"allocations\": " << allocations
+      << ", \"allocated_bytes\": " << allocatedBytes
+      << ", \"reclaimed_bytes\": " << reclaimedBytes
+      << ", \"promoted_bytes\": " << promotedBytes
+      << ", \"peak_live_bytes\": " << peakLiveBytes
+      << ", \"pauses\": {"
+      << "\"count\": " << pauses.count()
+      << ", \"total_ns\": " << pauses.totalNanoseconds()
+      << ", \"p50_ns\": " << pauses.percentile(50)
+      << ", \"p99_ns\": " << pauses.percentile(99)
+      << ", \"max_ns\": " << pauses.maxNanoseconds()
+      << "}}}\n";
+}
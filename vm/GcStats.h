@@ -0,0 +1,52 @@
+#ifndef GC_STATS_H
+#define GC_STATS_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+// Collector pauses in a log-linear histogram: four buckets per power of
+// two nanoseconds, so a percentile is off by at most a quarter and no
+// sample is kept.
+class PauseHistogram {
+ public:
+  void record(uint64_t nanoseconds);
+
+  [[nodiscard]] uint64_t count() const { return count_; }
+  [[nodiscard]] uint64_t totalNanoseconds() const { return total_; }
+  [[nodiscard]] uint64_t maxNanoseconds() const { return max_; }
+  // Upper bound of the bucket holding the given percentile (0 to 100).
+  [[nodiscard]] uint64_t percentile(double percent) const;
+
+ private:
+  static constexpr size_t kSubBuckets = 4;
+  static constexpr size_t kBuckets = 64 * kSubBuckets;
+
+  static size_t bucketOf(uint64_t nanoseconds);
+  static uint64_t upperBound(size_t bucket);
+
+  std::array<uint64_t, kBuckets> buckets_{};
+  uint64_t count_ = 0;
+  uint64_t total_ = 0;
+  uint64_t max_ = 0;
+};
+
+// What the garbage collector did during a run. A pause is one collector
+// step that did work: a minor collection, or a slice of a major one.
+struct GcStats {
+  uint64_t minorCollections = 0;
+  uint64_t majorCollections = 0;
+  uint64_t allocations = 0;
+  size_t allocatedBytes = 0;
+  size_t reclaimedBytes = 0;
+  size_t promotedBytes = 0;
+  size_t peakLiveBytes = 0;
+  PauseHistogram pauses;
+
+  void print(std::ostream& out) const;
+  // One JSON object on a single line.
+  void printJson(std::ostream& out) const;
+};
+
+#endif // GC_STATS_H
@@ -0,0 +1,41 @@
+#include "MemoTable.h"
+#include <iomanip>
+#include <utility>
+
+std::optional<int64_t> MemoTable::find(const std::vector<int64_t>& arguments) {
+  auto it = results_.find(arguments);
+  if (it == results_.end()) {
+    ++misses_;
+    return std::nullopt;
+  }
+  ++hits_;
+  return it->second;
+}
+
+void MemoTable::insert(std::vector<int64_t> arguments, int64_t result) {
+  results_.insert_or_assign(std::move(arguments), result);
+}
+
+void MemoTable::print(std::ostream& out, const std::string& function) const {
+  uint64_t lookups = hits_ + misses_;
+  double hitRate = lookups == 0 ? 0 : 100.0 * static_cast<double>(hits_) / static_cast<double>(lookups);
+  std::ios_base::fmtflags flags = out.flags();
+  std::streamsize precision = out.precision();
+  out << "  " << function << ": " << hits_ << " hits, " << misses_ << " misses (" << std::fixed
+      << std::setprecision(1) << hitRate << "% hit rate), " << results_.size() << " entries\n";
+  out.flags(flags);
+  out.precision(precision);
+}
+
+// Mixes each argument in with the multiply and xor-shift of splitmix64, so
+// small consecutive arguments do not land in consecutive buckets.
+size_t MemoTable::Hash::operator()(const std::vector<int64_t>& arguments) const {
+  uint64_t hash = arguments.size();
+  for (int64_t argument : arguments) {
+    hash ^= static_cast<uint64_t>(argument) + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ull;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebull;
+    hash ^= hash >> 31;
+  }
+  return hash;
+}
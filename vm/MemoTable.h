@@ -0,0 +1,40 @@
+#ifndef MEMO_TABLE_H
+#define MEMO_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Results of one memoized function, keyed by its arguments in order. Both
+// VMs and the JIT runtime keep one table per function and look every call
+// up before running it; only a miss runs the body, whose result is then
+// inserted. A table never evicts, so it grows with the distinct argument
+// tuples the program calls the function with.
+class MemoTable {
+ public:
+  // The cached result for the arguments, if any. Counts a hit or a miss.
+  std::optional<int64_t> find(const std::vector<int64_t>& arguments);
+  void insert(std::vector<int64_t> arguments, int64_t result);
+
+  [[nodiscard]] uint64_t hits() const { return hits_; }
+  [[nodiscard]] uint64_t misses() const { return misses_; }
+  [[nodiscard]] size_t size() const { return results_.size(); }
+
+  // One line of statistics for the function, indented under a heading.
+  void print(std::ostream& out, const std::string& function) const;
+
+ private:
+  struct Hash {
+    size_t operator()(const std::vector<int64_t>& arguments) const;
+  };
+
+  std::unordered_map<std::vector<int64_t>, int64_t, Hash> results_;
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+};
+
+#endif // MEMO_TABLE_H
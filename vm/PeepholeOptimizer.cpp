@@ -0,0 +1,362 @@
+#include "PeepholeOptimizer.h"
+#include <algorithm>
+#include <array>
+#include <vector>
+
+namespace {
+
+struct Instruction {
+  // Offset in the bytecode being optimized. The operands stay there; a
+  // rewrite only changes the opcode and keeps a prefix of them.
+  size_t offset;
+  OpCode op;
+  size_t length;
+  // Index of the instruction a jump lands on, or of the first instruction
+  // after the body of a FUNC_DEF.
+  size_t target = 0;
+  bool removed = false;
+};
+
+// Position of the operand that holds the jump target, or 0 if there is none.
+size_t targetOperand(OpCode op) {
+  switch (op) {
+    case OpCode::JUMP:
+    case OpCode::JUMP_IF_FALSE:
+    case OpCode::JUMP_IF_NOT_EQUALS:
+    case OpCode::JUMP_IF_NOT_LESS_THAN:
+    case OpCode::JUMP_IF_NOT_GREATER_THAN:
+    case OpCode::JUMP_IF_NOT_LESS_THAN_OR_EQUAL:
+    case OpCode::JUMP_IF_NOT_GREATER_THAN_OR_EQUAL:
+      return 1;
+    case OpCode::FOR_LOOP:
+      return 4;
+    default:
+      return 0;
+  }
+}
+
+class Program;
+
+using Window = std::array<size_t, 2>;
+
+// A rule for a window of consecutive instructions: the opcodes it starts
+// from and a rewrite that checks their operands and returns false if it
+// does not apply after all.
+struct Pattern {
+  std::array<OpCode, 2> ops;
+  size_t width;
+  bool (*rewrite)(Program& program, const Window& window);
+};
+
+class Program {
+ public:
+  explicit Program(Bytecode& bytecode) : code_(bytecode) {
+    std::vector<size_t> offsets;
+    for (size_t pc = 0; pc < code_.size(); pc += instructionLength(&code_[pc])) {
+      offsets.push_back(pc);
+      instructions_.push_back({pc, static_cast<OpCode>(code_[pc]), instructionLength(&code_[pc])});
+    }
+    offsets.push_back(code_.size());
+
+    auto indexOf = [&](int64_t offset) {
+      return static_cast<size_t>(std::lower_bound(offsets.begin(), offsets.end(), offset) - offsets.begin());
+    };
+    for (Instruction& instruction : instructions_) {
+      if (size_t operand = targetOperand(instruction.op)) {
+        instruction.target = indexOf(code_[instruction.offset + operand]);
+      } else if (instruction.op == OpCode::FUNC_DEF) {
+        instruction.target = indexOf(instruction.offset + instruction.length + code_[instruction.offset + 4]);
+      }
+    }
+  }
+
+  void optimize();
+  size_t encode();
+
+  [[nodiscard]] int64_t operand(size_t index, size_t position) const {
+    return code_[instructions_[index].offset + position];
+  }
+
+  void rewrite(size_t index, OpCode op, size_t length) {
+    instructions_[index].op = op;
+    instructions_[index].length = length;
+  }
+
+  // Only for positions the instruction had before it was rewritten.
+  void setOperand(size_t index, size_t position, int64_t value) {
+    code_[instructions_[index].offset + position] = value;
+  }
+
+  void remove(size_t index) {
+    instructions_[index].removed = true;
+    // Whatever jumped here now lands on the next instruction.
+    if (targets_[index]) {
+      targets_[live(index + 1)] = true;
+    }
+  }
+
+ private:
+  // The first instruction at or after the index that is not removed. Where
+  // a jump lands once the instructions it pointed at are gone.
+  [[nodiscard]] size_t live(size_t index) const {
+    while (index < instructions_.size() && instructions_[index].removed) {
+      ++index;
+    }
+    return index;
+  }
+
+  void markTargets();
+  bool applyPatterns();
+  bool threadJumps();
+  bool removeJumpsToNext();
+  bool removeUnreachable();
+
+  Bytecode& code_;
+  std::vector<Instruction> instructions_;
+  // Instructions control can reach other than from the one before them.
+  // Sized one past the end, where a function that is last can end.
+  std::vector<bool> targets_;
+};
+
+// x = e; x  ->  STORE_SLOT_KEEP x
+bool storeThenLoad(Program& program, const Window& window) {
+  if (program.operand(window[0], 1) != program.operand(window[1], 1)) return false;
+  program.rewrite(window[0], OpCode::STORE_SLOT_KEEP, 2);
+  program.remove(window[1]);
+  return true;
+}
+
+// x = x
+bool loadThenStore(Program& program, const Window& window) {
+  if (program.operand(window[0], 1) != program.operand(window[1], 1)) return false;
+  program.remove(window[0]);
+  program.remove(window[1]);
+  return true;
+}
+
+// e + 0, e - 0, e * 1, e / 1
+template <int64_t Identity>
+bool identityOperand(Program& program, const Window& window) {
+  if (program.operand(window[0], 1) != Identity) return false;
+  program.remove(window[0]);
+  program.remove(window[1]);
+  return true;
+}
+
+// x + 0 with the operands fused
+bool addSlotZero(Program& program, const Window& window) {
+  if (program.operand(window[0], 2) != 0) return false;
+  program.rewrite(window[0], OpCode::LOAD_SLOT, 2);
+  return true;
+}
+
+// e / 2^k, e % 2^k
+template <OpCode Shifted>
+bool powerOfTwoDivisor(Program& program, const Window& window) {
+  int64_t shift = powerOfTwoShift(program.operand(window[0], 1));
+  if (!shift) return false;
+  program.rewrite(window[0], Shifted, 2);
+  program.setOperand(window[0], 1, shift);
+  program.remove(window[1]);
+  return true;
+}
+
+// A branch on a constant either always jumps or never does.
+bool constantBranch(Program& program, const Window& window) {
+  bool jumps = program.operand(window[0], 1) == 0;
+  program.remove(window[0]);
+  if (jumps) {
+    program.rewrite(window[1], OpCode::JUMP, 2);
+  } else {
+    program.remove(window[1]);
+  }
+  return true;
+}
+
+const Pattern kPatterns[] = {
+    {{OpCode::STORE_SLOT, OpCode::LOAD_SLOT}, 2, storeThenLoad},
+    {{OpCode::LOAD_SLOT, OpCode::STORE_SLOT}, 2, loadThenStore},
+    {{OpCode::LOAD_CONST, OpCode::ADD}, 2, identityOperand<0>},
+    {{OpCode::LOAD_CONST, OpCode::SUBTRACT}, 2, identityOperand<0>},
+    {{OpCode::LOAD_CONST, OpCode::MULTIPLY}, 2, identityOperand<1>},
+    {{OpCode::LOAD_CONST, OpCode::DIVIDE}, 2, identityOperand<1>},
+    {{OpCode::LOAD_CONST, OpCode::DIVIDE}, 2, powerOfTwoDivisor<OpCode::DIVIDE_POW2>},
+    {{OpCode::LOAD_CONST, OpCode::MODULO}, 2, powerOfTwoDivisor<OpCode::MODULO_POW2>},
+    {{OpCode::ADD_SLOT_CONST}, 1, addSlotZero},
+    {{OpCode::LOAD_CONST, OpCode::JUMP_IF_FALSE}, 2, constantBranch},
+};
+
+void Program::optimize() {
+  bool changed = true;
+  while (changed) {
+    markTargets();
+    changed = applyPatterns();
+    changed |= threadJumps();
+    changed |= removeJumpsToNext();
+    changed |= removeUnreachable();
+  }
+}
+
+void Program::markTargets() {
+  targets_.assign(instructions_.size() + 1, false);
+  targets_[0] = true;
+  for (size_t i = 0; i < instructions_.size(); ++i) {
+    const Instruction& instruction = instructions_[i];
+    if (instruction.removed) continue;
+    if (targetOperand(instruction.op)) {
+      targets_[live(instruction.target)] = true;
+    } else if (instruction.op == OpCode::FUNC_DEF) {
+      targets_[i + 1] = true;
+      targets_[live(instruction.target)] = true;
+    }
+  }
+}
+
+// A window never runs past an instruction control can enter from elsewhere,
+// so every path through the window executes all of it.
+bool Program::applyPatterns() {
+  bool changed = false;
+  for (size_t i = live(0); i < instructions_.size(); i = live(i + 1)) {
+    Window window = {i, live(i + 1)};
+    for (const Pattern& pattern : kPatterns) {
+      if (instructions_[i].op != pattern.ops[0]) continue;
+      if (pattern.width == 2 && (window[1] == instructions_.size() || targets_[window[1]] ||
+                                 instructions_[window[1]].op != pattern.ops[1])) {
+        continue;
+      }
+      if (pattern.rewrite(*this, window)) {
+        changed = true;
+        break;
+      }
+    }
+  }
+  return changed;
+}
+
+bool Program::threadJumps() {
+  bool changed = false;
+  for (Instruction& instruction : instructions_) {
+    if (instruction.removed || !targetOperand(instruction.op)) continue;
+    size_t target = live(instruction.target);
+    // Bounded, since a chain of jumps can be a loop.
+    for (size_t steps = 0; steps < instructions_.size() && target < instructions_.size() &&
+                           instructions_[target].op == OpCode::JUMP;
+         ++steps) {
+      target = live(instructions_[target].target);
+    }
+    if (target != live(instruction.target)) {
+      instruction.target = target;
+      changed = true;
+    }
+    if (instruction.op == OpCode::JUMP && target < instructions_.size() &&
+        (instructions_[target].op == OpCode::RETURN || instructions_[target].op == OpCode::HALT)) {
+      instruction.op = instructions_[target].op;
+      instruction.length = 1;
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+bool Program::removeJumpsToNext() {
+  bool changed = false;
+  for (size_t i = 0; i < instructions_.size(); ++i) {
+    const Instruction& instruction = instructions_[i];
+    if (!instruction.removed && instruction.op == OpCode::JUMP && live(instruction.target) == live(i + 1)) {
+      remove(i);
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+// Function bodies are only entered through calls, so every entry is a root,
+// and every header is kept so the linker still finds the function.
+bool Program::removeUnreachable() {
+  std::vector<bool> reached(instructions_.size(), false);
+  std::vector<size_t> worklist = {live(0)};
+  for (size_t i = 0; i < instructions_.size(); ++i) {
+    if (!instructions_[i].removed && instructions_[i].op == OpCode::FUNC_DEF) {
+      worklist.push_back(i);
+      worklist.push_back(live(i + 1));
+    }
+  }
+
+  while (!worklist.empty()) {
+    size_t i = worklist.back();
+    worklist.pop_back();
+    if (i >= instructions_.size() || reached[i]) continue;
+    reached[i] = true;
+    const Instruction& instruction = instructions_[i];
+    switch (instruction.op) {
+      case OpCode::JUMP:
+        worklist.push_back(live(instruction.target));
+        break;
+      case OpCode::RETURN:
+      case OpCode::HALT:
+        break;
+      case OpCode::FUNC_DEF:
+        worklist.push_back(live(instruction.target));
+        break;
+      default:
+        if (targetOperand(instruction.op)) {
+          worklist.push_back(live(instruction.target));
+        }
+        worklist.push_back(live(i + 1));
+        break;
+    }
+  }
+
+  bool changed = false;
+  for (size_t i = 0; i < instructions_.size(); ++i) {
+    if (!instructions_[i].removed && !reached[i]) {
+      instructions_[i].removed = true;
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+// Writes the remaining instructions back, with every target moved to where
+// the instruction it lands on ends up. Returns how many were removed.
+size_t Program::encode() {
+  std::vector<int64_t> offsets(instructions_.size() + 1);
+  int64_t offset = 0;
+  for (size_t i = 0; i < instructions_.size(); ++i) {
+    offsets[i] = offset;
+    if (!instructions_[i].removed) {
+      offset += static_cast<int64_t>(instructions_[i].length);
+    }
+  }
+  offsets[instructions_.size()] = offset;
+
+  Bytecode optimized;
+  optimized.reserve(static_cast<size_t>(offset));
+  size_t removed = 0;
+  for (size_t i = 0; i < instructions_.size(); ++i) {
+    const Instruction& instruction = instructions_[i];
+    if (instruction.removed) {
+      ++removed;
+      continue;
+    }
+    size_t start = optimized.size();
+    optimized.push_back(static_cast<int64_t>(instruction.op));
+    optimized.insert(optimized.end(), code_.begin() + static_cast<std::ptrdiff_t>(instruction.offset + 1),
+                     code_.begin() + static_cast<std::ptrdiff_t>(instruction.offset + instruction.length));
+    if (size_t operand = targetOperand(instruction.op)) {
+      optimized[start + operand] = offsets[instruction.target];
+    } else if (instruction.op == OpCode::FUNC_DEF) {
+      optimized[start + 4] = offsets[instruction.target] - offsets[i] - static_cast<int64_t>(instruction.length);
+    }
+  }
+  code_ = std::move(optimized);
+  return removed;
+}
+
+}  // namespace
+
+size_t PeepholeOptimizer::optimize(Bytecode& bytecode) {
+  Program program(bytecode);
+  program.optimize();
+  return program.encode();
+}
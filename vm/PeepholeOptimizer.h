@@ -0,0 +1,20 @@
+#ifndef PEEPHOLE_OPTIMIZER_H
+#define PEEPHOLE_OPTIMIZER_H
+
+#include <cstddef>
+#include "Bytecode.h"
+
+class PeepholeOptimizer {
+ public:
+  // Rewrites unlinked stack bytecode in place until none of its rules apply:
+  //  - the window patterns in PeepholeOptimizer.cpp, such as a store followed
+  //    by a load of the same slot or an addition of the constant 0,
+  //  - jumps to a JUMP go straight to its target, and a JUMP to RETURN or
+  //    HALT becomes that instruction,
+  //  - jumps to the next instruction and code no path reaches are removed.
+  // Jump targets and function lengths are fixed up afterwards. Returns the
+  // number of instructions removed.
+  static size_t optimize(Bytecode& bytecode);
+};
+
+#endif // PEEPHOLE_OPTIMIZER_H
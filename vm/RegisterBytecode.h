@@ -0,0 +1,152 @@
+#ifndef REGISTER_BYTECODE_H
+#define REGISTER_BYTECODE_H
+
+#include <cstdint>
+#include <initializer_list>
+#include <span>
+#include <vector>
+
+// Three-address instruction stream for the register VM. Same layout as the
+// stack bytecode: an opcode word followed by its operands inline, with jump
+// targets and function entries as word offsets.
+//
+// Registers are frame slots: a function's parameters and locals come first,
+// then the temporaries the converter allocated for sub-expressions, so a
+// variable is read in place instead of being pushed on a stack. Top-level
+// code runs in the bottom frame, whose named slots are the globals; functions
+// reach globals through the *_GLOBAL instructions. Function bodies follow the
+// top-level HALT.
+enum class RegOp : int64_t {
+  RESERVE_SLOTS,         // slot count, emitted once at the start of the program
+  LOAD_CONST,            // dst, value
+  MOVE,                  // dst, src
+  LOAD_GLOBAL,           // dst, global slot
+  STORE_GLOBAL,          // global slot, src
+  DECLARE_ARRAY,         // dst, size, size * element
+  LOAD_ELEMENT,          // dst, array, index
+  STORE_ELEMENT,         // array, index, src
+  LOAD_GLOBAL_ELEMENT,   // dst, global array slot, index
+  STORE_GLOBAL_ELEMENT,  // global array slot, index, src
+  // The element accesses above, for an index the compiler proved to be
+  // inside the array: they skip the bounds check.
+  LOAD_ELEMENT_UNCHECKED,          // dst, array, index
+  STORE_ELEMENT_UNCHECKED,         // array, index, src
+  LOAD_GLOBAL_ELEMENT_UNCHECKED,   // dst, global array slot, index
+  STORE_GLOBAL_ELEMENT_UNCHECKED,  // global array slot, index, src
+  ADD,                   // dst, lhs, rhs
+  SUBTRACT,              // dst, lhs, rhs
+  MULTIPLY,              // dst, lhs, rhs
+  DIVIDE,                // dst, lhs, rhs
+  MODULO,                // dst, lhs, rhs
+  ADD_CONST,             // dst, src, value
+  DIVIDE_POW2,           // dst, src, shift: divide by 2^shift
+  MODULO_POW2,           // dst, src, shift: remainder of dividing by 2^shift
+  EQUALS,                // dst, lhs, rhs
+  LESS_THAN,             // dst, lhs, rhs
+  GREATER_THAN,          // dst, lhs, rhs
+  LESS_THAN_OR_EQUAL,    // dst, lhs, rhs
+  GREATER_THAN_OR_EQUAL, // dst, lhs, rhs
+  JUMP,                  // target
+  JUMP_IF_FALSE,         // condition, target
+  JUMP_IF_NOT_EQUALS,    // lhs, rhs, target
+  JUMP_IF_NOT_LESS_THAN, // lhs, rhs, target
+  JUMP_IF_NOT_GREATER_THAN,           // lhs, rhs, target
+  JUMP_IF_NOT_LESS_THAN_OR_EQUAL,     // lhs, rhs, target
+  JUMP_IF_NOT_GREATER_THAN_OR_EQUAL,  // lhs, rhs, target
+  FOR_LOOP,              // iterator, step, limit, target: add step to iterator, jump to target while it is < limit
+  CALL,                  // dst, entry, frame size, first argument, argument count
+  CALL_MEMO,             // dst, entry, frame size, first argument, argument count, function id: CALL through the function's memo table
+  RETURN,                // src
+  RETURN_VOID,
+  PRINT,                 // src
+  HALT,                  // end of the top level
+  COUNT
+};
+
+using RegisterBytecode = std::vector<int64_t>;
+using RegisterBytecodeView = std::span<const int64_t>;
+
+inline const char* opcodeName(RegOp op) {
+  switch (op) {
+    case RegOp::RESERVE_SLOTS: return "RESERVE_SLOTS";
+    case RegOp::LOAD_CONST: return "LOAD_CONST";
+    case RegOp::MOVE: return "MOVE";
+    case RegOp::LOAD_GLOBAL: return "LOAD_GLOBAL";
+    case RegOp::STORE_GLOBAL: return "STORE_GLOBAL";
+    case RegOp::DECLARE_ARRAY: return "DECLARE_ARRAY";
+    case RegOp::LOAD_ELEMENT: return "LOAD_ELEMENT";
+    case RegOp::STORE_ELEMENT: return "STORE_ELEMENT";
+    case RegOp::LOAD_GLOBAL_ELEMENT: return "LOAD_GLOBAL_ELEMENT";
+    case RegOp::STORE_GLOBAL_ELEMENT: return "STORE_GLOBAL_ELEMENT";
+    case RegOp::LOAD_ELEMENT_UNCHECKED: return "LOAD_ELEMENT_UNCHECKED";
+    case RegOp::STORE_ELEMENT_UNCHECKED: return "STORE_ELEMENT_UNCHECKED";
+    case RegOp::LOAD_GLOBAL_ELEMENT_UNCHECKED: return "LOAD_GLOBAL_ELEMENT_UNCHECKED";
+    case RegOp::STORE_GLOBAL_ELEMENT_UNCHECKED: return "STORE_GLOBAL_ELEMENT_UNCHECKED";
+    case RegOp::ADD: return "ADD";
+    case RegOp::SUBTRACT: return "SUBTRACT";
+    case RegOp::MULTIPLY: return "MULTIPLY";
+    case RegOp::DIVIDE: return "DIVIDE";
+    case RegOp::MODULO: return "MODULO";
+    case RegOp::ADD_CONST: return "ADD_CONST";
+    case RegOp::DIVIDE_POW2: return "DIVIDE_POW2";
+    case RegOp::MODULO_POW2: return "MODULO_POW2";
+    case RegOp::EQUALS: return "EQUALS";
+    case RegOp::LESS_THAN: return "LESS_THAN";
+    case RegOp::GREATER_THAN: return "GREATER_THAN";
+    case RegOp::LESS_THAN_OR_EQUAL: return "LESS_THAN_OR_EQUAL";
+    case RegOp::GREATER_THAN_OR_EQUAL: return "GREATER_THAN_OR_EQUAL";
+    case RegOp::JUMP: return "JUMP";
+    case RegOp::JUMP_IF_FALSE: return "JUMP_IF_FALSE";
+    case RegOp::JUMP_IF_NOT_EQUALS: return "JUMP_IF_NOT_EQUALS";
+    case RegOp::JUMP_IF_NOT_LESS_THAN: return "JUMP_IF_NOT_LESS_THAN";
+    case RegOp::JUMP_IF_NOT_GREATER_THAN: return "JUMP_IF_NOT_GREATER_THAN";
+    case RegOp::JUMP_IF_NOT_LESS_THAN_OR_EQUAL: return "JUMP_IF_NOT_LESS_THAN_OR_EQUAL";
+    case RegOp::JUMP_IF_NOT_GREATER_THAN_OR_EQUAL: return "JUMP_IF_NOT_GREATER_THAN_OR_EQUAL";
+    case RegOp::FOR_LOOP: return "FOR_LOOP";
+    case RegOp::CALL: return "CALL";
+    case RegOp::CALL_MEMO: return "CALL_MEMO";
+    case RegOp::RETURN: return "RETURN";
+    case RegOp::RETURN_VOID: return "RETURN_VOID";
+    case RegOp::PRINT: return "PRINT";
+    case RegOp::HALT: return "HALT";
+    case RegOp::COUNT: break;
+  }
+  return "UNKNOWN";
+}
+
+// Number of words (opcode included) taken by the instruction starting at ip.
+inline size_t registerInstructionLength(const int64_t* ip) {
+  switch (static_cast<RegOp>(ip[0])) {
+    case RegOp::RETURN_VOID:
+    case RegOp::HALT:
+      return 1;
+    case RegOp::RESERVE_SLOTS:
+    case RegOp::JUMP:
+    case RegOp::RETURN:
+    case RegOp::PRINT:
+      return 2;
+    case RegOp::LOAD_CONST:
+    case RegOp::MOVE:
+    case RegOp::LOAD_GLOBAL:
+    case RegOp::STORE_GLOBAL:
+    case RegOp::JUMP_IF_FALSE:
+      return 3;
+    case RegOp::DECLARE_ARRAY:
+      return 3 + ip[2];
+    case RegOp::FOR_LOOP:
+      return 5;
+    case RegOp::CALL:
+      return 6;
+    case RegOp::CALL_MEMO:
+      return 7;
+    default:
+      return 4;
+  }
+}
+
+inline void emit(RegisterBytecode& bytecode, RegOp op, std::initializer_list<int64_t> operands = {}) {
+  bytecode.push_back(static_cast<int64_t>(op));
+  bytecode.insert(bytecode.end(), operands.begin(), operands.end());
+}
+
+#endif // REGISTER_BYTECODE_H
@@ -0,0 +1,45 @@
+#include "SweepWorkers.h"
+#include <utility>
+
+SweepWorkers::SweepWorkers(size_t threads) {
+  for (size_t i = 0; i < threads; ++i) {
+    threads_.emplace_back(&SweepWorkers::run, this);
+  }
+}
+
+SweepWorkers::~SweepWorkers() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  queued_.notify_all();
+  for (std::thread& thread : threads_) {
+    thread.join();
+  }
+}
+
+void SweepWorkers::release(std::vector<std::vector<int64_t>>& buffers) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    batches_.push_back(std::move(buffers));
+  }
+  buffers.clear();
+  queued_.notify_one();
+}
+
+void SweepWorkers::run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    queued_.wait(lock, [this] { return stopping_ || !batches_.empty(); });
+    if (batches_.empty()) {
+      return;
+    }
+    std::vector<std::vector<int64_t>> batch = std::move(batches_.front());
+    batches_.pop_front();
+
+    // The buffers are freed when the batch goes out of scope, outside the lock.
+    lock.unlock();
+    batch.clear();
+    lock.lock();
+  }
+}
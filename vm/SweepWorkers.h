@@ -0,0 +1,38 @@
+#ifndef SWEEP_WORKERS_H
+#define SWEEP_WORKERS_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A small pool of threads that free the element buffers of swept arrays.
+// The interpreter thread only decides which arrays are dead; returning
+// their memory to the system, which for large arrays means unmapping
+// pages, happens on the workers.
+class SweepWorkers {
+ public:
+  explicit SweepWorkers(size_t threads);
+  // Frees the buffers still queued, then joins the threads.
+  ~SweepWorkers();
+
+  SweepWorkers(const SweepWorkers&) = delete;
+  SweepWorkers& operator=(const SweepWorkers&) = delete;
+
+  // Queues the buffers for the workers and leaves `buffers` empty.
+  void release(std::vector<std::vector<int64_t>>& buffers);
+
+ private:
+  void run();
+
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable queued_;
+  std::deque<std::vector<std::vector<int64_t>>> batches_;
+  bool stopping_ = false;
+};
+
+#endif // SWEEP_WORKERS_H
@@ -0,0 +1,117 @@
+#ifndef VALUE_H
+#define VALUE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// What a slot holds: an integer (or bool), using all 64 bits, or the handle
+// of an array in the ArrayHeap. In Slots the word and the tag saying which of
+// the two it is are kept apart, so a slot costs one 64-bit word plus a tag
+// byte and no integer loses a bit to the tag.
+class Value {
+ public:
+  Value() = default;
+  // Implicit, so integer results can be stored into a slot directly.
+  Value(int64_t integer) : word_(integer) {}
+
+  static Value array(uint64_t handle) {
+    Value value;
+    value.word_ = static_cast<int64_t>(handle);
+    value.array_ = true;
+    return value;
+  }
+
+  [[nodiscard]] bool isInteger() const { return !array_; }
+  [[nodiscard]] bool isArray() const { return array_; }
+
+  [[nodiscard]] int64_t asInteger() const { return word_; }
+  [[nodiscard]] uint64_t asArray() const { return static_cast<uint64_t>(word_); }
+
+ private:
+  friend class Slots;
+
+  int64_t word_ = 0;
+  bool array_ = false;
+};
+
+// The frame stack's slots: their words in one array and their tags in
+// another. Indexing yields a Ref, which reads and writes both.
+class Slots {
+  // Not a character type, so storing a tag does not make the compiler assume
+  // that any other memory changed.
+  enum class Tag : uint8_t { Integer, Array };
+
+ public:
+  class Ref {
+   public:
+    Ref(int64_t& word, Tag& tag) : word_(word), tag_(tag) {}
+
+    [[nodiscard]] bool isInteger() const { return tag_ == Tag::Integer; }
+    [[nodiscard]] bool isArray() const { return tag_ == Tag::Array; }
+
+    [[nodiscard]] int64_t asInteger() const { return word_; }
+    [[nodiscard]] uint64_t asArray() const { return static_cast<uint64_t>(word_); }
+
+    operator Value() const {
+      Value value;
+      value.word_ = word_;
+      value.array_ = tag_ == Tag::Array;
+      return value;
+    }
+
+    Ref& operator=(const Value& value) {
+      word_ = value.word_;
+      tag_ = value.array_ ? Tag::Array : Tag::Integer;
+      return *this;
+    }
+    Ref& operator=(const Ref& other) {
+      word_ = other.word_;
+      tag_ = other.tag_;
+      return *this;
+    }
+
+   private:
+    int64_t& word_;
+    Tag& tag_;
+  };
+
+  Ref operator[](size_t slot) { return {words_[slot], tags_[slot]}; }
+
+  [[nodiscard]] size_t size() const { return words_.size(); }
+
+  void reserve(size_t slots) {
+    words_.reserve(slots);
+    tags_.reserve(slots);
+  }
+
+  // Slots added by assign and resize, and those reset, hold the integer 0.
+  void assign(size_t slots) {
+    words_.assign(slots, 0);
+    tags_.assign(slots, Tag::Integer);
+  }
+
+  void resize(size_t slots) {
+    words_.resize(slots, 0);
+    tags_.resize(slots, Tag::Integer);
+  }
+
+  // Frames are small, so one loop beats two calls to memset.
+  void reset(size_t begin, size_t end) {
+    for (size_t slot = begin; slot < end; ++slot) {
+      words_[slot] = 0;
+      tags_[slot] = Tag::Integer;
+    }
+  }
+
+  void clear() {
+    words_.clear();
+    tags_.clear();
+  }
+
+ private:
+  std::vector<int64_t> words_;
+  std::vector<Tag> tags_;
+};
+
+#endif // VALUE_H
@@ -1,10 +1,204 @@
 #include "VirtualMachine.h"
+#include <algorithm>
+#include <iterator>
+#include <limits>
 #include <stack>
+#include <utility>
+
+namespace {
+
+// Counts how often each opcode is executed directly after each other opcode.
+// The most frequent pairs are the candidates for superinstructions.
+template <typename Op>
+class OpcodePairProfile {
+ public:
+  void record(int64_t op) {
+    ++executed_;
+    if (previous_ >= 0) {
+      ++counts_[previous_ * kOpCount + op];
+    }
+    previous_ = op;
+  }
+
+  void report(std::ostream& out, size_t limit = 20) const {
+    std::vector<std::pair<uint64_t, size_t>> pairs;
+    for (size_t i = 0; i < counts_.size(); ++i) {
+      if (counts_[i] != 0) {
+        pairs.emplace_back(counts_[i], i);
+      }
+    }
+    std::sort(pairs.begin(), pairs.end(), std::greater<>());
+    pairs.resize(std::min(pairs.size(), limit));
+
+    out << "Executed " << executed_ << " instructions\n";
+    out << "Most frequent opcode pairs:\n";
+    for (const auto& [count, index] : pairs) {
+      out << "  " << opcodeName(static_cast<Op>(index / kOpCount)) << " -> "
+          << opcodeName(static_cast<Op>(index % kOpCount)) << ": " << count << "\n";
+    }
+  }
+
+ private:
+  static constexpr size_t kOpCount = static_cast<size_t>(Op::COUNT);
+  std::vector<uint64_t> counts_ = std::vector<uint64_t>(kOpCount * kOpCount);
+  int64_t previous_ = -1;
+  uint64_t executed_ = 0;
+};
+
+// Operators of the binary handlers, which are instantiated per operator so
+// each one compiles down to the bare instruction inside the dispatch loop.
+// apply() returns false when the result does not fit into 64 bits or is
+// undefined; the checks are only compiled into the Checked variant.
+struct Add {
+  static constexpr const char* kName = "ADD";
+  template <bool Checked>
+  static bool apply(int64_t a, int64_t b, int64_t& result) {
+    if constexpr (Checked) {
+      return !__builtin_add_overflow(a, b, &result);
+    }
+    result = a + b;
+    return true;
+  }
+};
+
+struct Subtract {
+  static constexpr const char* kName = "SUBTRACT";
+  template <bool Checked>
+  static bool apply(int64_t a, int64_t b, int64_t& result) {
+    if constexpr (Checked) {
+      return !__builtin_sub_overflow(a, b, &result);
+    }
+    result = a - b;
+    return true;
+  }
+};
+
+struct Multiply {
+  static constexpr const char* kName = "MULTIPLY";
+  template <bool Checked>
+  static bool apply(int64_t a, int64_t b, int64_t& result) {
+    if constexpr (Checked) {
+      return !__builtin_mul_overflow(a, b, &result);
+    }
+    result = a * b;
+    return true;
+  }
+};
+
+struct Divide {
+  static constexpr const char* kName = "DIVIDE";
+  template <bool Checked>
+  static bool apply(int64_t a, int64_t b, int64_t& result) {
+    if constexpr (Checked) {
+      if (b == 0 || (a == std::numeric_limits<int64_t>::min() && b == -1)) {
+        return false;
+      }
+    }
+    result = a / b;
+    return true;
+  }
+};
+
+struct Modulo {
+  static constexpr const char* kName = "MODULO";
+  template <bool Checked>
+  static bool apply(int64_t a, int64_t b, int64_t& result) {
+    if constexpr (Checked) {
+      if (b == 0 || (a == std::numeric_limits<int64_t>::min() && b == -1)) {
+        return false;
+      }
+    }
+    result = a % b;
+    return true;
+  }
+};
+
+// Comparisons cannot overflow, so both variants are the same.
+#define VM_COMPARISON(Name, label, op)                       \
+  struct Name {                                              \
+    static constexpr const char* kName = label;              \
+    template <bool Checked>                                  \
+    static bool apply(int64_t a, int64_t b, int64_t& result) { \
+      result = a op b;                                       \
+      return true;                                           \
+    }                                                        \
+  };
+
+VM_COMPARISON(Equals, "EQUALS", ==)
+VM_COMPARISON(LessThan, "LESS_THAN", <)
+VM_COMPARISON(GreaterThan, "GREATER_THAN", >)
+VM_COMPARISON(LessThanOrEqual, "LESS_THAN_OR_EQUAL", <=)
+VM_COMPARISON(GreaterThanOrEqual, "GREATER_THAN_OR_EQUAL", >=)
+
+#undef VM_COMPARISON
+
+// DIVIDE and MODULO by 2^shift without a divide. A negative dividend is
+// biased by 2^shift - 1 first, so the quotient still rounds toward zero.
+// Neither can overflow.
+int64_t dividePow2(int64_t a, int64_t shift) {
+  int64_t bias = (a >> 63) & ((int64_t{1} << shift) - 1);
+  return (a + bias) >> shift;
+}
+
+int64_t moduloPow2(int64_t a, int64_t shift) {
+  return a - (dividePow2(a, shift) << shift);
+}
+
+// With MATUR_PL_CHECKED_ARITHMETIC every interpreter uses the overflow-checked
+// variant of the operators and stops at the first result that does not fit.
+#ifdef MATUR_PL_CHECKED_ARITHMETIC
+constexpr bool kCheckedArithmetic = true;
+#else
+constexpr bool kCheckedArithmetic = false;
+#endif
+
+bool reportArithmeticFailure(const char* operation, int64_t a, int64_t b) {
+  std::cerr << operation << " failed: " << a << ", " << b << " has no 64-bit result\n";
+  return false;
+}
+
+template <typename Operation>
+bool applyOperation(int64_t a, int64_t b, int64_t& result) {
+  if (Operation::template apply<kCheckedArithmetic>(a, b, result)) {
+    return true;
+  }
+  return reportArithmeticFailure(Operation::kName, a, b);
+}
+
+}  // namespace
 
 VirtualMachine::VirtualMachine()
-    : operationCount(0), gc(storage, stack, current_name_scope) {}
+    : framePointer(0), frameTop(0), gc(storage, stack, heap, frameTop) {
+  storage.reserve(kFrameStackSlots);
+}
+
+void VirtualMachine::setGcBudget(size_t bytes) {
+  gc.setBudget(bytes);
+}
+
+void VirtualMachine::setGcThreads(size_t threads) {
+  gc.setSweepThreads(threads);
+}
+
+void VirtualMachine::enableGcStats() {
+  gc.enableStats();
+}
+
+GcStats VirtualMachine::getGcStats() const {
+  return gc.getStats();
+}
 
-std::unordered_map<std::string, Value>& VirtualMachine::getStorage() {
+void VirtualMachine::printMemoStats(std::ostream& out) const {
+  out << "Memo statistics:\n";
+  for (size_t function = 0; function < memoTables.size(); ++function) {
+    const MemoTable& table = memoTables[function];
+    if (table.hits() + table.misses() != 0) {
+      table.print(out, "function #" + std::to_string(function));
+    }
+  }
+}
+
+Slots& VirtualMachine::getStorage() {
   return storage;
 };
 
@@ -12,248 +206,1210 @@ std::vector<int64_t>& VirtualMachine::getStack() {
   return stack;
 };
 
-void VirtualMachine::execute(const std::vector<std::tuple<std::string, std::vector<int64_t>>>& bytecode) {
+// Register handlers read and copy slots through these, so they are defined
+// before the interpreters to be inlined there. Copying a slot that holds an
+// array shares the array; it is copied only when one of the slots writes to
+// it (see ArrayHeap::writable).
+inline void VirtualMachine::copySlot(size_t dst, size_t src) {
+  if (storage[dst].isArray()) {
+    heap.release(storage[dst].asArray());
+  }
+  if (storage[src].isArray()) {
+    heap.share(storage[src].asArray());
+  }
+  storage[dst] = storage[src];
+}
+
+inline bool VirtualMachine::readScalar(size_t slot, int64_t& value) {
+  if (storage[slot].isInteger()) {
+    value = storage[slot].asInteger();
+    return true;
+  }
+  return reportNotScalar(slot);
+}
+
+template <typename Operation>
+bool VirtualMachine::binaryOperation() {
+  if (stack.size() < 2) {
+    std::cerr << Operation::kName << " failed: insufficient operands on stack\n";
+    return false;
+  }
+
+  int64_t b = stack.back();
+  stack.pop_back();
+  return applyOperation<Operation>(stack.back(), b, stack.back());
+}
+
+// With MATUR_PL_THREADED_DISPATCH on GCC/Clang every handler jumps straight to
+// the next one through a table of label addresses (one indirect branch per
+// handler instead of one shared by all of them). Otherwise the same handlers
+// are reached through a plain switch.
+#if defined(MATUR_PL_THREADED_DISPATCH) && (defined(__GNUC__) || defined(__clang__))
+#define VM_COMPUTED_GOTO 1
+#endif
+
+// With MATUR_PL_PROFILE_OPCODES every executed opcode is recorded in a pair
+// profile that is printed to stderr when the program halts.
+#ifdef MATUR_PL_PROFILE_OPCODES
+#define VM_PROFILE() profile.record(code[pc])
+#else
+#define VM_PROFILE() ((void)0)
+#endif
+
+// Fused compare-and-branch: pops two operands and jumps to the target when
+// the comparison does not hold.
+#define BRANCH_UNLESS(cmp)                                   \
+  do {                                                       \
+    int64_t lhs, rhs;                                        \
+    if (!popOperands(lhs, rhs)) {                            \
+      return;                                                \
+    }                                                        \
+    pc = (lhs cmp rhs) ? pc + 2 : code[pc + 1];              \
+  } while (0)
+
+#define STACK_BINARY(Operation)              \
+  do {                                       \
+    if (!binaryOperation<Operation>()) {     \
+      return;                                \
+    }                                        \
+    ++pc;                                    \
+  } while (0)
+
+// VM_OPCODE names the opcode enum of the interpreter being defined.
+#define VM_OPCODE OpCode
+
+#ifdef VM_COMPUTED_GOTO
+#define TARGET(op) case VM_OPCODE::op: label_##op
+#define DISPATCH()                       \
+  do {                                   \
+    VM_PROFILE();                        \
+    goto *dispatchTable[code[pc]];       \
+  } while (0)
+#else
+#define TARGET(op) case VM_OPCODE::op
+#define DISPATCH() goto dispatch
+#endif
+
+void VirtualMachine::execute(BytecodeView bytecode) {
   auto start = std::chrono::high_resolution_clock::now();
+  const int64_t* code = bytecode.data();
   size_t pc = 0;
-  std::vector<size_t> callStack;
-  std::unordered_map<std::string, size_t> functionTable;
+#ifdef MATUR_PL_PROFILE_OPCODES
+  OpcodePairProfile<OpCode> profile;
+#endif
 
-  while (pc < bytecode.size()) {
-    const auto& [operation, operands] = bytecode[pc];
+#ifdef VM_COMPUTED_GOTO
+  static const void* const dispatchTable[] = {
+      &&label_LOAD_CONST,
+      &&label_RESERVE_SLOTS,
+      &&label_STORE_SLOT,
+      &&label_LOAD_SLOT,
+      &&label_DECLARE_ARRAY,
+      &&label_ASSIGN_ARRAY_ELEMENT,
+      &&label_LOAD_ARRAY_ELEMENT,
+      &&label_STORE_GLOBAL,
+      &&label_LOAD_GLOBAL,
+      &&label_ASSIGN_GLOBAL_ELEMENT,
+      &&label_LOAD_GLOBAL_ELEMENT,
+      &&label_ADD,
+      &&label_SUBTRACT,
+      &&label_MULTIPLY,
+      &&label_DIVIDE,
+      &&label_MODULO,
+      &&label_EQUALS,
+      &&label_LESS_THAN,
+      &&label_GREATER_THAN,
+      &&label_LESS_THAN_OR_EQUAL,
+      &&label_GREATER_THAN_OR_EQUAL,
+      &&label_JUMP,
+      &&label_JUMP_IF_FALSE,
+      &&label_ADD_SLOT_CONST,
+      &&label_JUMP_IF_NOT_EQUALS,
+      &&label_JUMP_IF_NOT_LESS_THAN,
+      &&label_JUMP_IF_NOT_GREATER_THAN,
+      &&label_JUMP_IF_NOT_LESS_THAN_OR_EQUAL,
+      &&label_JUMP_IF_NOT_GREATER_THAN_OR_EQUAL,
+      &&label_FOR_LOOP,
+      &&label_STORE_SLOT_KEEP,
+      &&label_DIVIDE_POW2,
+      &&label_MODULO_POW2,
+      &&label_ASSIGN_ARRAY_ELEMENT_UNCHECKED,
+      &&label_LOAD_ARRAY_ELEMENT_UNCHECKED,
+      &&label_ASSIGN_GLOBAL_ELEMENT_UNCHECKED,
+      &&label_LOAD_GLOBAL_ELEMENT_UNCHECKED,
+      &&label_FUNC_DEF,
+      &&label_CALL_FUNC,
+      &&label_CALL,
+      &&label_CALL_FUNC_MEMO,
+      &&label_CALL_MEMO,
+      &&label_RETURN,
+      &&label_PRINT,
+      &&label_POP,
+      &&label_HALT,
+  };
+  static_assert(std::size(dispatchTable) == static_cast<size_t>(OpCode::COUNT),
+                "dispatch table must list every opcode in OpCode order");
 
-    ++operationCount;
-    if (operationCount % 100 == 0) {
-      gc.collect();
-    }
+  DISPATCH();
+#else
+dispatch:
+  VM_PROFILE();
+#endif
 
-    if (operation == "LOAD_CONST") {
-      loadConst(operands);
-    } else if (operation == "DECLARE_VAR") {
-      declareVar(operands);
-    } else if (operation == "ASSIGN_VAR") {
-      assignVar(operands);
-    } else if (operation == "LOAD_VAR") {
-      loadVar(operands);
-    } else if (operation == "DECLARE_ARRAY") {
-      declareArray(operands);
-    } else if (operation == "ASSIGN_ARRAY_ELEMENT") {
-      assignArrayElement(operands);
-    } else if (operation == "LOAD_ARRAY_ELEMENT") {
-      loadArrayElement(operands);
-    } else if (operation == "ADD") {
-      add();
-    } else if (operation == "SUBTRACT") {
-      subtract();
-    } else if (operation == "MULTIPLY") {
-      multiply();
-    } else if (operation == "DIVIDE") {
-      divide();
-    } else if (operation == "MODULO") {
-      modulo();
-    } else if (operation == "EQUALS") {
-      equals();
-    } else if (operation == "LESS_THAN") {
-      lessThan();
-    } else if (operation == "GREATER_THAN") {
-      greaterThan();
-    } else if (operation == "LESS_THAN_OR_EQUAL") {
-      lessThanOrEqual();
-    } else if (operation == "GREATER_THAN_OR_EQUAL") {
-      greaterThanOrEqual();
-    } else if (operation == "JUMP") {
-      pc = operands[0];
-      continue;
-    } else if (operation == "JUMP_IF_FALSE") {
+  switch (static_cast<OpCode>(code[pc])) {
+    TARGET(LOAD_CONST):
+      loadConst(code + pc + 1);
+      pc += 2;
+      DISPATCH();
+    TARGET(RESERVE_SLOTS):
+      storage.assign(code[pc + 1]);
+      framePointer = 0;
+      frameTop = storage.size();
+      pc += 2;
+      DISPATCH();
+    TARGET(STORE_SLOT):
+      storeSlot(framePointer + code[pc + 1]);
+      pc += 2;
+      DISPATCH();
+    TARGET(LOAD_SLOT):
+      loadSlot(framePointer + code[pc + 1]);
+      pc += 2;
+      DISPATCH();
+    TARGET(DECLARE_ARRAY):
+      declareArray(code + pc + 1);
+      pc += 3 + code[pc + 2];
+      DISPATCH();
+    TARGET(ASSIGN_ARRAY_ELEMENT):
+      assignArrayElement(framePointer + code[pc + 1]);
+      pc += 2;
+      DISPATCH();
+    TARGET(LOAD_ARRAY_ELEMENT):
+      loadArrayElement(framePointer + code[pc + 1]);
+      pc += 2;
+      DISPATCH();
+    TARGET(STORE_GLOBAL):
+      storeSlot(code[pc + 1]);
+      pc += 2;
+      DISPATCH();
+    TARGET(LOAD_GLOBAL):
+      loadSlot(code[pc + 1]);
+      pc += 2;
+      DISPATCH();
+    TARGET(ASSIGN_GLOBAL_ELEMENT):
+      assignArrayElement(code[pc + 1]);
+      pc += 2;
+      DISPATCH();
+    TARGET(LOAD_GLOBAL_ELEMENT):
+      loadArrayElement(code[pc + 1]);
+      pc += 2;
+      DISPATCH();
+    TARGET(ADD):
+      STACK_BINARY(Add);
+      DISPATCH();
+    TARGET(SUBTRACT):
+      STACK_BINARY(Subtract);
+      DISPATCH();
+    TARGET(MULTIPLY):
+      STACK_BINARY(Multiply);
+      DISPATCH();
+    TARGET(DIVIDE):
+      STACK_BINARY(Divide);
+      DISPATCH();
+    TARGET(MODULO):
+      STACK_BINARY(Modulo);
+      DISPATCH();
+    TARGET(EQUALS):
+      STACK_BINARY(Equals);
+      DISPATCH();
+    TARGET(LESS_THAN):
+      STACK_BINARY(LessThan);
+      DISPATCH();
+    TARGET(GREATER_THAN):
+      STACK_BINARY(GreaterThan);
+      DISPATCH();
+    TARGET(LESS_THAN_OR_EQUAL):
+      STACK_BINARY(LessThanOrEqual);
+      DISPATCH();
+    TARGET(GREATER_THAN_OR_EQUAL):
+      STACK_BINARY(GreaterThanOrEqual);
+      DISPATCH();
+    TARGET(JUMP):
+      pc = code[pc + 1];
+      DISPATCH();
+    TARGET(JUMP_IF_FALSE): {
       if (stack.empty()) {
         std::cerr << "JUMP_IF_FALSE failed: stack is empty\n";
         return;
       }
       int64_t condition = stack.back();
       stack.pop_back();
-      if (condition == 0) {
-        pc = operands[0];
-        continue;
+      pc = condition == 0 ? code[pc + 1] : pc + 2;
+      DISPATCH();
+    }
+    TARGET(ADD_SLOT_CONST):
+      if (!addSlotConst(framePointer + code[pc + 1], code[pc + 2])) {
+        return;
       }
-    } else if (operation == "FUNC_DEF") {
-      std::string funcName(operands.begin() + 1, operands.end() - 1);
-      auto skip = operands.back();
-      functionTable[funcName] = pc + 1;
-      pc += skip;
-    } else if (operation == "CALL_FUNC") {
-      std::string funcName(operands.begin() + 1, operands.end());
-
-      if (functionTable.find(funcName) == functionTable.end()) {
-        std::cerr << "Function " << funcName << " not found\n";
+      pc += 3;
+      DISPATCH();
+    TARGET(JUMP_IF_NOT_EQUALS):
+      BRANCH_UNLESS(==);
+      DISPATCH();
+    TARGET(JUMP_IF_NOT_LESS_THAN):
+      BRANCH_UNLESS(<);
+      DISPATCH();
+    TARGET(JUMP_IF_NOT_GREATER_THAN):
+      BRANCH_UNLESS(>);
+      DISPATCH();
+    TARGET(JUMP_IF_NOT_LESS_THAN_OR_EQUAL):
+      BRANCH_UNLESS(<=);
+      DISPATCH();
+    TARGET(JUMP_IF_NOT_GREATER_THAN_OR_EQUAL):
+      BRANCH_UNLESS(>=);
+      DISPATCH();
+    TARGET(FOR_LOOP): {
+      Slots::Ref iterator = storage[framePointer + code[pc + 1]];
+      if (!iterator.isInteger()) {
+        std::cerr << "FOR_LOOP failed: iterator in slot " << code[pc + 1] << " is not a scalar value\n";
+        return;
+      }
+      int64_t next = iterator.asInteger() + code[pc + 2];
+      iterator = next;
+      pc = next < code[pc + 3] ? code[pc + 4] : pc + 5;
+      DISPATCH();
+    }
+    TARGET(STORE_SLOT_KEEP):
+      storeSlotKeep(framePointer + code[pc + 1]);
+      pc += 2;
+      DISPATCH();
+    TARGET(DIVIDE_POW2):
+      if (stack.empty()) {
+        std::cerr << "DIVIDE_POW2 failed: stack is empty\n";
+        return;
+      }
+      stack.back() = dividePow2(stack.back(), code[pc + 1]);
+      pc += 2;
+      DISPATCH();
+    TARGET(MODULO_POW2):
+      if (stack.empty()) {
+        std::cerr << "MODULO_POW2 failed: stack is empty\n";
+        return;
+      }
+      stack.back() = moduloPow2(stack.back(), code[pc + 1]);
+      pc += 2;
+      DISPATCH();
+    // Programs that were not verified keep every check, including the bounds
+    // checks the compiler proved unnecessary.
+    TARGET(ASSIGN_ARRAY_ELEMENT_UNCHECKED):
+      assignArrayElement(framePointer + code[pc + 1]);
+      pc += 2;
+      DISPATCH();
+    TARGET(LOAD_ARRAY_ELEMENT_UNCHECKED):
+      loadArrayElement(framePointer + code[pc + 1]);
+      pc += 2;
+      DISPATCH();
+    TARGET(ASSIGN_GLOBAL_ELEMENT_UNCHECKED):
+      assignArrayElement(code[pc + 1]);
+      pc += 2;
+      DISPATCH();
+    TARGET(LOAD_GLOBAL_ELEMENT_UNCHECKED):
+      loadArrayElement(code[pc + 1]);
+      pc += 2;
+      DISPATCH();
+    TARGET(FUNC_DEF):
+      pc += 5 + code[pc + 4];
+      DISPATCH();
+    TARGET(CALL_FUNC):
+      std::cerr << "Unlinked call to function #" << code[pc + 1] << "\n";
+      return;
+    TARGET(CALL): {
+      int64_t argumentCount = code[pc + 3];
+      if (stack.size() < static_cast<size_t>(argumentCount)) {
+        std::cerr << "CALL failed: insufficient arguments on stack\n";
         return;
       }
 
-      callStack.push_back(pc);
-      current_name_scope.push(storage);
-      pc = functionTable[funcName];
-      continue;
-    } else if (operation == "RETURN") {
-      if (callStack.empty() || current_name_scope.empty()) {
-        std::cerr << "RETURN failed: empty call stack or scope stack\n";
+      callStack.push_back({pc + 4, framePointer, frameTop, 0});
+      enterFrame(code[pc + 2], argumentCount);
+      pc = code[pc + 1];
+      DISPATCH();
+    }
+    TARGET(CALL_FUNC_MEMO):
+      std::cerr << "Unlinked call to function #" << code[pc + 1] << "\n";
+      return;
+    TARGET(CALL_MEMO): {
+      int64_t argumentCount = code[pc + 3];
+      if (stack.size() < static_cast<size_t>(argumentCount)) {
+        std::cerr << "CALL failed: insufficient arguments on stack\n";
+        return;
+      }
+      if (code[pc + 4] < 0) {
+        std::cerr << "CALL failed: bad function id " << code[pc + 4] << "\n";
         return;
       }
 
-      pc = callStack.back();
-      callStack.pop_back();
-      storage = current_name_scope.top();
-      current_name_scope.pop();
-    } else if (operation == "PRINT") {
-      print();
-    } else {
-      std::cerr << "Unknown operation: " << operation << "\n";
+      // Arguments were pushed last-to-first, so the first one is on top.
+      memoKey.assign(stack.rbegin(), stack.rbegin() + argumentCount);
+      int64_t result;
+      if (findMemo(code[pc + 4], result)) {
+        stack.resize(stack.size() - argumentCount);
+        stack.push_back(result);
+        pc += 5;
+        DISPATCH();
+      }
+      callStack.push_back({pc + 5, framePointer, frameTop, 0});
+      enterFrame(code[pc + 2], argumentCount);
+      pc = code[pc + 1];
+      DISPATCH();
     }
+    TARGET(RETURN): {
+      if (callStack.empty()) {
+        std::cerr << "RETURN failed: empty call stack\n";
+        return;
+      }
 
-    ++pc;
+      bool memoized = returnsMemoized();
+      pc = leaveFrame().returnPc;
+      if (memoized) {
+        finishMemo(stack.empty() ? std::nullopt : std::optional(stack.back()));
+      }
+      DISPATCH();
+    }
+    TARGET(PRINT):
+      print();
+      ++pc;
+      DISPATCH();
+    TARGET(POP):
+      if (stack.empty()) {
+        std::cerr << "POP failed: stack is empty\n";
+        return;
+      }
+      stack.pop_back();
+      ++pc;
+      DISPATCH();
+    TARGET(HALT):
+      break;
+    default:
+      std::cerr << "Unknown operation: " << code[pc] << "\n";
+      return;
   }
 
+#ifdef MATUR_PL_PROFILE_OPCODES
+  profile.report(std::cerr);
+#endif
   gc.cleanup();
   auto end = std::chrono::high_resolution_clock::now();
   std::chrono::duration<double> duration = end - start;
   std::cout << "Execution time: " << duration.count() << " seconds" << std::endl;
 }
 
-void VirtualMachine::assignVar(const std::vector<int64_t>& operands) {
-  if (operands.size() < 2) {
-    std::cerr << "Invalid assign operation: insufficient operands\n";
-    return;
-  }
+// Verified handlers: the operand stack is a raw buffer sized by the
+// verifier and sp points past its top.
+#define VERIFIED_BINARY(Operation)                                  \
+  do {                                                              \
+    if (!applyOperation<Operation>(sp[-2], sp[-1], sp[-2])) {       \
+      return;                                                       \
+    }                                                               \
+    --sp;                                                           \
+    ++pc;                                                           \
+  } while (0)
 
-  std::string varName;
-  int64_t nameSize = operands[0];
-  for (auto i = 1; i <= nameSize; ++i) {
-    varName += static_cast<char>(operands[i]);
-  }
+#define VERIFIED_BRANCH_UNLESS(cmp)                     \
+  do {                                                  \
+    sp -= 2;                                            \
+    pc = (sp[0] cmp sp[1]) ? pc + 2 : code[pc + 1];     \
+  } while (0)
 
-  if (!stack.empty()) {
-    int64_t value = stack.back();
-    stack.pop_back();
-    auto it = storage.find(varName);
-    if (it != storage.end()) {
-      storage[varName] = value;
-    } else {
-      std::cerr << "Variable not found: " << varName << "\n";
+// The verifier proved that the stack never underflows and has room for each
+// frame's deepest expression, that jumps and calls land on instructions of
+// the right function and that scalar slots never hold arrays. What is left
+// to check at runtime is what depends on values: array indices, and stack
+// room for recursion, once per call.
+void VirtualMachine::executeVerified(BytecodeView bytecode, const BytecodeVerifier::Result& verification) {
+  auto start = std::chrono::high_resolution_clock::now();
+  const int64_t* code = bytecode.data();
+  size_t pc = 0;
+#ifdef MATUR_PL_PROFILE_OPCODES
+  OpcodePairProfile<OpCode> profile;
+#endif
+
+  size_t frameHeight = verification.maxFrameStackHeight;
+  size_t height = verification.recursive ? std::max(frameHeight, kOperandStackSlots) : verification.maxStackHeight;
+  stack.assign(std::max<size_t>(height, 1), 0);
+  int64_t* sp = stack.data();
+  int64_t* stackEnd = stack.data() + stack.size();
+
+#ifdef VM_COMPUTED_GOTO
+  static const void* const dispatchTable[] = {
+      &&label_LOAD_CONST,
+      &&label_RESERVE_SLOTS,
+      &&label_STORE_SLOT,
+      &&label_LOAD_SLOT,
+      &&label_DECLARE_ARRAY,
+      &&label_ASSIGN_ARRAY_ELEMENT,
+      &&label_LOAD_ARRAY_ELEMENT,
+      &&label_STORE_GLOBAL,
+      &&label_LOAD_GLOBAL,
+      &&label_ASSIGN_GLOBAL_ELEMENT,
+      &&label_LOAD_GLOBAL_ELEMENT,
+      &&label_ADD,
+      &&label_SUBTRACT,
+      &&label_MULTIPLY,
+      &&label_DIVIDE,
+      &&label_MODULO,
+      &&label_EQUALS,
+      &&label_LESS_THAN,
+      &&label_GREATER_THAN,
+      &&label_LESS_THAN_OR_EQUAL,
+      &&label_GREATER_THAN_OR_EQUAL,
+      &&label_JUMP,
+      &&label_JUMP_IF_FALSE,
+      &&label_ADD_SLOT_CONST,
+      &&label_JUMP_IF_NOT_EQUALS,
+      &&label_JUMP_IF_NOT_LESS_THAN,
+      &&label_JUMP_IF_NOT_GREATER_THAN,
+      &&label_JUMP_IF_NOT_LESS_THAN_OR_EQUAL,
+      &&label_JUMP_IF_NOT_GREATER_THAN_OR_EQUAL,
+      &&label_FOR_LOOP,
+      &&label_STORE_SLOT_KEEP,
+      &&label_DIVIDE_POW2,
+      &&label_MODULO_POW2,
+      &&label_ASSIGN_ARRAY_ELEMENT_UNCHECKED,
+      &&label_LOAD_ARRAY_ELEMENT_UNCHECKED,
+      &&label_ASSIGN_GLOBAL_ELEMENT_UNCHECKED,
+      &&label_LOAD_GLOBAL_ELEMENT_UNCHECKED,
+      &&label_FUNC_DEF,
+      &&label_CALL_FUNC,
+      &&label_CALL,
+      &&label_CALL_FUNC_MEMO,
+      &&label_CALL_MEMO,
+      &&label_RETURN,
+      &&label_PRINT,
+      &&label_POP,
+      &&label_HALT,
+  };
+  static_assert(std::size(dispatchTable) == static_cast<size_t>(OpCode::COUNT),
+                "dispatch table must list every opcode in OpCode order");
+
+  DISPATCH();
+#else
+dispatch:
+  VM_PROFILE();
+#endif
+
+  switch (static_cast<OpCode>(code[pc])) {
+    TARGET(LOAD_CONST):
+      *sp++ = code[pc + 1];
+      pc += 2;
+      DISPATCH();
+    TARGET(RESERVE_SLOTS):
+      storage.assign(code[pc + 1]);
+      framePointer = 0;
+      frameTop = storage.size();
+      pc += 2;
+      DISPATCH();
+    TARGET(STORE_SLOT):
+      storage[framePointer + code[pc + 1]] = *--sp;
+      pc += 2;
+      DISPATCH();
+    TARGET(LOAD_SLOT):
+      *sp++ = storage[framePointer + code[pc + 1]].asInteger();
+      pc += 2;
+      DISPATCH();
+    TARGET(DECLARE_ARRAY):
+      declareArray(code + pc + 1);
+      pc += 3 + code[pc + 2];
+      DISPATCH();
+    TARGET(ASSIGN_ARRAY_ELEMENT):
+      sp -= 2;
+      if (!writeElement(framePointer + code[pc + 1], sp[0], sp[1])) {
+        return;
+      }
+      pc += 2;
+      DISPATCH();
+    TARGET(LOAD_ARRAY_ELEMENT):
+      if (!readElement(framePointer + code[pc + 1], sp[-1], sp[-1])) {
+        return;
+      }
+      pc += 2;
+      DISPATCH();
+    TARGET(STORE_GLOBAL):
+      storage[code[pc + 1]] = *--sp;
+      pc += 2;
+      DISPATCH();
+    TARGET(LOAD_GLOBAL):
+      *sp++ = storage[code[pc + 1]].asInteger();
+      pc += 2;
+      DISPATCH();
+    TARGET(ASSIGN_GLOBAL_ELEMENT):
+      sp -= 2;
+      if (!writeElement(code[pc + 1], sp[0], sp[1])) {
+        return;
+      }
+      pc += 2;
+      DISPATCH();
+    TARGET(LOAD_GLOBAL_ELEMENT):
+      if (!readElement(code[pc + 1], sp[-1], sp[-1])) {
+        return;
+      }
+      pc += 2;
+      DISPATCH();
+    TARGET(ADD):
+      VERIFIED_BINARY(Add);
+      DISPATCH();
+    TARGET(SUBTRACT):
+      VERIFIED_BINARY(Subtract);
+      DISPATCH();
+    TARGET(MULTIPLY):
+      VERIFIED_BINARY(Multiply);
+      DISPATCH();
+    TARGET(DIVIDE):
+      VERIFIED_BINARY(Divide);
+      DISPATCH();
+    TARGET(MODULO):
+      VERIFIED_BINARY(Modulo);
+      DISPATCH();
+    TARGET(EQUALS):
+      VERIFIED_BINARY(Equals);
+      DISPATCH();
+    TARGET(LESS_THAN):
+      VERIFIED_BINARY(LessThan);
+      DISPATCH();
+    TARGET(GREATER_THAN):
+      VERIFIED_BINARY(GreaterThan);
+      DISPATCH();
+    TARGET(LESS_THAN_OR_EQUAL):
+      VERIFIED_BINARY(LessThanOrEqual);
+      DISPATCH();
+    TARGET(GREATER_THAN_OR_EQUAL):
+      VERIFIED_BINARY(GreaterThanOrEqual);
+      DISPATCH();
+    TARGET(JUMP):
+      pc = code[pc + 1];
+      DISPATCH();
+    TARGET(JUMP_IF_FALSE):
+      pc = *--sp == 0 ? code[pc + 1] : pc + 2;
+      DISPATCH();
+    TARGET(ADD_SLOT_CONST):
+      if (!applyOperation<Add>(storage[framePointer + code[pc + 1]].asInteger(), code[pc + 2], *sp)) {
+        return;
+      }
+      ++sp;
+      pc += 3;
+      DISPATCH();
+    TARGET(JUMP_IF_NOT_EQUALS):
+      VERIFIED_BRANCH_UNLESS(==);
+      DISPATCH();
+    TARGET(JUMP_IF_NOT_LESS_THAN):
+      VERIFIED_BRANCH_UNLESS(<);
+      DISPATCH();
+    TARGET(JUMP_IF_NOT_GREATER_THAN):
+      VERIFIED_BRANCH_UNLESS(>);
+      DISPATCH();
+    TARGET(JUMP_IF_NOT_LESS_THAN_OR_EQUAL):
+      VERIFIED_BRANCH_UNLESS(<=);
+      DISPATCH();
+    TARGET(JUMP_IF_NOT_GREATER_THAN_OR_EQUAL):
+      VERIFIED_BRANCH_UNLESS(>=);
+      DISPATCH();
+    TARGET(FOR_LOOP): {
+      Slots::Ref iterator = storage[framePointer + code[pc + 1]];
+      int64_t next = iterator.asInteger() + code[pc + 2];
+      iterator = next;
+      pc = next < code[pc + 3] ? code[pc + 4] : pc + 5;
+      DISPATCH();
     }
-  } else {
-    std::cerr << "Assign operation failed: stack is empty\n";
-  }
-}
+    TARGET(STORE_SLOT_KEEP):
+      storage[framePointer + code[pc + 1]] = sp[-1];
+      pc += 2;
+      DISPATCH();
+    TARGET(DIVIDE_POW2):
+      sp[-1] = dividePow2(sp[-1], code[pc + 1]);
+      pc += 2;
+      DISPATCH();
+    TARGET(MODULO_POW2):
+      sp[-1] = moduloPow2(sp[-1], code[pc + 1]);
+      pc += 2;
+      DISPATCH();
+    TARGET(ASSIGN_ARRAY_ELEMENT_UNCHECKED):
+      sp -= 2;
+      if (!writeElement<false>(framePointer + code[pc + 1], sp[0], sp[1])) {
+        return;
+      }
+      pc += 2;
+      DISPATCH();
+    TARGET(LOAD_ARRAY_ELEMENT_UNCHECKED):
+      if (!readElement<false>(framePointer + code[pc + 1], sp[-1], sp[-1])) {
+        return;
+      }
+      pc += 2;
+      DISPATCH();
+    TARGET(ASSIGN_GLOBAL_ELEMENT_UNCHECKED):
+      sp -= 2;
+      if (!writeElement<false>(code[pc + 1], sp[0], sp[1])) {
+        return;
+      }
+      pc += 2;
+      DISPATCH();
+    TARGET(LOAD_GLOBAL_ELEMENT_UNCHECKED):
+      if (!readElement<false>(code[pc + 1], sp[-1], sp[-1])) {
+        return;
+      }
+      pc += 2;
+      DISPATCH();
+    TARGET(FUNC_DEF):
+      pc += 5 + code[pc + 4];
+      DISPATCH();
+    TARGET(CALL_FUNC):
+      std::cerr << "Unlinked call to function #" << code[pc + 1] << "\n";
+      return;
+    TARGET(CALL):
+      callStack.push_back({pc + 4, framePointer, frameTop, 0});
+    enterCall: {
+      int64_t argumentCount = code[pc + 3];
+      openFrame(code[pc + 2]);
 
-void VirtualMachine::performArithmeticOperation(const std::function<int64_t(int64_t, int64_t)>& op) {
-  if (stack.size() < 2) {
-    std::cerr << "Arithmetic operation failed: insufficient operands on stack\n";
-    return;
+      // Arguments were pushed last-to-first, so the first one is on top.
+      for (int64_t i = 0; i < argumentCount; ++i) {
+        storage[framePointer + i] = sp[-1 - i];
+      }
+      sp -= argumentCount;
+
+      if (static_cast<size_t>(stackEnd - sp) < frameHeight) {
+        size_t used = sp - stack.data();
+        stack.resize(stack.size() * 2 + frameHeight);
+        sp = stack.data() + used;
+        stackEnd = stack.data() + stack.size();
+      }
+      pc = code[pc + 1];
+      DISPATCH();
+    }
+    TARGET(CALL_FUNC_MEMO):
+      std::cerr << "Unlinked call to function #" << code[pc + 1] << "\n";
+      return;
+    TARGET(CALL_MEMO): {
+      int64_t argumentCount = code[pc + 3];
+      memoKey.assign(std::reverse_iterator(sp), std::reverse_iterator(sp - argumentCount));
+      int64_t result;
+      if (findMemo(code[pc + 4], result)) {
+        sp -= argumentCount;
+        *sp++ = result;
+        pc += 5;
+        DISPATCH();
+      }
+      callStack.push_back({pc + 5, framePointer, frameTop, 0});
+      goto enterCall;
+    }
+    TARGET(RETURN):
+      if (returnsMemoized()) {
+        finishMemo(sp[-1]);
+      }
+      pc = leaveFrame().returnPc;
+      DISPATCH();
+    TARGET(PRINT):
+      std::cout << *--sp << "\n";
+      ++pc;
+      DISPATCH();
+    TARGET(POP):
+      --sp;
+      ++pc;
+      DISPATCH();
+    TARGET(HALT):
+      break;
+    default:
+      std::cerr << "Unknown operation: " << code[pc] << "\n";
+      return;
   }
 
-  int64_t b = stack.back();
-  stack.pop_back();
-  int64_t a = stack.back();
-  stack.pop_back();
-  stack.push_back(op(a, b));
+#ifdef MATUR_PL_PROFILE_OPCODES
+  profile.report(std::cerr);
+#endif
+  gc.cleanup();
+  auto end = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double> duration = end - start;
+  std::cout << "Execution time: " << duration.count() << " seconds" << std::endl;
 }
 
-void VirtualMachine::add() {
-  performArithmeticOperation([](int64_t a, int64_t b) { return a + b; });
-}
+#undef VERIFIED_BRANCH_UNLESS
+#undef VERIFIED_BINARY
 
-void VirtualMachine::subtract() {
-  performArithmeticOperation([](int64_t a, int64_t b) { return a - b; });
-}
+#undef VM_OPCODE
+#define VM_OPCODE RegOp
 
-void VirtualMachine::multiply() {
-  performArithmeticOperation([](int64_t a, int64_t b) { return a * b; });
-}
+// Three-address handlers: read scalar registers, write the result register.
+#define REGISTER_BINARY(Operation)                                            \
+  do {                                                                        \
+    int64_t lhs, rhs, result;                                                 \
+    if (!readScalar(framePointer + code[pc + 2], lhs) ||                      \
+        !readScalar(framePointer + code[pc + 3], rhs) ||                      \
+        !applyOperation<Operation>(lhs, rhs, result)) {                       \
+      return;                                                                 \
+    }                                                                         \
+    storage[framePointer + code[pc + 1]] = result;                            \
+    pc += 4;                                                                  \
+  } while (0)
 
-void VirtualMachine::divide() {
-  performArithmeticOperation([](int64_t a, int64_t b) { return a / b; });
-}
+#define REGISTER_BRANCH_UNLESS(cmp)                                           \
+  do {                                                                        \
+    int64_t lhs, rhs;                                                         \
+    if (!readScalar(framePointer + code[pc + 1], lhs) ||                      \
+        !readScalar(framePointer + code[pc + 2], rhs)) {                      \
+      return;                                                                 \
+    }                                                                         \
+    pc = (lhs cmp rhs) ? pc + 4 : code[pc + 3];                               \
+  } while (0)
 
-void VirtualMachine::modulo() {
-  performArithmeticOperation([](int64_t a, int64_t b) { return a % b; });
-}
+void VirtualMachine::executeRegisters(RegisterBytecodeView bytecode) {
+  auto start = std::chrono::high_resolution_clock::now();
+  const int64_t* code = bytecode.data();
+  size_t pc = 0;
+#ifdef MATUR_PL_PROFILE_OPCODES
+  OpcodePairProfile<RegOp> profile;
+#endif
 
-void VirtualMachine::lessThan() {
-  performComparisonOperation([](int64_t a, int64_t b) { return a < b; });
-}
+#ifdef VM_COMPUTED_GOTO
+  static const void* const dispatchTable[] = {
+      &&label_RESERVE_SLOTS,
+      &&label_LOAD_CONST,
+      &&label_MOVE,
+      &&label_LOAD_GLOBAL,
+      &&label_STORE_GLOBAL,
+      &&label_DECLARE_ARRAY,
+      &&label_LOAD_ELEMENT,
+      &&label_STORE_ELEMENT,
+      &&label_LOAD_GLOBAL_ELEMENT,
+      &&label_STORE_GLOBAL_ELEMENT,
+      &&label_LOAD_ELEMENT_UNCHECKED,
+      &&label_STORE_ELEMENT_UNCHECKED,
+      &&label_LOAD_GLOBAL_ELEMENT_UNCHECKED,
+      &&label_STORE_GLOBAL_ELEMENT_UNCHECKED,
+      &&label_ADD,
+      &&label_SUBTRACT,
+      &&label_MULTIPLY,
+      &&label_DIVIDE,
+      &&label_MODULO,
+      &&label_ADD_CONST,
+      &&label_DIVIDE_POW2,
+      &&label_MODULO_POW2,
+      &&label_EQUALS,
+      &&label_LESS_THAN,
+      &&label_GREATER_THAN,
+      &&label_LESS_THAN_OR_EQUAL,
+      &&label_GREATER_THAN_OR_EQUAL,
+      &&label_JUMP,
+      &&label_JUMP_IF_FALSE,
+      &&label_JUMP_IF_NOT_EQUALS,
+      &&label_JUMP_IF_NOT_LESS_THAN,
+      &&label_JUMP_IF_NOT_GREATER_THAN,
+      &&label_JUMP_IF_NOT_LESS_THAN_OR_EQUAL,
+      &&label_JUMP_IF_NOT_GREATER_THAN_OR_EQUAL,
+      &&label_FOR_LOOP,
+      &&label_CALL,
+      &&label_CALL_MEMO,
+      &&label_RETURN,
+      &&label_RETURN_VOID,
+      &&label_PRINT,
+      &&label_HALT,
+  };
+  static_assert(std::size(dispatchTable) == static_cast<size_t>(RegOp::COUNT),
+                "dispatch table must list every opcode in RegOp order");
+
+  DISPATCH();
+#else
+dispatch:
+  VM_PROFILE();
+#endif
 
-void VirtualMachine::greaterThan() {
-  performComparisonOperation([](int64_t a, int64_t b) { return a > b; });
+  switch (static_cast<RegOp>(code[pc])) {
+    TARGET(RESERVE_SLOTS):
+      storage.assign(code[pc + 1]);
+      framePointer = 0;
+      frameTop = storage.size();
+      pc += 2;
+      DISPATCH();
+    TARGET(LOAD_CONST):
+      storage[framePointer + code[pc + 1]] = code[pc + 2];
+      pc += 3;
+      DISPATCH();
+    TARGET(MOVE):
+      copySlot(framePointer + code[pc + 1], framePointer + code[pc + 2]);
+      pc += 3;
+      DISPATCH();
+    TARGET(LOAD_GLOBAL):
+      copySlot(framePointer + code[pc + 1], code[pc + 2]);
+      pc += 3;
+      DISPATCH();
+    TARGET(STORE_GLOBAL):
+      copySlot(code[pc + 1], framePointer + code[pc + 2]);
+      pc += 3;
+      DISPATCH();
+    TARGET(DECLARE_ARRAY):
+      declareArray(code + pc + 1);
+      pc += 3 + code[pc + 2];
+      DISPATCH();
+    TARGET(LOAD_ELEMENT):
+      if (!loadElement(framePointer + code[pc + 1], framePointer + code[pc + 2], framePointer + code[pc + 3])) {
+        return;
+      }
+      pc += 4;
+      DISPATCH();
+    TARGET(STORE_ELEMENT):
+      if (!storeElement(framePointer + code[pc + 1], framePointer + code[pc + 2], framePointer + code[pc + 3])) {
+        return;
+      }
+      pc += 4;
+      DISPATCH();
+    TARGET(LOAD_GLOBAL_ELEMENT):
+      if (!loadElement(framePointer + code[pc + 1], code[pc + 2], framePointer + code[pc + 3])) {
+        return;
+      }
+      pc += 4;
+      DISPATCH();
+    TARGET(STORE_GLOBAL_ELEMENT):
+      if (!storeElement(code[pc + 1], framePointer + code[pc + 2], framePointer + code[pc + 3])) {
+        return;
+      }
+      pc += 4;
+      DISPATCH();
+    TARGET(LOAD_ELEMENT_UNCHECKED):
+      if (!loadElement<false>(framePointer + code[pc + 1], framePointer + code[pc + 2], framePointer + code[pc + 3])) {
+        return;
+      }
+      pc += 4;
+      DISPATCH();
+    TARGET(STORE_ELEMENT_UNCHECKED):
+      if (!storeElement<false>(framePointer + code[pc + 1], framePointer + code[pc + 2], framePointer + code[pc + 3])) {
+        return;
+      }
+      pc += 4;
+      DISPATCH();
+    TARGET(LOAD_GLOBAL_ELEMENT_UNCHECKED):
+      if (!loadElement<false>(framePointer + code[pc + 1], code[pc + 2], framePointer + code[pc + 3])) {
+        return;
+      }
+      pc += 4;
+      DISPATCH();
+    TARGET(STORE_GLOBAL_ELEMENT_UNCHECKED):
+      if (!storeElement<false>(code[pc + 1], framePointer + code[pc + 2], framePointer + code[pc + 3])) {
+        return;
+      }
+      pc += 4;
+      DISPATCH();
+    TARGET(ADD):
+      REGISTER_BINARY(Add);
+      DISPATCH();
+    TARGET(SUBTRACT):
+      REGISTER_BINARY(Subtract);
+      DISPATCH();
+    TARGET(MULTIPLY):
+      REGISTER_BINARY(Multiply);
+      DISPATCH();
+    TARGET(DIVIDE):
+      REGISTER_BINARY(Divide);
+      DISPATCH();
+    TARGET(MODULO):
+      REGISTER_BINARY(Modulo);
+      DISPATCH();
+    TARGET(ADD_CONST): {
+      int64_t value;
+      if (!readScalar(framePointer + code[pc + 2], value) || !applyOperation<Add>(value, code[pc + 3], value)) {
+        return;
+      }
+      storage[framePointer + code[pc + 1]] = value;
+      pc += 4;
+      DISPATCH();
+    }
+    TARGET(DIVIDE_POW2): {
+      int64_t value;
+      if (!readScalar(framePointer + code[pc + 2], value)) {
+        return;
+      }
+      storage[framePointer + code[pc + 1]] = dividePow2(value, code[pc + 3]);
+      pc += 4;
+      DISPATCH();
+    }
+    TARGET(MODULO_POW2): {
+      int64_t value;
+      if (!readScalar(framePointer + code[pc + 2], value)) {
+        return;
+      }
+      storage[framePointer + code[pc + 1]] = moduloPow2(value, code[pc + 3]);
+      pc += 4;
+      DISPATCH();
+    }
+    TARGET(EQUALS):
+      REGISTER_BINARY(Equals);
+      DISPATCH();
+    TARGET(LESS_THAN):
+      REGISTER_BINARY(LessThan);
+      DISPATCH();
+    TARGET(GREATER_THAN):
+      REGISTER_BINARY(GreaterThan);
+      DISPATCH();
+    TARGET(LESS_THAN_OR_EQUAL):
+      REGISTER_BINARY(LessThanOrEqual);
+      DISPATCH();
+    TARGET(GREATER_THAN_OR_EQUAL):
+      REGISTER_BINARY(GreaterThanOrEqual);
+      DISPATCH();
+    TARGET(JUMP):
+      pc = code[pc + 1];
+      DISPATCH();
+    TARGET(JUMP_IF_FALSE): {
+      int64_t condition;
+      if (!readScalar(framePointer + code[pc + 1], condition)) {
+        return;
+      }
+      pc = condition == 0 ? code[pc + 2] : pc + 3;
+      DISPATCH();
+    }
+    TARGET(JUMP_IF_NOT_EQUALS):
+      REGISTER_BRANCH_UNLESS(==);
+      DISPATCH();
+    TARGET(JUMP_IF_NOT_LESS_THAN):
+      REGISTER_BRANCH_UNLESS(<);
+      DISPATCH();
+    TARGET(JUMP_IF_NOT_GREATER_THAN):
+      REGISTER_BRANCH_UNLESS(>);
+      DISPATCH();
+    TARGET(JUMP_IF_NOT_LESS_THAN_OR_EQUAL):
+      REGISTER_BRANCH_UNLESS(<=);
+      DISPATCH();
+    TARGET(JUMP_IF_NOT_GREATER_THAN_OR_EQUAL):
+      REGISTER_BRANCH_UNLESS(>=);
+      DISPATCH();
+    TARGET(FOR_LOOP): {
+      Slots::Ref iterator = storage[framePointer + code[pc + 1]];
+      if (!iterator.isInteger()) {
+        std::cerr << "FOR_LOOP failed: iterator in slot " << code[pc + 1] << " is not a scalar value\n";
+        return;
+      }
+      int64_t next = iterator.asInteger() + code[pc + 2];
+      iterator = next;
+      pc = next < code[pc + 3] ? code[pc + 4] : pc + 5;
+      DISPATCH();
+    }
+    TARGET(CALL):
+      callStack.push_back({pc + 6, framePointer, frameTop, framePointer + code[pc + 1]});
+      enterRegisterFrame(code[pc + 3], code[pc + 4], code[pc + 5]);
+      pc = code[pc + 2];
+      DISPATCH();
+    TARGET(CALL_MEMO): {
+      // Only calls with scalar arguments are looked up; any other runs as
+      // a plain CALL.
+      size_t arguments = framePointer + code[pc + 4];
+      int64_t argumentCount = code[pc + 5];
+      memoKey.clear();
+      for (int64_t i = 0; i < argumentCount && storage[arguments + i].isInteger(); ++i) {
+        memoKey.push_back(storage[arguments + i].asInteger());
+      }
+      int64_t result;
+      if (memoKey.size() == static_cast<size_t>(argumentCount)) {
+        if (findMemo(code[pc + 6], result)) {
+          storage[framePointer + code[pc + 1]] = result;
+          pc += 7;
+          DISPATCH();
+        }
+      }
+      callStack.push_back({pc + 7, framePointer, frameTop, framePointer + code[pc + 1]});
+      enterRegisterFrame(code[pc + 3], code[pc + 4], code[pc + 5]);
+      pc = code[pc + 2];
+      DISPATCH();
+    }
+    TARGET(RETURN): {
+      if (callStack.empty()) {
+        std::cerr << "RETURN failed: empty call stack\n";
+        return;
+      }
+
+      // The result is copied before the frame is released, so an array
+      // returned from a local keeps a reference throughout.
+      copySlot(callStack.back().resultSlot, framePointer + code[pc + 1]);
+      if (returnsMemoized()) {
+        Slots::Ref result = storage[framePointer + code[pc + 1]];
+        finishMemo(result.isInteger() ? std::optional(result.asInteger()) : std::nullopt);
+      }
+      pc = leaveFrame().returnPc;
+      DISPATCH();
+    }
+    TARGET(RETURN_VOID): {
+      if (callStack.empty()) {
+        std::cerr << "RETURN failed: empty call stack\n";
+        return;
+      }
+
+      if (returnsMemoized()) {
+        finishMemo(0);
+      }
+      const CallFrame frame = leaveFrame();
+      storage[frame.resultSlot] = int64_t{0};
+      pc = frame.returnPc;
+      DISPATCH();
+    }
+    TARGET(PRINT): {
+      int64_t value;
+      if (!readScalar(framePointer + code[pc + 1], value)) {
+        return;
+      }
+      std::cout << value << "\n";
+      pc += 2;
+      DISPATCH();
+    }
+    TARGET(HALT):
+      break;
+    default:
+      std::cerr << "Unknown operation: " << code[pc] << "\n";
+      return;
+  }
+
+#ifdef MATUR_PL_PROFILE_OPCODES
+  profile.report(std::cerr);
+#endif
+  gc.cleanup();
+  auto end = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double> duration = end - start;
+  std::cout << "Execution time: " << duration.count() << " seconds" << std::endl;
 }
 
-void VirtualMachine::lessThanOrEqual() {
-  performComparisonOperation([](int64_t a, int64_t b) { return a <= b; });
+#undef REGISTER_BRANCH_UNLESS
+#undef REGISTER_BINARY
+#undef VM_OPCODE
+#undef DISPATCH
+#undef TARGET
+#undef BRANCH_UNLESS
+#undef STACK_BINARY
+#undef VM_PROFILE
+
+void VirtualMachine::enterFrame(int64_t frameSize, int64_t argumentCount) {
+  openFrame(frameSize);
+
+  // Arguments were pushed last-to-first, so the first one is on top.
+  for (int64_t i = 0; i < argumentCount; ++i) {
+    storage[framePointer + i] = stack.back();
+    stack.pop_back();
+  }
 }
 
-void VirtualMachine::greaterThanOrEqual() {
-  performComparisonOperation([](int64_t a, int64_t b) { return a >= b; });
+void VirtualMachine::enterRegisterFrame(int64_t frameSize, int64_t firstArgument, int64_t argumentCount) {
+  size_t arguments = framePointer + firstArgument;
+  openFrame(frameSize);
+
+  // Argument registers are temporaries of the caller that are dead after
+  // the call, so their values (and array references) move to the callee.
+  for (int64_t i = 0; i < argumentCount; ++i) {
+    storage[framePointer + i] = storage[arguments + i];
+    storage[arguments + i] = Value{};
+  }
 }
 
-void VirtualMachine::equals() {
-  performComparisonOperation([](int64_t a, int64_t b) { return a == b; });
+VirtualMachine::CallFrame VirtualMachine::leaveFrame() {
+  releaseFrame();
+  CallFrame frame = callStack.back();
+  callStack.pop_back();
+  framePointer = frame.framePointer;
+  frameTop = frame.frameTop;
+  return frame;
 }
 
-void VirtualMachine::performComparisonOperation(const std::function<bool(int64_t, int64_t)>& op) {
-  if (stack.size() < 2) {
-    std::cerr << "Comparison operation failed: insufficient operands on stack\n";
-    return;
+bool VirtualMachine::findMemo(int64_t function, int64_t& result) {
+  if (static_cast<size_t>(function) >= memoTables.size()) {
+    memoTables.resize(function + 1);
   }
-
-  int64_t b = stack.back();
-  stack.pop_back();
-  int64_t a = stack.back();
-  stack.pop_back();
-  stack.push_back(op(a, b) ? 1 : 0);
+  if (auto cached = memoTables[function].find(memoKey)) {
+    result = *cached;
+    return true;
+  }
+  pendingMemos.push_back({callStack.size() + 1, function, memoKey});
+  return false;
 }
 
-void VirtualMachine::loadConst(const std::vector<int64_t>& operands) {
-  if (!operands.empty()) {
-    stack.push_back(operands[0]);
-  } else {
-    std::cerr << "LoadConst operation failed: no operands\n";
+void VirtualMachine::finishMemo(std::optional<int64_t> result) {
+  PendingMemo memo = std::move(pendingMemos.back());
+  pendingMemos.pop_back();
+  if (result) {
+    memoTables[memo.function].insert(std::move(memo.arguments), *result);
   }
 }
 
-void VirtualMachine::declareVar(const std::vector<int64_t>& operands) {
-  if (operands.size() < 2) return;
+// Drops the references held by the returning frame, so arrays that were
+// shared with it can be written by the caller without being copied.
+void VirtualMachine::releaseFrame() {
+  if (heap.liveCount() == 0) {
+    return;
+  }
+  for (size_t slot = framePointer; slot < frameTop; ++slot) {
+    if (storage[slot].isArray()) {
+      heap.release(storage[slot].asArray());
+    }
+  }
+}
 
-  std::string varName;
-  int64_t nameSize = operands[0];
+void VirtualMachine::openFrame(int64_t frameSize) {
+  framePointer = frameTop;
+  frameTop += frameSize;
 
-  for (auto i = 1; i <= nameSize; ++i) {
-    varName += static_cast<char>(operands[i]);
+  size_t reused = std::min(frameTop, storage.size());
+  storage.reset(framePointer, reused);
+  if (frameTop > storage.size()) {
+    storage.resize(frameTop);
   }
+}
 
+void VirtualMachine::storeSlot(size_t slot) {
   if (!stack.empty()) {
     int64_t value = stack.back();
     stack.pop_back();
-    storage[varName] = value;
+    storage[slot] = value;
   } else {
-    std::cerr << "DeclareVar operation failed: stack is empty\n";
+    std::cerr << "Store operation failed: stack is empty\n";
   }
 }
 
-void VirtualMachine::loadVar(const std::vector<int64_t>& operands) {
-  if (operands.size() < 2) return;
+void VirtualMachine::storeSlotKeep(size_t slot) {
+  if (!stack.empty()) {
+    storage[slot] = stack.back();
+  } else {
+    std::cerr << "Store operation failed: stack is empty\n";
+  }
+}
 
-  std::string varName;
-  int64_t nameSize = operands[0];
+bool VirtualMachine::popOperands(int64_t& a, int64_t& b) {
+  if (stack.size() < 2) {
+    std::cerr << "Comparison operation failed: insufficient operands on stack\n";
+    return false;
+  }
 
-  for (auto i = 1; i <= nameSize; ++i) {
-    varName += static_cast<char>(operands[i]);
+  b = stack.back();
+  stack.pop_back();
+  a = stack.back();
+  stack.pop_back();
+  return true;
+}
+
+bool VirtualMachine::addSlotConst(size_t slot, int64_t value) {
+  int64_t current;
+  int64_t result;
+  if (!readScalar(slot, current) || !applyOperation<Add>(current, value, result)) {
+    return false;
   }
+  stack.push_back(result);
+  return true;
+}
 
-  auto it = storage.find(varName);
-  if (it != storage.end()) {
-    if (auto* val = std::get_if<int64_t>(&it->second)) {
-      stack.push_back(*val);
-    } else {
-      std::cerr << "Variable is not a scalar value: " << varName << "\n";
-    }
+bool VirtualMachine::reportNotScalar(size_t slot) {
+  std::cerr << "Variable in slot " << slot << " is not a scalar value\n";
+  return false;
+}
+
+void VirtualMachine::loadConst(const int64_t* operands) {
+  stack.push_back(operands[0]);
+}
+
+void VirtualMachine::loadSlot(size_t slot) {
+  if (storage[slot].isInteger()) {
+    stack.push_back(storage[slot].asInteger());
   } else {
-    std::cerr << "Variable not found: " << varName << "\n";
+    std::cerr << "Variable in slot " << slot << " is not a scalar value\n";
   }
 }
 
@@ -267,40 +1423,23 @@ void VirtualMachine::print() {
   }
 }
 
-void VirtualMachine::declareArray(const std::vector<int64_t>& operands) {
-  if (operands.size() < 2) {
-    std::cerr << "Invalid array declaration: insufficient operands\n";
-    return;
-  }
-
-  int64_t size = operands[0];
-  std::string arrayName;
-  int64_t nameSize = operands[1];
-
-  for (auto i = 2; i < 2 + nameSize; ++i) {
-    arrayName += static_cast<char>(operands[i]);
-  }
+void VirtualMachine::declareArray(const int64_t* operands) {
+  size_t slot = framePointer + operands[0];
+  int64_t size = operands[1];
 
-  if (storage.find(arrayName) != storage.end()) {
-    std::cerr << "Array already declared or variable already exists with the name: " << arrayName << "\n";
+  if (storage[slot].isArray()) {
+    std::cerr << "Array already declared in slot: " << slot << "\n";
     return;
   }
 
-  std::vector<int64_t> arrayValues;
-  size_t valuesStart = 2 + nameSize;
-
-  for (size_t i = valuesStart; i < operands.size(); ++i) {
-    arrayValues.push_back(operands[i]);
-  }
-
-  while (arrayValues.size() < static_cast<size_t>(size)) {
-    arrayValues.push_back(0);
-  }
-
-  storage[arrayName] = arrayValues;
+  // Collect before allocating, so a minor collection does not promote the
+  // array that is being declared.
+  gc.step();
+  const int64_t* values = operands + 2;
+  storage[slot] = Value::array(heap.allocate(values, size));
 }
 
-void VirtualMachine::assignArrayElement(const std::vector<int64_t>& operands) {
+void VirtualMachine::assignArrayElement(size_t slot) {
   if (stack.empty()) {
     std::cerr << "Stack is empty for value\n";
     return;
@@ -316,36 +1455,10 @@ void VirtualMachine::assignArrayElement(const std::vector<int64_t>& operands) {
 
   int64_t index = stack.back();
   stack.pop_back();
-
-  if (operands.size() < 2) {
-    std::cerr << "Invalid ASSIGN_ARRAY_ELEMENT operation: insufficient operands\n";
-    return;
-  }
-
-  std::string arrayName;
-  int64_t nameSize = operands[0];
-  for (auto i = 1; i <= nameSize; ++i) {
-    arrayName += static_cast<char>(operands[i]);
-  }
-
-  auto it = storage.find(arrayName);
-  if (it == storage.end()) {
-    std::cerr << "Array not found: " << arrayName << "\n";
-    return;
-  }
-
-  if (auto* arr = std::get_if<std::vector<int64_t>>(&it->second)) {
-    if (index < 0 || index >= static_cast<int64_t>(arr->size())) {
-      std::cerr << "Index out of bounds for array: " << arrayName << " index: " << index << "\n";
-      return;
-    }
-    (*arr)[index] = value;
-  } else {
-    std::cerr << "Variable is not an array: " << arrayName << "\n";
-  }
+  writeElement(slot, index, value);
 }
 
-void VirtualMachine::loadArrayElement(const std::vector<int64_t>& operands) {
+void VirtualMachine::loadArrayElement(size_t slot) {
   if (stack.empty()) {
     std::cerr << "Stack is empty\n";
     return;
@@ -354,32 +1467,66 @@ void VirtualMachine::loadArrayElement(const std::vector<int64_t>& operands) {
   int64_t index = stack.back();
   stack.pop_back();
 
-  if (operands.size() < 2) {
-    std::cerr << "Invalid array element load: insufficient operands\n";
-    return;
+  int64_t value;
+  if (readElement(slot, index, value)) {
+    stack.push_back(value);
   }
+}
+
+template <bool kCheckBounds>
+bool VirtualMachine::loadElement(size_t dst, size_t arraySlot, size_t indexSlot) {
+  int64_t index;
+  int64_t value;
+  if (!readScalar(indexSlot, index) || !readElement<kCheckBounds>(arraySlot, index, value)) {
+    return false;
+  }
+  storage[dst] = value;
+  return true;
+}
 
-  std::string arrayName;
-  int64_t nameSize = operands[0];
+template <bool kCheckBounds>
+bool VirtualMachine::storeElement(size_t arraySlot, size_t indexSlot, size_t srcSlot) {
+  int64_t index;
+  int64_t value;
+  if (!readScalar(indexSlot, index) || !readScalar(srcSlot, value)) {
+    return false;
+  }
+  return writeElement<kCheckBounds>(arraySlot, index, value);
+}
 
-  for (auto i = 1; i < 1 + nameSize; ++i) {
-    arrayName += static_cast<char>(operands[i]);
+template <bool kCheckBounds>
+bool VirtualMachine::readElement(size_t slot, int64_t index, int64_t& value) {
+  if (!storage[slot].isArray()) {
+    std::cerr << "Variable in slot " << slot << " is not an array\n";
+    return false;
   }
 
-  auto it = storage.find(arrayName);
-  if (it == storage.end()) {
-    std::cerr << "Array not declared: " << arrayName << "\n";
-    return;
+  const std::vector<int64_t>& arr = heap.get(storage[slot].asArray());
+  if (kCheckBounds && (index < 0 || index >= static_cast<int64_t>(arr.size()))) {
+    std::cerr << "Array index out of bounds: " << index << "\n";
+    return false;
   }
+  value = arr[index];
+  return true;
+}
 
-  if (auto* arr = std::get_if<std::vector<int64_t>>(&it->second)) {
-    if (index < 0 || index >= static_cast<int64_t>(arr->size())) {
-      std::cerr << "Array index out of bounds: " << index << "\n";
-      return;
-    }
+template <bool kCheckBounds>
+bool VirtualMachine::writeElement(size_t slot, int64_t index, int64_t value) {
+  if (!storage[slot].isArray()) {
+    std::cerr << "Variable in slot " << slot << " is not an array\n";
+    return false;
+  }
 
-    stack.push_back((*arr)[index]);
-  } else {
-    std::cerr << "Variable is not an array: " << arrayName << "\n";
+  uint64_t handle = storage[slot].asArray();
+  if (kCheckBounds && (index < 0 || index >= static_cast<int64_t>(heap.get(handle).size()))) {
+    std::cerr << "Index out of bounds for array in slot: " << slot << " index: " << index << "\n";
+    return false;
+  }
+  heap.writable(handle)[index] = value;
+  if (handle != storage[slot].asArray()) {
+    // The write copied a shared array.
+    storage[slot] = Value::array(handle);
+    gc.step();
   }
+  return true;
 }
@@ -2,55 +2,127 @@
 #define VIRTUAL_MACHINE_H
 
 #include <iostream>
+#include <optional>
 #include <unordered_map>
 #include <vector>
 #include <string>
-#include <tuple>
-#include <functional>
-#include <variant>
+#include "ArrayHeap.h"
+#include "Bytecode.h"
+#include "BytecodeVerifier.h"
 #include "GarbageCollector.h"
-
-using Value = std::variant<int64_t, std::vector<int64_t>>;
+#include "MemoTable.h"
+#include "RegisterBytecode.h"
+#include "Value.h"
 
 class VirtualMachine {
  public:
   VirtualMachine();
 
-  void execute(const std::vector<std::tuple<std::string, std::vector<int64_t>>>& bytecode);
+  void execute(BytecodeView bytecode);
+  // Runs bytecode that BytecodeVerifier accepted, without the checks the
+  // verifier already proved unnecessary.
+  void executeVerified(BytecodeView bytecode, const BytecodeVerifier::Result& verification);
+  // Runs register bytecode in the same frame stack, one register per slot.
+  void executeRegisters(RegisterBytecodeView bytecode);
+
+  // Bytes the program may allocate before the garbage collector starts a
+  // collection (GarbageCollector::kDefaultBudgetBytes by default).
+  void setGcBudget(size_t bytes);
+  void setGcThreads(size_t threads);
+  void enableGcStats();
+  [[nodiscard]] GcStats getGcStats() const;
+  // Hits and misses of every memo table the program looked calls up in.
+  void printMemoStats(std::ostream& out) const;
 
-  std::unordered_map<std::string, Value>& getStorage();
+  Slots& getStorage();
   std::vector<int64_t>& getStack();
 
  private:
-  std::unordered_map<std::string, Value> storage;
+  struct CallFrame {
+    size_t returnPc;
+    size_t framePointer;
+    size_t frameTop;
+    size_t resultSlot;  // register mode: caller slot that receives the return value
+  };
+
+  // A memoized call that is running: the call stack depth of its frame, and
+  // the arguments its result is for. Kept apart from CallFrame, which every
+  // call pushes and is faster at 32 bytes.
+  struct PendingMemo {
+    size_t depth;
+    int64_t function;
+    std::vector<int64_t> arguments;
+  };
+
+  // Capacity reserved up front for the frame stack, so calls do not
+  // reallocate it unless the recursion gets deep.
+  static constexpr size_t kFrameStackSlots = 4096;
+  // Operand stack reserved for verified programs whose depth is unbounded
+  // because of recursion.
+  static constexpr size_t kOperandStackSlots = 4096;
+
+  // Frame stack: the globals frame sits at the bottom, the running function's
+  // frame is [framePointer, frameTop). Slots past frameTop belong to frames
+  // that already returned.
+  Slots storage;
   std::vector<int64_t> stack;
-  std::stack<std::unordered_map<std::string, Value>> current_name_scope;
-  size_t operationCount;
+  std::vector<CallFrame> callStack;
+  size_t framePointer;
+  size_t frameTop;
+  ArrayHeap heap;
   GarbageCollector gc;
+  // Memo tables by function id, the memoized calls still running and the
+  // arguments of the call being looked up.
+  std::vector<MemoTable> memoTables;
+  std::vector<PendingMemo> pendingMemos;
+  std::vector<int64_t> memoKey;
+
+  void openFrame(int64_t frameSize);
+  void enterFrame(int64_t frameSize, int64_t argumentCount);
+  void enterRegisterFrame(int64_t frameSize, int64_t firstArgument, int64_t argumentCount);
+  CallFrame leaveFrame();
+  void releaseFrame();
+
+  // Looks memoKey up in the function's memo table. A miss is remembered
+  // for the frame the call pushes next, until finishMemo, which the frame's
+  // RETURN reaches with its result, or without one when the result cannot
+  // be cached.
+  bool findMemo(int64_t function, int64_t& result);
+  [[nodiscard]] bool returnsMemoized() const {
+    return !pendingMemos.empty() && pendingMemos.back().depth == callStack.size();
+  }
+  void finishMemo(std::optional<int64_t> result);
+
+  // Pops two operands and pushes Operation applied to them. Instantiated
+  // per operator in VirtualMachine.cpp.
+  template <typename Operation>
+  bool binaryOperation();
+  bool popOperands(int64_t& a, int64_t& b);
+
+  void storeSlot(size_t slot);
+  void storeSlotKeep(size_t slot);
+  void loadSlot(size_t slot);
+  bool addSlotConst(size_t slot, int64_t value);
+
+  void declareArray(const int64_t* operands);
+  void assignArrayElement(size_t slot);
+  void loadArrayElement(size_t slot);
+
+  void loadConst(const int64_t* operands);
 
-  void add();
-  void subtract();
-  void multiply();
-  void divide();
-  void modulo();
-  void performArithmeticOperation(const std::function<int64_t(int64_t, int64_t)>& op);
-
-  void equals();
-  void lessThan();
-  void greaterThan();
-  void lessThanOrEqual();
-  void greaterThanOrEqual();
-  void performComparisonOperation(const std::function<bool(int64_t, int64_t)>& op);
-
-  void declareVar(const std::vector<int64_t>& operands);
-  void assignVar(const std::vector<int64_t>& operands);
-  void loadVar(const std::vector<int64_t>& operands);
-
-  void declareArray(const std::vector<int64_t>& operands);
-  void assignArrayElement(const std::vector<int64_t>& operands);
-  void loadArrayElement(const std::vector<int64_t>& operands);
-
-  void loadConst(const std::vector<int64_t>& operands);
+  void copySlot(size_t dst, size_t src);
+  bool readScalar(size_t slot, int64_t& value);
+  bool reportNotScalar(size_t slot);
+  // Element accesses. Without kCheckBounds the index is trusted to be inside
+  // the array, as the compiler proved for the *_UNCHECKED opcodes.
+  template <bool kCheckBounds = true>
+  bool loadElement(size_t dst, size_t arraySlot, size_t indexSlot);
+  template <bool kCheckBounds = true>
+  bool storeElement(size_t arraySlot, size_t indexSlot, size_t srcSlot);
+  template <bool kCheckBounds = true>
+  bool readElement(size_t slot, int64_t index, int64_t& value);
+  template <bool kCheckBounds = true>
+  bool writeElement(size_t slot, int64_t index, int64_t value);
 
   void print();
 };